@@ -0,0 +1,101 @@
+// Actor throughput: ping-pong and fan-in against the number of workers.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched actor.c ../src/sched/actor.c
+//     ../src/sched/topology.c ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s
+//     ../queue/queue.c -lpthread -o actor
+//   ./actor [max-workers]
+//
+// `ping-pong`: PAIRS pairs of actors send a message back and forth
+// ROUNDS times, so every message finds an empty mailbox and the
+// receiver parks and is woken again. `fan-in`: SENDERS actors each send
+// MESSAGES messages to one collector, which mostly finds its mailbox
+// full and processes up to `batch` messages per turn; it is run with a
+// batch of 1 and of 64. Reports messages per second for 1, 2, 4, ...
+// workers.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "actor.h"
+
+#define PAIRS 8
+#define ROUNDS 20000
+#define SENDERS 64
+#define MESSAGES 20000
+
+// ping-pong
+
+static void pong(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 0; i < ROUNDS; i++) {
+    lh_actor *from = (lh_actor *)lh_ptr_value(lh_actor_receive());
+    lh_actor_send(from, lh_value_long(i));
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static void ping(void *res, uint8_t *closure, lh_value arg) {
+  lh_actor *partner = (lh_actor *)lh_ptr_value(arg);
+  long sum = 0;
+  for (long i = 0; i < ROUNDS; i++) {
+    lh_actor_send(partner, lh_value_ptr(lh_actor_self()));
+    sum += lh_long_value(lh_actor_receive());
+  }
+  *(lh_value *)res = lh_value_long(sum);
+}
+
+static lh_actionfun ping_fun = {ping};
+static lh_actionfun pong_fun = {pong};
+
+static double ping_pong(int workers) {
+  lh_actors *actors = lh_actors_start(workers, 0);
+  double t0 = now();
+  for (int i = 0; i < PAIRS; i++) {
+    lh_actor *p = lh_actor_spawn(actors, &pong_fun, lh_value_null);
+    lh_actor_spawn(actors, &ping_fun, lh_value_ptr(p));
+  }
+  lh_actors_join(actors);
+  return 2.0 * PAIRS * ROUNDS / (now() - t0);
+}
+
+// fan-in
+
+static long collected;
+
+static void collector(void *res, uint8_t *closure, lh_value arg) {
+  long sum = 0;
+  for (long i = 0; i < SENDERS * MESSAGES; i++) sum += lh_long_value(lh_actor_receive());
+  collected = sum;
+  *(lh_value *)res = lh_value_null;
+}
+
+static void sender(void *res, uint8_t *closure, lh_value arg) {
+  lh_actor *to = (lh_actor *)lh_ptr_value(arg);
+  for (long i = 0; i < MESSAGES; i++) lh_actor_send(to, lh_value_long(1));
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun collector_fun = {collector};
+static lh_actionfun sender_fun = {sender};
+
+static double fan_in(int workers, long batch) {
+  lh_actors *actors = lh_actors_start(workers, batch);
+  double t0 = now();
+  lh_actor *c = lh_actor_spawn(actors, &collector_fun, lh_value_null);
+  for (int i = 0; i < SENDERS; i++) lh_actor_spawn(actors, &sender_fun, lh_value_ptr(c));
+  lh_actors_join(actors);
+  double secs = now() - t0;
+  if (collected != (long)SENDERS * MESSAGES) printf("fan-in lost messages: %ld\n", collected);
+  return (double)SENDERS * MESSAGES / secs;
+}
+
+int main(int argc, char **argv) {
+  int max = (argc > 1 ? atoi(argv[1]) : 4);
+  printf("workers  ping-pong      fan-in (batch 1)  fan-in (batch 64)\n");
+  for (int workers = 1; workers <= max; workers *= 2) {
+    double pp = ping_pong(workers);
+    double f1 = fan_in(workers, 1);
+    double f64 = fan_in(workers, 64);
+    printf("%7d  %6.2f M/s     %6.2f M/s        %6.2f M/s\n", workers, pp / 1e6, f1 / 1e6, f64 / 1e6);
+  }
+}
@@ -0,0 +1,137 @@
+// Generator pipelines: one operation per value versus batched operations.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers batch.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o batch
+//
+// A two stage pipeline: a producer generates NVALUES values, a map stage
+// squares them and passes them on, and a sink sums them. Each stage
+// hands values to the next by yielding to its handler. Per value, every
+// hand-off is one operation; batched, the producer and the map stage
+// write into an `lh_stream` that yields a whole batch at a time. The
+// map stage is tail-resumptive; the sink is either a general operation
+// that resumes once (so each operation captures and restores the stack)
+// or a tail-resumptive operation.
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NVALUES 1000000
+#define NRUNS 3
+
+LH_DEFINE_EFFECT1(source, op)
+LH_DEFINE_EFFECT1(sink, op)
+
+static bool batched;
+static long batch_size;
+static lh_stream map_stream;
+static long total;
+
+static void map_value(lh_value v) {
+  long x = lh_long_value(v);
+  if (batched) {
+    lh_stream_emit(&map_stream, lh_value_long(x * x));
+  } else {
+    lh_yield(LH_EFFECT(sink), lh_value_long(x * x));
+  }
+}
+
+static void sink_value(lh_value v) {
+  total += lh_long_value(v);
+}
+
+// operation functions: a batch is consumed completely before resuming
+static lh_value map_consume(lh_resume r, lh_value arg) {
+  if (!batched) {
+    map_value(arg);
+  } else {
+    lh_batch b = lh_batch_value(r, arg);
+    for (long i = 0; i < b.count; i++) map_value(b.values[i]);
+  }
+  return lh_value_null;
+}
+
+static lh_value sink_consume(lh_resume r, lh_value arg) {
+  if (!batched) {
+    sink_value(arg);
+  } else {
+    lh_batch b = lh_batch_value(r, arg);
+    for (long i = 0; i < b.count; i++) sink_value(b.values[i]);
+  }
+  return lh_value_null;
+}
+
+static void map_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, map_consume(r, arg));
+}
+
+static void sink_general(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_release_resume(r, sink_consume(r, arg));
+}
+
+static void sink_tail(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, sink_consume(r, arg));
+}
+
+static lh_opfun map_fun = {map_op};
+static lh_opfun sink_general_fun = {sink_general};
+static lh_opfun sink_tail_fun = {sink_tail};
+
+static const lh_handlerdef map_def = {LH_OP_TAIL_NOOP, LH_EFFECT(source), NULL, &map_fun};
+static const lh_handlerdef sink_defs[2] = {
+    {LH_OP_GENERAL, LH_EFFECT(sink), NULL, &sink_general_fun},
+    {LH_OP_TAIL_NOOP, LH_EFFECT(sink), NULL, &sink_tail_fun}};
+
+static void producer(void *res, uint8_t *closure, lh_value arg) {
+  if (batched) {
+    lh_stream s;
+    lh_stream_init(&s, LH_EFFECT(source), batch_size);
+    for (long i = 0; i < NVALUES; i++) lh_stream_emit(&s, lh_value_long(i));
+    lh_stream_done(&s);
+  } else {
+    for (long i = 0; i < NVALUES; i++) lh_yield(LH_EFFECT(source), lh_value_long(i));
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static void map_stage(void *res, uint8_t *closure, lh_value arg) {
+  lh_actionfun action = {producer};
+  if (batched) lh_stream_init(&map_stream, LH_EFFECT(sink), batch_size);
+  lh_handle(&map_def, &action, lh_value_null);
+  if (batched) lh_stream_done(&map_stream);
+  *(lh_value *)res = lh_value_null;
+}
+
+static double pipeline(long kind, long size) {
+  lh_actionfun action = {map_stage};
+  batched = (size > 0);
+  batch_size = size;
+  double best = 1e9;
+  for (int run = 0; run < NRUNS; run++) {
+    total = 0;
+    double t0 = now();
+    lh_handle(&sink_defs[kind], &action, lh_value_null);
+    double t1 = now();
+    if (t1 - t0 < best) best = t1 - t0;
+  }
+  return best;
+}
+
+int main(void) {
+  static const char *kinds[2] = {"general", "tail"};
+  static const long sizes[4] = {0, 1, 16, 256};
+  for (long kind = 0; kind < 2; kind++) {
+    double base = 0;
+    for (int i = 0; i < 4; i++) {
+      double secs = pipeline(kind, sizes[i]);
+      if (i == 0) base = secs;
+      if (sizes[i] == 0) {
+        printf("%-7s per value : ", kinds[kind]);
+      } else {
+        printf("%-7s batch %4ld: ", kinds[kind], sizes[i]);
+      }
+      printf("%.4fs, %6.1f M values/s, %5.1fx (sum %ld)\n", secs, NVALUES / secs / 1e6, base / secs, total);
+    }
+  }
+}
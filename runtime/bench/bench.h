@@ -0,0 +1,18 @@
+// Helpers shared by the runtime benchmarks
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// Seconds on the monotonic clock
+static inline double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Nanoseconds on the monotonic clock
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,102 @@
+// Compression of parked continuations: memory saved and resume latency.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers compress.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o compress
+//
+// Parks NTASKS tasks as first-class resumptions, each a few frames deep
+// with a partly used buffer on its stack (like a connection handler
+// waiting for input), and then resumes them all. Without compression
+// they are resumed as is; with compression they are swept by
+// `lh_compress_idle` once idle for longer than the threshold. Reports
+// the heap in use while parked and the per-resume latency.
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NTASKS 10000
+#define DEPTH 4
+#define BUFSIZE 512
+
+LH_DEFINE_EFFECT1(park, op)
+
+static lh_resume parked[NTASKS];
+static long parked_count;
+static double latency[NTASKS];
+
+static size_t heap_in_use(void) {
+  return mallinfo2().uordblks;
+}
+
+static void park_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  parked[parked_count++] = r;
+  *(lh_value *)res = lh_value_null;
+}
+
+static __attribute__((noinline)) long task(long id, long depth) {
+  char buf[BUFSIZE];
+  memset(buf, 0, sizeof(buf));
+  snprintf(buf, sizeof(buf), "task %ld at depth %ld", id, depth);
+  if (depth > 0) return task(id, depth - 1) + buf[0];
+  long input = lh_long_value(lh_yield(LH_EFFECT(park), lh_value_long(id)));
+  return input + (long)strlen(buf);
+}
+
+static void task_action(void *res, uint8_t *closure, lh_value arg) {
+  *(lh_value *)res = lh_value_long(task(lh_long_value(arg), DEPTH));
+}
+
+static lh_opfun park_fun = {park_op};
+static const lh_handlerdef park_def = {LH_OP_GENERAL, LH_EFFECT(park), NULL, &park_fun};
+
+static int compare(const void *p, const void *q) {
+  double x = *(const double *)p, y = *(const double *)q;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+static void run(const char *name, bool compress) {
+  lh_actionfun action = {task_action};
+  size_t heap0 = heap_in_use();
+  parked_count = 0;
+  for (long i = 0; i < NTASKS; i++) {
+    lh_handle(&park_def, &action, lh_value_long(i));
+  }
+  size_t parked_heap = heap_in_use() - heap0;
+
+  double sweep = 0;
+  size_t saved = 0;
+  if (compress) {
+    struct timespec idle = {0, 20 * 1000000};
+    nanosleep(&idle, NULL);
+    double t0 = now();
+    saved = lh_compress_idle();
+    sweep = now() - t0;
+    parked_heap = heap_in_use() - heap0;
+  }
+
+  long total = 0;
+  for (long i = 0; i < NTASKS; i++) {
+    double t0 = now();
+    total += lh_long_value(lh_release_resume(parked[i], lh_value_long(1)));
+    latency[i] = now() - t0;
+  }
+  qsort(latency, NTASKS, sizeof(double), compare);
+  double sum = 0;
+  for (long i = 0; i < NTASKS; i++) sum += latency[i];
+
+  printf("%-10s: %ld tasks, parked heap %6.1f kb/task", name, (long)NTASKS, parked_heap / 1024.0 / NTASKS);
+  if (compress) printf(" (saved %.1f kb/task, sweep %.1f us/task)", saved / 1024.0 / NTASKS, sweep * 1e6 / NTASKS);
+  printf("\n            resume avg %.2f us, p50 %.2f us, p99 %.2f us (checksum %ld)\n",
+         sum * 1e6 / NTASKS, latency[NTASKS / 2] * 1e6, latency[NTASKS * 99 / 100] * 1e6, total);
+}
+
+int main(void) {
+  run("raw", false);
+  lh_compress_threshold(10);
+  run("compressed", true);
+}
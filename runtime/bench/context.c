@@ -0,0 +1,65 @@
+// Tail-resume throughput: explicit context versus the thread local context.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers context.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o context
+//
+// Runs a counter effect with a tail-resumptive operation through `lh_yield`,
+// which reads the thread local handler stack on every operation, and through
+// `lh_cx_yield` with the context kept in a local. Both are measured for a
+// `LH_OP_TAIL_NOOP` and a `LH_OP_TAIL` operation (which pushes a skip frame).
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NITER 10000000
+#define NRUNS 5
+
+LH_DEFINE_EFFECT1(counter, inc)
+
+static void inc_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  long *count = lh_local(r);
+  *count += arg;
+  *(lh_value *)res = lh_tail_resume(r, *count);
+}
+
+static void body_thread(void *res, uint8_t *closure, lh_value arg) {
+  lh_value v = 0;
+  for (long i = 0; i < NITER; i++) v = lh_yield(LH_EFFECT(counter), 1);
+  *(lh_value *)res = v;
+}
+
+static void body_context(void *res, uint8_t *closure, lh_value arg) {
+  lh_context *cx = lh_ptr_value(arg);
+  lh_value v = 0;
+  for (long i = 0; i < NITER; i++) v = lh_cx_yield(cx, LH_EFFECT(counter), 1);
+  *(lh_value *)res = v;
+}
+
+static void bench(const char *name, lh_opkind kind) {
+  lh_opfun fun = {inc_op};
+  lh_handlerdef def = {kind, LH_EFFECT(counter), NULL, &fun, sizeof(long)};
+  lh_actionfun thread_action = {body_thread}, context_action = {body_context};
+  lh_context *cx = lh_context_new();
+  long zero = 0;
+  double thread_secs = 1e9, context_secs = 1e9;
+  lh_value thread_res = 0, context_res = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double t0 = now();
+    thread_res = lh_handle_local(&def, &zero, &thread_action, lh_value_null);
+    double t1 = now();
+    context_res = lh_cx_handle_local(cx, &def, &zero, &context_action, lh_value_ptr(cx));
+    double t2 = now();
+    if (t1 - t0 < thread_secs) thread_secs = t1 - t0;
+    if (t2 - t1 < context_secs) context_secs = t2 - t1;
+  }
+  lh_context_free(cx);
+  printf("%-9s thread : %lld in %.3fs, %.1f Mops/s\n", name, thread_res, thread_secs, NITER / thread_secs / 1e6);
+  printf("%-9s context: %lld in %.3fs, %.1f Mops/s\n", name, context_res, context_secs, NITER / context_secs / 1e6);
+}
+
+int main(void) {
+  bench("tail-noop", LH_OP_TAIL_NOOP);
+  bench("tail", LH_OP_TAIL);
+}
@@ -0,0 +1,119 @@
+// Generators: direct context switches versus general resumptions.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers generator.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o generator
+//
+// The producer walks a range by recursively splitting it in halves, so
+// it yields from a stack that is log2(n) frames deep, and the consumer
+// pulls the values one at a time and sums them. The `resume` variant
+// is the usual generator effect: `yield` is a general operation that
+// returns the value from the handler and keeps the resumption, and
+// `next` resumes it (capturing and restoring the stack each time). The
+// `generator` variant uses `lh_generator_next`. The `first 10` rows
+// create a generator, take ten values and terminate it early.
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NRUNS 5
+
+LH_DEFINE_EFFECT1(gen, yield)
+
+static bool use_effect;
+
+static void walk(long lo, long hi) {
+  if (hi - lo == 1) {
+    if (use_effect) {
+      lh_yield(LH_EFFECT(gen), lh_value_long(lo));
+    } else {
+      lh_generator_yield(lh_value_long(lo));
+    }
+  } else if (hi > lo) {
+    long mid = lo + (hi - lo) / 2;
+    walk(lo, mid);
+    walk(mid, hi);
+  }
+}
+
+static void producer(void *res, uint8_t *closure, lh_value arg) {
+  walk(0, lh_long_value(arg));
+  *(lh_value *)res = lh_value_null;
+}
+
+// generator effect with general resumptions
+static lh_resume pending;
+static bool produced;
+
+static void yield_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  pending = r;
+  produced = true;
+  *(lh_value *)res = arg;
+}
+
+static lh_opfun yield_fun = {yield_op};
+static const lh_handlerdef gen_def = {LH_OP_GENERAL, LH_EFFECT(gen), NULL, &yield_fun};
+
+static bool resume_next(bool first, long n, lh_value *value) {
+  lh_actionfun action = {producer};
+  produced = false;
+  if (first) {
+    *value = lh_handle(&gen_def, &action, lh_value_long(n));
+  } else {
+    *value = lh_release_resume(pending, lh_value_null);
+  }
+  return produced;
+}
+
+static long sum_resume(long n, long take) {
+  lh_value v;
+  long sum = 0, count = 0;
+  use_effect = true;
+  for (bool more = resume_next(true, n, &v); more; more = resume_next(false, n, &v)) {
+    sum += lh_long_value(v);
+    if (++count == take) {
+      lh_release(pending);
+      break;
+    }
+  }
+  return sum;
+}
+
+static long sum_generator(long n, long take) {
+  lh_actionfun action = {producer};
+  lh_generator *g = lh_generator_new(&action, lh_value_long(n), 0);
+  lh_value v;
+  long sum = 0, count = 0;
+  use_effect = false;
+  while (lh_generator_next(g, &v)) {
+    sum += lh_long_value(v);
+    if (++count == take) break;
+  }
+  lh_generator_free(g);
+  return sum;
+}
+
+static void bench(const char *name, long n, long take, long repeat) {
+  double resume_secs = 1e9, gen_secs = 1e9;
+  long resume_sum = 0, gen_sum = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double t0 = now();
+    for (long i = 0; i < repeat; i++) resume_sum = sum_resume(n, take);
+    double t1 = now();
+    for (long i = 0; i < repeat; i++) gen_sum = sum_generator(n, take);
+    double t2 = now();
+    if (t1 - t0 < resume_secs) resume_secs = t1 - t0;
+    if (t2 - t1 < gen_secs) gen_secs = t2 - t1;
+  }
+  long values = (take > 0 && take < n ? take : n) * repeat;
+  printf("%-10s resume   : %8.1f ns/value (sum %ld)\n", name, resume_secs * 1e9 / values, resume_sum);
+  printf("%-10s generator: %8.1f ns/value (sum %ld, %.1fx)\n", name, gen_secs * 1e9 / values, gen_sum,
+         resume_secs / gen_secs);
+}
+
+int main(void) {
+  bench("2^10", 1L << 10, 0, 100);
+  bench("2^20", 1L << 20, 0, 1);
+  bench("first 10", 1L << 20, 10, 10000);
+}
@@ -0,0 +1,292 @@
+// One handler frame for several effects: `lh_handle_many` versus nested `lh_handle`.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers many.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o many
+//
+// First checks that both give the same results for a handler group with
+// tail, general and non-resuming operations, inline state, result
+// functions (whose order shows in the result), and operation functions
+// that yield to a lower definition of the group and to a handler outside
+// of it. Exits with 1 on a mismatch.
+//
+// Then measures, for a group of NDEFS reader effects:
+// - install: handling the group around a body that yields once to the
+//   outermost effect; one frame sets up one jump point instead of NDEFS
+// - yield: yields to the outermost effect; `hstack_find` checks the
+//   definitions of one frame instead of walking NDEFS frames
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NDEFS 4
+#define NINSTALL 2000000
+#define NYIELD 10000000
+#define NRUNS 5
+
+LH_DEFINE_EFFECT1(ask, op)
+LH_DEFINE_EFFECT1(flip, op)
+LH_DEFINE_EFFECT1(state, op)
+LH_DEFINE_EFFECT1(raise, op)
+LH_DEFINE_EFFECT1(log, op)
+LH_DEFINE_EFFECT1(tick, op)
+LH_DEFINE_EFFECT1(read0, op)
+LH_DEFINE_EFFECT1(read1, op)
+LH_DEFINE_EFFECT1(read2, op)
+LH_DEFINE_EFFECT1(read3, op)
+
+#define STATE_GET (-1)
+
+// Handle `defs[level..ndefs)` with nested `lh_handle_local` calls around `nested_body`
+static const lh_handlerdef *nested_defs;
+static const void *const *nested_locals;
+static long nested_count;
+static lh_actionfun *nested_body;
+
+typedef struct {
+  void (*function_ptr)(void *, uint8_t *, lh_value);
+  long level;
+} nested_fun;
+
+static void nested(void *res, uint8_t *closure, lh_value arg) {
+  long level = *(long *)closure;
+  if (level == nested_count) {
+    nested_body->function_ptr(res, nested_body->closure, arg);
+    return;
+  }
+  nested_fun inner = {nested, level + 1};
+  const void *local = (nested_locals != NULL ? nested_locals[level] : NULL);
+  *(lh_value *)res = lh_handle_local(&nested_defs[level], local, (lh_actionfun *)&inner, arg);
+}
+
+static lh_value handle_nested(const lh_handlerdef *defs, long ndefs, const void *const *locals, lh_actionfun *body,
+                              lh_value arg) {
+  nested_defs = defs;
+  nested_locals = locals;
+  nested_count = ndefs;
+  nested_body = body;
+  lh_value res;
+  nested_fun outer = {nested, 0};
+  nested(&res, (uint8_t *)&outer.level, arg);
+  return res;
+}
+
+/*-----------------------------------------------------------------
+  Equivalence
+-----------------------------------------------------------------*/
+
+// The order in which operation and result functions ran
+static char trace[256];
+static size_t trace_len;
+
+static void trace_add(char c) {
+  if (trace_len < sizeof(trace) - 1) trace[trace_len++] = c;
+  trace[trace_len] = 0;
+}
+
+static void ask_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, 42);
+}
+
+// resumes twice and adds up both results
+static void flip_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  trace_add('f');
+  lh_value x = lh_call_resume(r, 0);
+  lh_value y = lh_release_resume(r, 1);
+  *(lh_value *)res = x + y;
+}
+
+static void state_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  long *s = lh_local(r);
+  if (arg == STATE_GET) {
+    *(lh_value *)res = lh_tail_resume(r, *s);
+  } else {
+    *s = arg;
+    *(lh_value *)res = lh_tail_resume(r, lh_value_null);
+  }
+}
+
+static void raise_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  trace_add('r');
+  *(lh_value *)res = -arg;
+}
+
+// yields to `ask`, a lower definition of the group, and to `tick`, which is handled outside of it
+static void log_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  lh_value a = lh_yield(LH_EFFECT(ask), lh_value_null);
+  lh_value t = lh_yield(LH_EFFECT(tick), arg);
+  trace_add('l');
+  *(lh_value *)res = lh_tail_resume(r, a + t);
+}
+
+static lh_value ticks;
+
+static void tick_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  ticks += arg;
+  *(lh_value *)res = lh_tail_resume(r, ticks);
+}
+
+static void ask_result(void *res, uint8_t *closure, lh_value v) {
+  trace_add('A');
+  *(lh_value *)res = v + 1000;
+}
+
+static void flip_result(void *res, uint8_t *closure, lh_value v) {
+  trace_add('F');
+  *(lh_value *)res = v * 2;
+}
+
+static void raise_result(void *res, uint8_t *closure, lh_value v) {
+  trace_add('R');
+  *(lh_value *)res = v * 3 + 1;
+}
+
+static void program(void *res, uint8_t *closure, lh_value arg) {
+  lh_value a = lh_yield(LH_EFFECT(ask), lh_value_null);
+  lh_yield(LH_EFFECT(state), a + 1);
+  lh_value l = lh_yield(LH_EFFECT(log), 5);
+  lh_value f = lh_yield(LH_EFFECT(flip), lh_value_null);
+  lh_value s = lh_yield(LH_EFFECT(state), STATE_GET);
+  lh_yield(LH_EFFECT(state), s + 10 * f);
+  if (arg == 1 && f == 1) {
+    *(lh_value *)res = lh_yield(LH_EFFECT(raise), 7);
+    return;
+  }
+  *(lh_value *)res = lh_yield(LH_EFFECT(state), STATE_GET) + l;
+}
+
+static lh_opfun ask_fun = {ask_op};
+static lh_opfun flip_fun = {flip_op};
+static lh_opfun state_fun = {state_op};
+static lh_opfun raise_fun = {raise_op};
+static lh_opfun log_fun = {log_op};
+static lh_opfun tick_fun = {tick_op};
+static lh_resultfun ask_res = {ask_result};
+static lh_resultfun flip_res = {flip_result};
+static lh_resultfun raise_res = {raise_result};
+
+static const lh_handlerdef program_defs[] = {
+    {LH_OP_TAIL_NOOP, LH_EFFECT(ask), &ask_res, &ask_fun, 0},
+    {LH_OP_GENERAL, LH_EFFECT(flip), &flip_res, &flip_fun, 0},
+    {LH_OP_TAIL_NOOP, LH_EFFECT(state), NULL, &state_fun, sizeof(long)},
+    {LH_OP_NORESUME, LH_EFFECT(raise), &raise_res, &raise_fun, 0},
+    {LH_OP_TAIL, LH_EFFECT(log), NULL, &log_fun, 0},
+};
+#define PROGRAM_DEFS ((long)(sizeof(program_defs) / sizeof(*program_defs)))
+
+static const long state_init = 3;
+static const void *const program_locals[PROGRAM_DEFS] = {NULL, NULL, &state_init, NULL, NULL};
+
+static const lh_handlerdef tick_def = {LH_OP_TAIL_NOOP, LH_EFFECT(tick), NULL, &tick_fun, 0};
+
+// Run `program` under the group inside a `tick` handler, with the group as one frame or nested
+static void in_tick(void *res, uint8_t *closure, lh_value arg) {
+  bool many = *(bool *)closure;
+  lh_actionfun body = {program};
+  if (many) {
+    *(lh_value *)res = lh_handle_many_local(program_defs, PROGRAM_DEFS, program_locals, &body, arg);
+  } else {
+    *(lh_value *)res = handle_nested(program_defs, PROGRAM_DEFS, program_locals, &body, arg);
+  }
+}
+
+typedef struct {
+  void (*function_ptr)(void *, uint8_t *, lh_value);
+  bool many;
+} in_tick_fun;
+
+static lh_value run_program(bool many, lh_value arg, lh_value *tick_total) {
+  in_tick_fun action = {in_tick, many};
+  ticks = 0;
+  trace_len = 0;
+  trace[0] = 0;
+  lh_value res = lh_handle(&tick_def, (lh_actionfun *)&action, arg);
+  *tick_total = ticks;
+  return res;
+}
+
+static bool check(void) {
+  bool ok = true;
+  for (lh_value arg = 0; arg <= 1; arg++) {
+    lh_value many_ticks, nested_ticks;
+    lh_value many_res = run_program(true, arg, &many_ticks);
+    char many_trace[sizeof(trace)];
+    strcpy(many_trace, trace);
+    lh_value nested_res = run_program(false, arg, &nested_ticks);
+    bool same = (many_res == nested_res && many_ticks == nested_ticks && strcmp(many_trace, trace) == 0);
+    printf("check %lld: many %lld (ticks %lld, %s), nested %lld (ticks %lld, %s)%s\n", (long long)arg,
+           (long long)many_res, (long long)many_ticks, many_trace, (long long)nested_res, (long long)nested_ticks,
+           trace, same ? "" : "  MISMATCH");
+    ok = ok && same;
+  }
+  return ok;
+}
+
+/*-----------------------------------------------------------------
+  Throughput
+-----------------------------------------------------------------*/
+
+static void read_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, arg + 1);
+}
+
+static lh_opfun read_fun = {read_op};
+
+static const lh_handlerdef read_defs[NDEFS] = {
+    {LH_OP_TAIL_NOOP, LH_EFFECT(read0), NULL, &read_fun, 0},
+    {LH_OP_TAIL_NOOP, LH_EFFECT(read1), NULL, &read_fun, 0},
+    {LH_OP_TAIL_NOOP, LH_EFFECT(read2), NULL, &read_fun, 0},
+    {LH_OP_TAIL_NOOP, LH_EFFECT(read3), NULL, &read_fun, 0},
+};
+
+static void yield_once(void *res, uint8_t *closure, lh_value arg) {
+  *(lh_value *)res = lh_yield(LH_EFFECT(read0), arg);
+}
+
+static void yield_loop(void *res, uint8_t *closure, lh_value arg) {
+  lh_value v = arg;
+  for (long i = 0; i < NYIELD; i++) v = lh_yield(LH_EFFECT(read0), v);
+  *(lh_value *)res = v;
+}
+
+static lh_value install(bool many) {
+  lh_actionfun body = {yield_once};
+  lh_value sum = 0;
+  for (long i = 0; i < NINSTALL; i++) {
+    sum += (many ? lh_handle_many(read_defs, NDEFS, &body, i) : handle_nested(read_defs, NDEFS, NULL, &body, i));
+  }
+  return sum;
+}
+
+static lh_value yields(bool many) {
+  lh_actionfun body = {yield_loop};
+  return (many ? lh_handle_many(read_defs, NDEFS, &body, 0) : handle_nested(read_defs, NDEFS, NULL, &body, 0));
+}
+
+// Time `fun` for both variants, alternating them and keeping the best run of each
+static bool measure(const char *name, lh_value (*fun)(bool), long n) {
+  double many_secs = 1e9, nested_secs = 1e9;
+  lh_value many_res = 0, nested_res = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double t0 = now();
+    many_res = fun(true);
+    double t1 = now();
+    nested_res = fun(false);
+    double t2 = now();
+    if (t1 - t0 < many_secs) many_secs = t1 - t0;
+    if (t2 - t1 < nested_secs) nested_secs = t2 - t1;
+  }
+  printf("%-7s: many %6.1f M/s, nested %6.1f M/s (%.2fx)%s\n", name, n / many_secs / 1e6, n / nested_secs / 1e6,
+         nested_secs / many_secs, many_res == nested_res ? "" : "  MISMATCH");
+  return (many_res == nested_res);
+}
+
+int main(void) {
+  bool ok = check();
+  printf("%d effects\n", NDEFS);
+  ok = measure("install", install, NINSTALL) && ok;
+  ok = measure("yield", yields, NYIELD) && ok;
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,88 @@
+// Nursery fan-out: spawn, join and cancel of many children.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched nursery.c ../src/sched/nursery.c
+//     ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s -o nursery
+//   ./nursery [children]
+//
+// The body of a nursery spawns `children` (default 100000) children.
+// In `join` they return right away; in `yield` each child yields once,
+// so all of them are parked as resumptions at the same time before
+// they finish; in `cancel` the last child fails after the others
+// parked, which cancels them all. Each child holds a handler with
+// inline state whose release is counted, and the heap is compared
+// before and after to check that cancelled children do not leak.
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "nursery.h"
+
+#define NRUNS 3
+
+LH_DEFINE_EFFECT1(resource, op)
+
+static long children = 100000;
+static long released;
+static bool do_yield;
+static bool do_fail;
+
+static void resource_release(void *local) {
+  released++;
+}
+
+static void resource_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, arg);
+}
+
+static lh_opfun resource_fun = {resource_op};
+static const lh_handlerdef resource_def = {LH_OP_TAIL_NOOP, LH_EFFECT(resource), NULL, &resource_fun,
+                                           sizeof(long), NULL, &resource_release};
+
+static void work(void *res, uint8_t *closure, lh_value arg) {
+  if (do_fail && lh_long_value(arg) == children - 1) lh_nursery_fail(arg);
+  if (do_yield || do_fail) lh_nursery_yield();
+  *(lh_value *)res = arg;
+}
+
+static void child(void *res, uint8_t *closure, lh_value arg) {
+  lh_actionfun action = {work};
+  long local = 0;
+  *(lh_value *)res = lh_handle_local(&resource_def, &local, &action, arg);
+}
+
+static lh_actionfun child_fun = {child};
+
+static void body(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 0; i < children; i++) lh_nursery_spawn(&child_fun, lh_value_long(i));
+  *(lh_value *)res = lh_value_long(children);
+}
+
+static void bench(const char *name, bool yield, bool fail) {
+  lh_actionfun action = {body};
+  do_yield = yield;
+  do_fail = fail;
+  double best = 1e9;
+  bool completed = false;
+  lh_value result = lh_value_null;
+  size_t heap0 = mallinfo2().uordblks;
+  for (int run = 0; run < NRUNS; run++) {
+    released = 0;
+    double t0 = now();
+    completed = lh_nursery_run(&action, lh_value_null, &result);
+    double t1 = now();
+    if (t1 - t0 < best) best = t1 - t0;
+  }
+  long leaked = (long)(mallinfo2().uordblks - heap0);
+  printf("%-6s: %ld children, %s %ld, %6.0f ns/child, released %ld, heap delta %ld b\n", name, children,
+         completed ? "result" : "error", lh_long_value(result), best * 1e9 / children, released, leaked);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) children = atol(argv[1]);
+  if (children < 1) children = 1;
+  bench("join", false, false);
+  bench("yield", true, false);
+  bench("cancel", false, true);
+}
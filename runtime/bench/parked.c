@@ -0,0 +1,190 @@
+// Scalability of parked continuations.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers parked.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o parked
+//   ./parked [max-tasks] [depth] [frame-bytes] [compress]
+//
+// For 10^3, 10^4, ... up to `max-tasks` (default 10^6) tasks, parks every
+// task as a general resumption `depth` frames deep with `frame-bytes` of
+// locals per frame, and resumes them all, once in FIFO order and once in
+// random order. With `compress` set to 1 the parked stacks are swept by
+// `lh_compress_idle` before resuming. Reports per parked continuation:
+//
+// - captured bytes (c-stack + handler stack), from the metrics page
+// - heap bytes, which adds the resume header and allocator overhead
+// - the RSS of the process
+// - park latency (yield and capture of the stack, i.e. `capture_cstack`)
+// - resume latency (restore of the stack, i.e. `jumpto`, and run to completion)
+//
+// The sweep stops early when the heap per task of the previous size says the
+// next size would not fit in the available physical memory.
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+#include "metrics.h"
+
+LH_DEFINE_EFFECT1(park, op)
+
+static long depth = 4;
+static long frame = 256;
+static bool compress = false;
+
+static lh_resume *parked;
+static long parked_count;
+static uint32_t *park_ns;
+static uint32_t *resume_ns;
+static lh_metrics_page *metrics;
+
+static size_t rss_bytes(void) {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return 0;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(f);
+  return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static uint64_t captured_bytes(void) {
+  lh_metrics_publish();
+  return atomic_load_explicit(&metrics->captured_bytes, memory_order_relaxed);
+}
+
+static void park_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  if (compress) lh_resume_compress(r, LH_COMPRESS_EAGER);
+  parked[parked_count++] = r;
+  *(lh_value *)res = lh_value_null;
+}
+
+static __attribute__((noinline)) long task(long id, long d) {
+  char buf[frame];
+  memset(buf, 0, frame);
+  buf[0] = (char)id;
+  if (d > 1) return task(id, d - 1) + buf[0];
+  return lh_long_value(lh_yield(LH_EFFECT(park), lh_value_long(id))) + buf[0];
+}
+
+static void task_action(void *res, uint8_t *closure, lh_value arg) {
+  *(lh_value *)res = lh_value_long(task(lh_long_value(arg), depth));
+}
+
+static lh_opfun park_fun = {park_op};
+static const lh_handlerdef park_def = {LH_OP_GENERAL, LH_EFFECT(park), NULL, &park_fun};
+
+static int compare(const void *p, const void *q) {
+  uint32_t x = *(const uint32_t *)p, y = *(const uint32_t *)q;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+static void percentiles(const char *name, uint32_t *ns, long n) {
+  qsort(ns, n, sizeof(uint32_t), compare);
+  double sum = 0;
+  for (long i = 0; i < n; i++) sum += ns[i];
+  printf("  %-6s avg %7.0f  p50 %7u  p90 %7u  p99 %7u  p99.9 %8u  max %9u ns\n", name,
+         sum / n, ns[n / 2], ns[n * 90 / 100], ns[n * 99 / 100], ns[n * 999 / 1000], ns[n - 1]);
+}
+
+static uint64_t rand_state = 0x9E3779B97F4A7C15u;
+
+static uint64_t xorshift(void) {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+// Returns the heap bytes per parked task
+static double run(long n, bool random) {
+  lh_actionfun action = {task_action};
+  size_t heap0 = mallinfo2().uordblks;
+  uint64_t captured0 = captured_bytes();
+
+  parked_count = 0;
+  for (long i = 0; i < n; i++) {
+    uint64_t t0 = now_ns();
+    lh_handle(&park_def, &action, lh_value_long(i));
+    park_ns[i] = (uint32_t)(now_ns() - t0);
+  }
+  size_t saved = (compress ? lh_compress_idle() : 0);
+  uint64_t captured = captured_bytes() - captured0;
+  size_t heap = mallinfo2().uordblks - heap0;
+  size_t rss = rss_bytes();
+
+  if (random) {
+    for (long i = n - 1; i > 0; i--) {
+      long j = (long)(xorshift() % (uint64_t)(i + 1));
+      lh_resume r = parked[i];
+      parked[i] = parked[j];
+      parked[j] = r;
+    }
+  }
+  uint64_t start = now_ns();
+  for (long i = 0; i < n; i++) {
+    uint64_t t0 = now_ns();
+    lh_release_resume(parked[i], lh_value_long(1));
+    resume_ns[i] = (uint32_t)(now_ns() - t0);
+  }
+  double secs = (now_ns() - start) / 1e9;
+
+  printf("%8ld tasks, %s: captured %6.0f b, heap %6.0f b", n, random ? "random" : "fifo  ",
+         (double)captured / n, (double)heap / n);
+  if (compress) printf(" (compressed -%.0f b)", (double)saved / n);
+  printf(", rss %7.1f mb, %.2f M resumes/s\n", rss / 1048576.0, n / secs / 1e6);
+  percentiles("park", park_ns, n);
+  percentiles("resume", resume_ns, n);
+  fflush(stdout);
+  return (double)heap / n;
+}
+
+// Would `n` tasks of `per_task` heap bytes (and the timing arrays) fit in the available memory?
+static bool fits(long n, double per_task) {
+  double avail = (double)sysconf(_SC_AVPHYS_PAGES) * (double)sysconf(_SC_PAGESIZE);
+  double need = n * (per_task + sizeof(lh_resume) + 2 * sizeof(uint32_t));
+  return (avail <= 0 || need * 1.25 < avail);  // leave some room for the allocator and the rest of the system
+}
+
+int main(int argc, char **argv) {
+  long max = (argc > 1 ? atol(argv[1]) : 1000000);
+  if (argc > 2) depth = atol(argv[2]);
+  if (argc > 3) frame = atol(argv[3]);
+  if (argc > 4) compress = (atoi(argv[4]) != 0);
+  if (depth < 1) depth = 1;
+  if (frame < 1) frame = 1;
+
+  // the metrics page counts the captured c-stack and handler stack bytes
+  char path[] = "/tmp/lh-parked-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || lh_metrics_open(path, 0) != 0) {
+    fprintf(stderr, "cannot open a metrics page at %s\n", path);
+    return 1;
+  }
+  metrics = mmap(NULL, sizeof(lh_metrics_page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  unlink(path);
+  if (metrics == MAP_FAILED) return 1;
+
+  parked = malloc(max * sizeof(lh_resume));
+  park_ns = malloc(max * sizeof(uint32_t));
+  resume_ns = malloc(max * sizeof(uint32_t));
+  if (parked == NULL || park_ns == NULL || resume_ns == NULL) return 1;
+
+  printf("depth %ld, frame %ld bytes%s\n", depth, frame, compress ? ", compressed" : "");
+  double per_task = 0;
+  for (long n = 1000; n <= max; n *= 10) {
+    if (!fits(n, per_task)) {
+      printf("%8ld tasks: skipped, needs about %.0f mb with %.0f heap bytes per task\n", n, n * per_task / 1048576.0, per_task);
+      break;
+    }
+    double fifo = run(n, false);
+    double random = run(n, true);
+    per_task = (fifo > random ? fifo : random);
+  }
+  lh_metrics_close();
+  return 0;
+}
@@ -0,0 +1,78 @@
+// Pipeline throughput against the number of stages.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched pipeline.c ../src/sched/pipeline.c
+//     ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s ../queue/queue.c -lpthread -o pipeline
+//   ./pipeline [max-stages]
+//
+// A source emits ITEMS numbers to `k` balanced stages that each do WORK
+// rounds of arithmetic on every item; the last stage sums them up. The
+// same `k` functions are also run one after the other on a single
+// thread. With at least `k` free cores the pipeline should approach a
+// speedup of `k`; a batch of 1 shows what batching saves.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "pipeline.h"
+
+#define ITEMS 500000
+#define WORK 100
+
+static uint64_t work(uint64_t x) {
+  for (int i = 0; i < WORK; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+static void source(lh_emitter *out, void *arg) {
+  for (long i = 1; i <= ITEMS; i++) lh_emit(out, lh_value_long(i));
+}
+
+static void transform(lh_value item, lh_emitter *out, void *arg) {
+  lh_emit(out, lh_value_long((long)work((uint64_t)lh_long_value(item))));
+}
+
+static void aggregate(lh_value item, lh_emitter *out, void *arg) {
+  *(uint64_t *)arg += work((uint64_t)lh_long_value(item));
+}
+
+static uint64_t run_sequential(int stages) {
+  uint64_t sum = 0;
+  for (long i = 1; i <= ITEMS; i++) {
+    uint64_t x = (uint64_t)i;
+    for (int k = 0; k < stages; k++) x = work(x);
+    sum += x;
+  }
+  return sum;
+}
+
+static uint64_t run_pipeline(int stages, long batch) {
+  uint64_t sum = 0;
+  lh_pipeline *p = lh_pipeline_new(&source, NULL, batch, 0);
+  for (int k = 0; k < stages - 1; k++) lh_pipeline_add(p, &transform, NULL, NULL);
+  lh_pipeline_add(p, &aggregate, NULL, &sum);
+  lh_pipeline_run(p);
+  lh_pipeline_free(p);
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  int max = (argc > 1 ? atoi(argv[1]) : 4);
+  printf("stages  sequential      pipeline (batch 1)     pipeline (batch 64)\n");
+  for (int stages = 1; stages <= max; stages++) {
+    double t0 = now();
+    uint64_t expect = run_sequential(stages);
+    double t1 = now();
+    uint64_t sum1 = run_pipeline(stages, 1);
+    double t2 = now();
+    uint64_t sum64 = run_pipeline(stages, 64);
+    double t3 = now();
+    double seq = ITEMS / (t1 - t0), p1 = ITEMS / (t2 - t1), p64 = ITEMS / (t3 - t2);
+    printf("%6d  %6.2f M/s     %6.2f M/s (%4.2fx)     %6.2f M/s (%4.2fx)%s\n", stages, seq / 1e6, p1 / 1e6,
+           p1 / seq, p64 / 1e6, p64 / seq, (sum1 == expect && sum64 == expect ? "" : "  WRONG"));
+  }
+}
@@ -0,0 +1,114 @@
+// Preemption: tail latency of I/O-bound actors next to CPU-bound ones.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched preempt.c ../src/sched/actor.c
+//     ../src/sched/topology.c ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s
+//     ../queue/queue.c -lpthread -o preempt
+//   ./preempt [workers]
+//
+// CPU actors each get JOBS jobs of about JOB_US microseconds of
+// arithmetic, with a safepoint every SAFEPOINT_EVERY iterations. An I/O
+// actor receives "completions" from a device thread every
+// DEVICE_PERIOD_US microseconds, each carrying the time it was sent,
+// and records how long it took to be handled. Without preemption a
+// completion waits until the CPU actors finish their batch of jobs;
+// with a time slice it waits at most about a slice. Reports the time
+// the CPU work took (throughput) and the p50/p99/max handling latency.
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "./bench.h"
+#include "actor.h"
+
+#define CPU_ACTORS 4
+#define JOBS 100
+#define JOB_US 2000
+#define SAFEPOINT_EVERY 1024
+#define DEVICE_PERIOD_US 200
+#define MAX_SAMPLES 100000
+
+static long job_iterations;
+static volatile uint64_t sink;
+static double latencies[MAX_SAMPLES];
+static long nsamples;
+static volatile int cpu_left;
+
+static uint64_t crunch(long iterations) {
+  uint64_t x = 88172645463325252ULL;
+  for (long i = 0; i < iterations; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    if ((i & (SAFEPOINT_EVERY - 1)) == 0) lh_actor_safepoint();
+  }
+  return x;
+}
+
+static void cpu_actor(void *res, uint8_t *closure, lh_value arg) {
+  uint64_t acc = 0;
+  for (int i = 0; i < JOBS; i++) {
+    acc += crunch(lh_long_value(lh_actor_receive()));
+  }
+  sink += acc;
+  __atomic_fetch_sub(&cpu_left, 1, __ATOMIC_SEQ_CST);
+  *(lh_value *)res = lh_value_null;
+}
+
+static void io_actor(void *res, uint8_t *closure, lh_value arg) {
+  for (;;) {
+    long sent = lh_long_value(lh_actor_receive());
+    if (sent == 0) break;
+    double t = now();
+    if (nsamples < MAX_SAMPLES) latencies[nsamples++] = t - sent / 1e9;
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun cpu_fun = {cpu_actor};
+static lh_actionfun io_fun = {io_actor};
+
+static int compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x < y ? -1 : x > y);
+}
+
+static void run(const char *name, int workers, long slice_us) {
+  lh_actors *actors = lh_actors_start_preemptive(workers, 0, slice_us);
+  nsamples = 0;
+  cpu_left = CPU_ACTORS;
+  lh_actor *io = lh_actor_spawn(actors, &io_fun, lh_value_null);
+  double t0 = now();
+  for (int i = 0; i < CPU_ACTORS; i++) {
+    lh_actor *a = lh_actor_spawn(actors, &cpu_fun, lh_value_null);
+    for (int j = 0; j < JOBS; j++) lh_actor_send(a, lh_value_long(job_iterations));
+  }
+  // the device: send completions until the CPU work is done
+  while (__atomic_load_n(&cpu_left, __ATOMIC_SEQ_CST) > 0) {
+    usleep(DEVICE_PERIOD_US);
+    lh_actor_send(io, lh_value_long((long)(now() * 1e9)));
+  }
+  double cpu = now() - t0;
+  lh_actor_send(io, lh_value_long(0));
+  lh_actors_join(actors);
+  qsort(latencies, nsamples, sizeof(double), &compare);
+  double p50 = (nsamples > 0 ? latencies[nsamples / 2] : 0);
+  double p99 = (nsamples > 0 ? latencies[nsamples * 99 / 100] : 0);
+  double max = (nsamples > 0 ? latencies[nsamples - 1] : 0);
+  printf("%-16s cpu work %7.1f ms  latency p50 %8.1f us  p99 %8.1f us  max %8.1f us  (%ld samples)\n", name,
+         cpu * 1e3, p50 * 1e6, p99 * 1e6, max * 1e6, nsamples);
+}
+
+int main(int argc, char **argv) {
+  int workers = (argc > 1 ? atoi(argv[1]) : 1);
+  // calibrate a job to about JOB_US
+  double t0 = now();
+  sink += crunch(10000000);
+  job_iterations = (long)(10000000 * (JOB_US / 1e6) / (now() - t0));
+  printf("%d worker(s), %d cpu actors x %d jobs of %d us, a completion every %d us\n", workers, CPU_ACTORS, JOBS,
+         JOB_US, DEVICE_PERIOD_US);
+  run("cooperative", workers, 0);
+  run("slice 1000 us", workers, 1000);
+  run("slice 250 us", workers, 250);
+}
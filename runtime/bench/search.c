@@ -0,0 +1,145 @@
+// Backtracking search: trail-based choice points versus multi-shot resumptions.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers search.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o search
+//
+// Counts all solutions of N-queens and of a subset-sum instance.
+// The `trail` variant runs under `lh_search`: its board is global and
+// every mutation is trailed, and a choice only saves the C stack up
+// to the choice point. The `resume` variant is the classic handler:
+// `choose` is a general operation that resumes once per alternative
+// and `fail` never resumes; its board lives on the stack and is
+// restored by copying the captured continuation back.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define QUEENS 9
+#define ITEMS 18
+#define TARGET 60
+#define NRUNS 5
+
+LH_DEFINE_EFFECT1(choose, op)
+LH_DEFINE_EFFECT1(fail, op)
+
+typedef struct {
+  char cols[QUEENS];
+  char up[2 * QUEENS];
+  char down[2 * QUEENS];
+} board;
+
+static bool board_free(const board *b, long row, long col) {
+  return !b->cols[col] && !b->up[row + col] && !b->down[row - col + QUEENS];
+}
+
+// trail-based search
+
+static board global_board;
+
+static void queens_trail(void *res, uint8_t *closure, lh_value arg) {
+  board *b = &global_board;
+  for (long row = 0; row < QUEENS; row++) {
+    long col = lh_choose(QUEENS);
+    if (!board_free(b, row, col)) lh_fail();
+    lh_trail_assign(b->cols[col], 1);
+    lh_trail_assign(b->up[row + col], 1);
+    lh_trail_assign(b->down[row - col + QUEENS], 1);
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static long global_sum;
+
+static void subset_trail(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 1; i <= ITEMS; i++) {
+    if (lh_choose(2) == 1) {
+      if (global_sum + i > TARGET) lh_fail();
+      lh_trail_assign(global_sum, global_sum + i);
+    }
+  }
+  if (global_sum != TARGET) lh_fail();
+  *(lh_value *)res = lh_value_null;
+}
+
+// multi-shot resumptions
+
+static void choose_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  lh_value total = 0;
+  for (long i = 0; i < lh_long_value(arg); i++) {
+    total += lh_call_resume(r, lh_value_long(i));
+  }
+  lh_release(r);
+  *(lh_value *)res = total;
+}
+
+static void fail_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = 0;
+}
+
+static long choose(long n) {
+  return lh_long_value(lh_yield(LH_EFFECT(choose), lh_value_long(n)));
+}
+
+static void queens_resume(void *res, uint8_t *closure, lh_value arg) {
+  board b;
+  memset(&b, 0, sizeof(b));
+  for (long row = 0; row < QUEENS; row++) {
+    long col = choose(QUEENS);
+    if (!board_free(&b, row, col)) {
+      *(lh_value *)res = lh_yield(LH_EFFECT(fail), lh_value_null);
+      return;
+    }
+    b.cols[col] = b.up[row + col] = b.down[row - col + QUEENS] = 1;
+  }
+  *(lh_value *)res = 1;
+}
+
+static void subset_resume(void *res, uint8_t *closure, lh_value arg) {
+  long sum = 0;
+  for (long i = 1; i <= ITEMS; i++) {
+    if (choose(2) == 1) {
+      if (sum + i > TARGET) {
+        *(lh_value *)res = lh_yield(LH_EFFECT(fail), lh_value_null);
+        return;
+      }
+      sum += i;
+    }
+  }
+  *(lh_value *)res = (sum == TARGET ? 1 : lh_yield(LH_EFFECT(fail), lh_value_null));
+}
+
+static lh_opfun choose_fun = {choose_op};
+static lh_opfun fail_fun = {fail_op};
+static const lh_handlerdef amb_defs[2] = {
+    {LH_OP_GENERAL, LH_EFFECT(choose), NULL, &choose_fun},
+    {LH_OP_NORESUME, LH_EFFECT(fail), NULL, &fail_fun}};
+
+static void bench(const char *name, lh_actionfun *trail, lh_actionfun *resume) {
+  double trail_secs = 1e9, iddfs_secs = 1e9, resume_secs = 1e9;
+  long trail_res = 0, iddfs_res = 0, resume_res = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double t0 = now();
+    trail_res = lh_search(LH_SEARCH_DFS, 0, trail, lh_value_null, NULL, lh_value_null);
+    double t1 = now();
+    iddfs_res = lh_search(LH_SEARCH_IDDFS, 0, trail, lh_value_null, NULL, lh_value_null);
+    double t2 = now();
+    resume_res = lh_long_value(lh_handle_many(amb_defs, 2, resume, lh_value_null));
+    double t3 = now();
+    if (t1 - t0 < trail_secs) trail_secs = t1 - t0;
+    if (t2 - t1 < iddfs_secs) iddfs_secs = t2 - t1;
+    if (t3 - t2 < resume_secs) resume_secs = t3 - t2;
+  }
+  printf("%s trail : %ld solutions in %.4fs\n", name, trail_res, trail_secs);
+  printf("%s iddfs : %ld solutions in %.4fs\n", name, iddfs_res, iddfs_secs);
+  printf("%s resume: %ld solutions in %.4fs (%.1fx)\n", name, resume_res, resume_secs, resume_secs / trail_secs);
+}
+
+int main(void) {
+  lh_actionfun queens_t = {queens_trail}, queens_r = {queens_resume};
+  lh_actionfun subset_t = {subset_trail}, subset_r = {subset_resume};
+  bench("queens", &queens_t, &queens_r);
+  bench("subset", &subset_t, &subset_r);
+}
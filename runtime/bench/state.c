@@ -0,0 +1,92 @@
+// State-effect throughput: inline handler state versus boxed state.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers state.c ../src/handlers/libhandler.c
+//     ../src/handlers/asm/setjmp_amd64.s -o state
+//
+// The boxed variant keeps a heap allocated state that the operation
+// function reaches through its closure; the inline variant stores the
+// state in the handler frame (`lh_handle_local`) and reads it with
+// `lh_local`. Both use a tail-resumptive `get/put` operation.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "libhandler.h"
+
+#define NITER 10000000
+
+LH_DEFINE_EFFECT1(state, op)
+
+#define STATE_GET (-1)
+
+typedef struct {
+  long value;
+  long writes;
+  long reads;
+} counter;
+
+static lh_value state_apply(counter *s, lh_value arg) {
+  if (arg == STATE_GET) {
+    s->reads++;
+    return s->value;
+  }
+  s->writes++;
+  s->value = arg;
+  return lh_value_null;
+}
+
+// inline state
+static void inline_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  *(lh_value *)res = lh_tail_resume(r, state_apply(lh_local(r), arg));
+}
+
+// boxed state, reached through the closure of the operation function
+typedef struct {
+  void (*function_ptr)(void *, uint8_t *, lh_resume r, lh_value arg);
+  counter *box;
+} boxed_opfun;
+
+static void boxed_op(void *res, uint8_t *closure, lh_resume r, lh_value arg) {
+  counter *s = *(counter **)closure;
+  *(lh_value *)res = lh_tail_resume(r, state_apply(s, arg));
+}
+
+static void body(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 0; i < NITER; i++) {
+    lh_value v = lh_yield(LH_EFFECT(state), STATE_GET);
+    lh_yield(LH_EFFECT(state), v + 1);
+  }
+  *(lh_value *)res = lh_yield(LH_EFFECT(state), STATE_GET);
+}
+
+#define NRUNS 5
+
+int main(void) {
+  lh_actionfun action = {body};
+
+  lh_opfun inline_fun = {inline_op};
+  lh_handlerdef inline_def = {LH_OP_TAIL_NOOP, LH_EFFECT(state), NULL, &inline_fun, sizeof(counter)};
+  counter init = {0, 0, 0};
+
+  boxed_opfun boxed_fun = {boxed_op, NULL};
+  lh_handlerdef boxed_def = {LH_OP_TAIL_NOOP, LH_EFFECT(state), NULL, (lh_opfun *)&boxed_fun};
+
+  // alternate the variants and keep the best run of each
+  double inline_secs = 1e9, boxed_secs = 1e9;
+  lh_value inline_res = 0, boxed_res = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double t0 = now();
+    inline_res = lh_handle_local(&inline_def, &init, &action, 0);
+    double t1 = now();
+    boxed_fun.box = calloc(1, sizeof(counter));
+    boxed_res = lh_handle(&boxed_def, &action, 0);
+    free(boxed_fun.box);
+    double t2 = now();
+    if (t1 - t0 < inline_secs) inline_secs = t1 - t0;
+    if (t2 - t1 < boxed_secs) boxed_secs = t2 - t1;
+  }
+
+  printf("inline: %lld in %.3fs, %.1f Mops/s\n", inline_res, inline_secs, 2 * NITER / inline_secs / 1e6);
+  printf("boxed : %lld in %.3fs, %.1f Mops/s\n", boxed_res, boxed_secs, 2 * NITER / boxed_secs / 1e6);
+}
@@ -0,0 +1,278 @@
+// Contention on actor synchronization primitives against pthread ones.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched sync.c ../src/sched/sync.c ../src/sched/actor.c
+//     ../src/sched/topology.c ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s
+//     ../queue/queue.c -lpthread -o sync
+//   ./sync [workers] [tasks]
+//
+// TASKS tasks (default 64) contend on one primitive, either as actors
+// on `workers` worker threads (default 4), or as one thread each:
+// - mutex: lock, bump a counter, unlock, then a bit of work outside;
+// - semaphore: at most 4 tasks inside at a time, each doing a bit of work;
+// - barrier: all tasks meet ROUNDS times;
+// - latch: every round all tasks count down a fresh latch and wait on it.
+// Actors holding a pthread mutex block their worker; with a pthread
+// barrier or latch they would deadlock once there are more actors
+// than workers, so those are only run as threads.
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "sync.h"
+
+#define MUTEX_OPS 20000
+#define SEMA_OPS 5000
+#define SEMA_UNITS 4
+#define ROUNDS 2000
+#define WORK 50
+
+static int workers = 4;
+static int tasks = 64;
+
+static uint64_t work(uint64_t x) {
+  for (int i = 0; i < WORK; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+static volatile uint64_t sink;
+
+/*-----------------------------------------------------------------
+  Running tasks as actors or threads
+-----------------------------------------------------------------*/
+
+typedef void(taskfun)(long i);
+static taskfun *current_task;
+
+static void actor_task(void *res, uint8_t *closure, lh_value arg) {
+  current_task(lh_long_value(arg));
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun actor_task_fun = {actor_task};
+
+static double run_actors(taskfun *task) {
+  current_task = task;
+  lh_actors *actors = lh_actors_start(workers, 0);
+  double t0 = now();
+  for (long i = 0; i < tasks; i++) lh_actor_spawn(actors, &actor_task_fun, lh_value_long(i));
+  lh_actors_join(actors);
+  return now() - t0;
+}
+
+static void *thread_task(void *arg) {
+  current_task((long)(intptr_t)arg);
+  return NULL;
+}
+
+static double run_threads(taskfun *task) {
+  current_task = task;
+  pthread_t *threads = (pthread_t *)malloc(tasks * sizeof(pthread_t));
+  double t0 = now();
+  for (long i = 0; i < tasks; i++) pthread_create(&threads[i], NULL, &thread_task, (void *)(intptr_t)i);
+  for (long i = 0; i < tasks; i++) pthread_join(threads[i], NULL);
+  double secs = now() - t0;
+  free(threads);
+  return secs;
+}
+
+static void report(const char *name, long ops, double secs, bool ok) {
+  printf("%-28s %8.0f ns/op  %6.2f M ops/s%s\n", name, secs * 1e9 / ops, ops / secs / 1e6, ok ? "" : "  WRONG");
+}
+
+/*-----------------------------------------------------------------
+  Mutex
+-----------------------------------------------------------------*/
+
+static long counter;
+static lh_mutex lmutex;
+static pthread_mutex_t pmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void mutex_lh(long i) {
+  uint64_t x = i + 1;
+  for (long k = 0; k < MUTEX_OPS; k++) {
+    lh_mutex_lock(&lmutex);
+    counter++;
+    lh_mutex_unlock(&lmutex);
+    x = work(x);
+  }
+  sink += x;
+}
+
+static void mutex_pthread(long i) {
+  uint64_t x = i + 1;
+  for (long k = 0; k < MUTEX_OPS; k++) {
+    pthread_mutex_lock(&pmutex);
+    counter++;
+    pthread_mutex_unlock(&pmutex);
+    x = work(x);
+  }
+  sink += x;
+}
+
+static void bench_mutex() {
+  long ops = (long)tasks * MUTEX_OPS;
+  lh_mutex_init(&lmutex);
+  counter = 0;
+  double secs = run_actors(&mutex_lh);
+  report("mutex: actors, lh_mutex", ops, secs, counter == ops);
+  counter = 0;
+  secs = run_actors(&mutex_pthread);
+  report("mutex: actors, pthread", ops, secs, counter == ops);
+  counter = 0;
+  secs = run_threads(&mutex_pthread);
+  report("mutex: threads, pthread", ops, secs, counter == ops);
+}
+
+/*-----------------------------------------------------------------
+  Semaphore
+-----------------------------------------------------------------*/
+
+static lh_semaphore lsema;
+static sem_t psema;
+static _Atomic long inside;
+static _Atomic long max_inside;
+
+static void enter() {
+  long n = atomic_fetch_add(&inside, 1) + 1;
+  long max = atomic_load(&max_inside);
+  while (n > max && !atomic_compare_exchange_weak(&max_inside, &max, n)) {
+  }
+}
+
+static void sema_lh(long i) {
+  uint64_t x = i + 1;
+  for (long k = 0; k < SEMA_OPS; k++) {
+    lh_semaphore_wait(&lsema);
+    enter();
+    x = work(x);
+    atomic_fetch_sub(&inside, 1);
+    lh_semaphore_post(&lsema);
+  }
+  sink += x;
+}
+
+static void sema_posix(long i) {
+  uint64_t x = i + 1;
+  for (long k = 0; k < SEMA_OPS; k++) {
+    sem_wait(&psema);
+    enter();
+    x = work(x);
+    atomic_fetch_sub(&inside, 1);
+    sem_post(&psema);
+  }
+  sink += x;
+}
+
+static void bench_semaphore() {
+  long ops = (long)tasks * SEMA_OPS;
+  lh_semaphore_init(&lsema, SEMA_UNITS);
+  sem_init(&psema, 0, SEMA_UNITS);
+  max_inside = 0;
+  double secs = run_actors(&sema_lh);
+  report("semaphore: actors, lh", ops, secs, max_inside <= SEMA_UNITS);
+  max_inside = 0;
+  secs = run_threads(&sema_posix);
+  report("semaphore: threads, posix", ops, secs, max_inside <= SEMA_UNITS);
+  sem_destroy(&psema);
+}
+
+/*-----------------------------------------------------------------
+  Barrier
+-----------------------------------------------------------------*/
+
+static lh_barrier lbarrier;
+static pthread_barrier_t pbarrier;
+static _Atomic long serial;
+
+static void barrier_lh(long i) {
+  for (long r = 0; r < ROUNDS; r++) {
+    if (lh_barrier_wait(&lbarrier)) serial++;
+  }
+}
+
+static void barrier_pthread(long i) {
+  for (long r = 0; r < ROUNDS; r++) {
+    if (pthread_barrier_wait(&pbarrier) == PTHREAD_BARRIER_SERIAL_THREAD) serial++;
+  }
+}
+
+static void bench_barrier() {
+  lh_barrier_init(&lbarrier, tasks);
+  pthread_barrier_init(&pbarrier, NULL, tasks);
+  serial = 0;
+  double secs = run_actors(&barrier_lh);
+  report("barrier: actors, lh (round)", ROUNDS, secs, serial == ROUNDS);
+  serial = 0;
+  secs = run_threads(&barrier_pthread);
+  report("barrier: threads, pthread", ROUNDS, secs, serial == ROUNDS);
+  pthread_barrier_destroy(&pbarrier);
+}
+
+/*-----------------------------------------------------------------
+  Latch
+-----------------------------------------------------------------*/
+
+// A latch from a pthread mutex and condition variable
+typedef struct _platch {
+  pthread_mutex_t lock;
+  pthread_cond_t open;
+  long count;
+} platch;
+
+static lh_latch *llatches;
+static platch *platches;
+
+static void latch_lh(long i) {
+  for (long r = 0; r < ROUNDS; r++) {
+    lh_latch_count_down(&llatches[r], 1);
+    lh_latch_wait(&llatches[r]);
+  }
+}
+
+static void latch_pthread(long i) {
+  for (long r = 0; r < ROUNDS; r++) {
+    platch *l = &platches[r];
+    pthread_mutex_lock(&l->lock);
+    if (--l->count == 0) pthread_cond_broadcast(&l->open);
+    while (l->count > 0) pthread_cond_wait(&l->open, &l->lock);
+    pthread_mutex_unlock(&l->lock);
+  }
+}
+
+static void bench_latch() {
+  llatches = (lh_latch *)malloc(ROUNDS * sizeof(lh_latch));
+  platches = (platch *)malloc(ROUNDS * sizeof(platch));
+  for (long r = 0; r < ROUNDS; r++) {
+    lh_latch_init(&llatches[r], tasks);
+    pthread_mutex_init(&platches[r].lock, NULL);
+    pthread_cond_init(&platches[r].open, NULL);
+    platches[r].count = tasks;
+  }
+  report("latch: actors, lh (round)", ROUNDS, run_actors(&latch_lh), true);
+  report("latch: threads, pthread (round)", ROUNDS, run_threads(&latch_pthread), true);
+  for (long r = 0; r < ROUNDS; r++) {
+    pthread_mutex_destroy(&platches[r].lock);
+    pthread_cond_destroy(&platches[r].open);
+  }
+  free(llatches);
+  free(platches);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) workers = atoi(argv[1]);
+  if (argc > 2) tasks = atoi(argv[2]);
+  if (workers < 1) workers = 1;
+  if (tasks < 1) tasks = 1;
+  printf("%d tasks; actors on %d workers\n", tasks, workers);
+  bench_mutex();
+  bench_semaphore();
+  bench_barrier();
+  bench_latch();
+}
@@ -0,0 +1,138 @@
+// Worker placement: unpinned workers against workers pinned by cpu topology.
+//
+//   clang-18 -O3 -DNDEBUG -I../src/handlers -I../src/sched topology.c ../src/sched/actor.c
+//     ../src/sched/topology.c ../src/handlers/libhandler.c ../src/handlers/asm/setjmp_amd64.s
+//     ../queue/queue.c -lpthread -o topology
+//   ./topology [workers]
+//
+// Run it under different cpu sets to see the effect of the topology,
+// picking cpus from `lscpu -e`, for example:
+//
+//   taskset -c 0-3 ./topology        # some cpus of one package
+//   taskset -c 0,<cpu on the other socket> ./topology
+//   taskset -c 0,<hyperthread sibling of 0> ./topology
+//
+// `fan-out`: one actor spawns CHILDREN children that each do a bit of
+// work and send the result to a collector; the children are stolen by
+// the other workers. `ping-pong`: one pair of actors per worker sends
+// messages back and forth. By default there is one worker per usable
+// cpu. On a single node the benchmark runs the same, without node
+// placement.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "actor.h"
+#include "topology.h"
+
+#define CHILDREN 100000
+#define CHILD_WORK 500
+#define ROUNDS 50000
+#define NRUNS 3
+
+// fan-out
+
+static lh_actor *collector_actor;
+
+static void child(void *res, uint8_t *closure, lh_value arg) {
+  uint64_t x = (uint64_t)lh_long_value(arg) + 1;
+  for (int i = 0; i < CHILD_WORK; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  lh_actor_send(collector_actor, lh_value_long((long)(x & 1)));
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun child_fun = {child};
+
+static void collector(void *res, uint8_t *closure, lh_value arg) {
+  long sum = 0;
+  for (long i = 0; i < CHILDREN; i++) sum += lh_long_value(lh_actor_receive());
+  *(lh_value *)res = lh_value_long(sum);
+}
+
+static void root(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 0; i < CHILDREN; i++) lh_actor_spawn(lh_actor_pool(), &child_fun, lh_value_long(i));
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun collector_fun = {collector};
+static lh_actionfun root_fun = {root};
+
+static double fan_out(const lh_actors_config *config) {
+  lh_actors *actors = lh_actors_start_config(config);
+  double t0 = now();
+  collector_actor = lh_actor_spawn(actors, &collector_fun, lh_value_null);
+  lh_actor_spawn(actors, &root_fun, lh_value_null);
+  lh_actors_join(actors);
+  return CHILDREN / (now() - t0);
+}
+
+// ping-pong
+
+static void pong(void *res, uint8_t *closure, lh_value arg) {
+  for (long i = 0; i < ROUNDS; i++) {
+    lh_actor *from = (lh_actor *)lh_ptr_value(lh_actor_receive());
+    lh_actor_send(from, lh_value_null);
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static void ping(void *res, uint8_t *closure, lh_value arg) {
+  lh_actor *partner = (lh_actor *)lh_ptr_value(arg);
+  for (long i = 0; i < ROUNDS; i++) {
+    lh_actor_send(partner, lh_value_ptr(lh_actor_self()));
+    lh_actor_receive();
+  }
+  *(lh_value *)res = lh_value_null;
+}
+
+static lh_actionfun ping_fun = {ping};
+static lh_actionfun pong_fun = {pong};
+
+static double ping_pong(const lh_actors_config *config, int pairs) {
+  lh_actors *actors = lh_actors_start_config(config);
+  double t0 = now();
+  for (int i = 0; i < pairs; i++) {
+    lh_actor *p = lh_actor_spawn(actors, &pong_fun, lh_value_null);
+    lh_actor_spawn(actors, &ping_fun, lh_value_ptr(p));
+  }
+  lh_actors_join(actors);
+  return 2.0 * pairs * ROUNDS / (now() - t0);
+}
+
+static void bench(const char *name, int workers, bool pin) {
+  lh_actors_config config = {workers, 0, 0, pin};
+  double best_fan = 0, best_pp = 0;
+  for (int run = 0; run < NRUNS; run++) {
+    double f = fan_out(&config);
+    double p = ping_pong(&config, workers);
+    if (f > best_fan) best_fan = f;
+    if (p > best_pp) best_pp = p;
+  }
+  printf("%-9s fan-out %6.2f M children/s   ping-pong %6.2f M msgs/s\n", name, best_fan / 1e6, best_pp / 1e6);
+}
+
+int main(int argc, char **argv) {
+  lh_topology topo;
+  if (!lh_topology_read(&topo, NULL)) {
+    printf("no usable cpus\n");
+    return 1;
+  }
+  int packages = 0;
+  for (int i = 0; i < topo.count; i++) {
+    if (i == 0 || topo.cpus[i].package != topo.cpus[i - 1].package) packages++;
+  }
+  int workers = (argc > 1 ? atoi(argv[1]) : topo.count);
+  if (workers < 1) workers = 1;
+  printf("%d usable cpus on %d package(s) and %d node(s), %d workers; placement:", topo.count, packages, topo.nodes,
+         workers);
+  for (int i = 0; i < workers; i++) printf(" %d", topo.cpus[i % topo.count].cpu);
+  printf("\n");
+  lh_topology_free(&topo);
+  bench("unpinned", workers, false);
+  bench("pinned", workers, true);
+}
@@ -0,0 +1,23 @@
+SCRIPT_DIR="$( cd -- "$(dirname "$0")" >/dev/null 2>&1 ; pwd -P )"
+SRC_DIR=$SCRIPT_DIR/src
+BUILD_DIR=$SCRIPT_DIR/build
+HANDLER_DIR=$SRC_DIR/handlers
+SCHED_DIR=$SRC_DIR/sched
+BENCH_DIR=$SCRIPT_DIR/bench
+LIB_HANDLER="$HANDLER_DIR/libhandler.c $HANDLER_DIR/asm/setjmp_amd64.s"
+
+mkdir -p $BUILD_DIR
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/state.c $LIB_HANDLER -o $BUILD_DIR/bench-state
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/search.c $LIB_HANDLER -o $BUILD_DIR/bench-search
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/compress.c $LIB_HANDLER -o $BUILD_DIR/bench-compress
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/parked.c $LIB_HANDLER -o $BUILD_DIR/bench-parked
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/context.c $LIB_HANDLER -o $BUILD_DIR/bench-context
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/batch.c $LIB_HANDLER -o $BUILD_DIR/bench-batch
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/generator.c $LIB_HANDLER -o $BUILD_DIR/bench-generator
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR $BENCH_DIR/many.c $LIB_HANDLER -o $BUILD_DIR/bench-many
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/nursery.c $SCHED_DIR/nursery.c $LIB_HANDLER -o $BUILD_DIR/bench-nursery
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/actor.c $SCHED_DIR/actor.c $SCHED_DIR/topology.c $SCRIPT_DIR/queue/queue.c $LIB_HANDLER -lpthread -o $BUILD_DIR/bench-actor
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/preempt.c $SCHED_DIR/actor.c $SCHED_DIR/topology.c $SCRIPT_DIR/queue/queue.c $LIB_HANDLER -lpthread -o $BUILD_DIR/bench-preempt
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/topology.c $SCHED_DIR/actor.c $SCHED_DIR/topology.c $SCRIPT_DIR/queue/queue.c $LIB_HANDLER -lpthread -o $BUILD_DIR/bench-topology
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/sync.c $SCHED_DIR/sync.c $SCHED_DIR/actor.c $SCHED_DIR/topology.c $SCRIPT_DIR/queue/queue.c $LIB_HANDLER -lpthread -o $BUILD_DIR/bench-sync
+clang-18 -O3 -DNDEBUG -I$HANDLER_DIR -I$SCHED_DIR $BENCH_DIR/pipeline.c $SCHED_DIR/pipeline.c $SCRIPT_DIR/queue/queue.c $LIB_HANDLER -lpthread -o $BUILD_DIR/bench-pipeline
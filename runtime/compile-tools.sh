@@ -0,0 +1,8 @@
+SCRIPT_DIR="$( cd -- "$(dirname "$0")" >/dev/null 2>&1 ; pwd -P )"
+SRC_DIR=$SCRIPT_DIR/src
+BUILD_DIR=$SCRIPT_DIR/build
+HANDLER_DIR=$SRC_DIR/handlers
+TOOLS_DIR=$SCRIPT_DIR/tools
+
+mkdir -p $BUILD_DIR
+clang-18 -O2 -I$HANDLER_DIR $TOOLS_DIR/metrics_reader.c -o $BUILD_DIR/metrics_reader
@@ -0,0 +1,31 @@
+// Helpers shared by the queue benchmarks
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SPINS 64
+
+// Seconds on the monotonic clock
+static inline double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Nanoseconds on the monotonic clock
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Spin a little, then let the other threads run
+static inline void backoff(int *spins) {
+  if (++*spins >= SPINS) {
+    sched_yield();
+    *spins = 0;
+  }
+}
@@ -0,0 +1,119 @@
+// A growable Chase-Lev work-stealing deque of lh_value
+//
+// The memory orderings follow Lê et al. The owner publishes a push with a
+// release store of `bottom`, which the thieves acquire. A pop first takes
+// the value by decrementing `bottom`, then reads `top` after a seq_cst
+// fence; a steal reads `top`, then `bottom` after a seq_cst fence. So the
+// owner and a thief cannot both miss each other's claim on the last value,
+// which they then settle with a CAS on `top`.
+//
+// Ref: Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing
+//      for Weak Memory Models", PPoPP 2013
+// This is free and unencumbered software released into the public domain.
+#include "./deque.h"
+
+#include <stdlib.h>
+
+struct deque_array {
+  long mask;  // size - 1
+  struct deque_array *next;  // on the retired list
+  _Atomic lh_value values[];
+};
+
+static struct deque_array *array_new(long size) {
+  struct deque_array *a = malloc(sizeof(struct deque_array) + size * sizeof(lh_value));
+  if (!a) return NULL;
+  a->mask = size - 1;
+  a->next = NULL;
+  return a;
+}
+
+// Initialize an empty deque with room for (1 << exp) values before it
+// grows. Returns false when out of memory.
+bool deque_init(struct deque *d, int exp) {
+  struct deque_array *a = array_new(1L << exp);
+  if (!a) return false;
+  atomic_init(&d->top, 0);
+  atomic_init(&d->bottom, 0);
+  atomic_init(&d->array, a);
+  d->retired = NULL;
+  return true;
+}
+
+// Free the arrays of a deque that no thread is using anymore.
+void deque_free(struct deque *d) {
+  free(atomic_load_explicit(&d->array, memory_order_relaxed));
+  while (d->retired) {
+    struct deque_array *next = d->retired->next;
+    free(d->retired);
+    d->retired = next;
+  }
+}
+
+// Double the array, which holds the values from top to bottom
+static struct deque_array *grow(struct deque *d, struct deque_array *a, long top, long bottom) {
+  struct deque_array *b = array_new(2 * (a->mask + 1));
+  if (!b) return NULL;
+  for (long i = top; i < bottom; i++) {
+    lh_value v = atomic_load_explicit(a->values + (i & a->mask), memory_order_relaxed);
+    atomic_store_explicit(b->values + (i & b->mask), v, memory_order_relaxed);
+  }
+  a->next = d->retired;
+  d->retired = a;
+  atomic_store_explicit(&d->array, b, memory_order_release);
+  return b;
+}
+
+// Push a value at the bottom. Owner only. Returns false when the deque
+// needed to grow and is out of memory.
+bool deque_push(struct deque *d, lh_value v) {
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  struct deque_array *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+  if (bottom - top > a->mask) {
+    a = grow(d, a, top, bottom);
+    if (!a) return false;
+  }
+  atomic_store_explicit(a->values + (bottom & a->mask), v, memory_order_relaxed);
+  atomic_store_explicit(&d->bottom, bottom + 1, memory_order_release);
+  return true;
+}
+
+// Pop the value at the bottom into *v. Owner only. Returns false if the
+// deque is empty.
+bool deque_pop(struct deque *d, lh_value *v) {
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  struct deque_array *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+  atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&d->top, memory_order_relaxed);
+  if (top > bottom) {  // empty
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+    return false;
+  }
+  *v = atomic_load_explicit(a->values + (bottom & a->mask), memory_order_relaxed);
+  if (top < bottom) return true;
+  // the last value: race the thieves for it
+  bool won = atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed);
+  atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+  return won;
+}
+
+// Steal the value at the top into *v. Any thread. Returns 1 on success, 0
+// if the deque is empty, and -1 if it lost a race with another thief or
+// the owner, in which case it may be retried.
+int deque_steal(struct deque *d, lh_value *v) {
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (top >= bottom) return 0;
+  struct deque_array *a = atomic_load_explicit(&d->array, memory_order_acquire);
+  lh_value x = atomic_load_explicit(a->values + (top & a->mask), memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return -1;
+  }
+  *v = x;
+  return 1;
+}
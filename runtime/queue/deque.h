@@ -0,0 +1,46 @@
+// A growable Chase-Lev work-stealing deque of lh_value
+//
+// The owner pushes and pops at the bottom, in LIFO order, and thieves steal
+// from the top, in FIFO order. Owner operations are plain loads and stores
+// (and a fence) except when the owner and a thief compete for the last
+// value, and stealing takes a single CAS. When full, a push doubles the
+// array; the old arrays are kept until the deque is freed, as a thief may
+// still be reading one.
+//
+// Ref: Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing
+//      for Weak Memory Models", PPoPP 2013
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "libhandler.h"
+
+struct deque_array;
+
+struct deque {
+  _Alignas(64) _Atomic long top;     // next to steal; only ever increases
+  _Alignas(64) _Atomic long bottom;  // next to push; owned by the owner
+  struct deque_array *_Atomic array;
+  struct deque_array *retired;  // replaced arrays, freed with the deque
+};
+
+// Initialize an empty deque with room for (1 << exp) values before it
+// grows. Returns false when out of memory.
+bool deque_init(struct deque *d, int exp);
+
+// Free the arrays of a deque that no thread is using anymore.
+void deque_free(struct deque *d);
+
+// Push a value at the bottom. Owner only. Returns false when the deque
+// needed to grow and is out of memory.
+bool deque_push(struct deque *d, lh_value v);
+
+// Pop the value at the bottom into *v. Owner only. Returns false if the
+// deque is empty.
+bool deque_pop(struct deque *d, lh_value *v);
+
+// Steal the value at the top into *v. Any thread. Returns 1 on success, 0
+// if the deque is empty, and -1 if it lost a race with another thief or
+// the owner, in which case it may be retried.
+int deque_steal(struct deque *d, lh_value *v);
@@ -0,0 +1,108 @@
+// Throughput of the work-stealing deque
+//
+//   clang-18 -O3 -I../src/handlers deque.c deque_bench.c -lpthread -o deque_bench
+//
+// First the owner alone pushes NVALS values then pops them all, and then
+// pushes and pops one value at a time: the uncontended paths. Then 1 to
+// NTHIEVES thieves steal while the owner pushes NVALS values in bursts of
+// BURST and pops half of each burst back, as a scheduler would with the
+// tasks it spawns. It reports the rate at which values are taken, the
+// share that was stolen, and how many steals lost a race.
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./deque.h"
+
+#define NVALS 10000000
+#define NTHIEVES 3
+#define BURST 32
+
+struct shared {
+  struct deque d;
+  _Atomic bool done;
+  _Atomic long stolen, lost;
+  _Atomic long long sum;
+};
+
+static void *thief(void *arg) {
+  struct shared *s = arg;
+  long stolen = 0, lost = 0;
+  long long sum = 0;
+  for (;;) {
+    bool done = atomic_load(&s->done);
+    lh_value v;
+    int r = deque_steal(&s->d, &v);
+    if (r > 0) {
+      sum += v;
+      stolen++;
+    } else if (r < 0) {
+      lost++;
+    } else if (done) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+  atomic_fetch_add(&s->stolen, stolen);
+  atomic_fetch_add(&s->lost, lost);
+  atomic_fetch_add(&s->sum, sum);
+  return 0;
+}
+
+static void owner_alone(void) {
+  struct deque d;
+  deque_init(&d, 4);
+  lh_value v;
+  long long sum = 0;
+  double t0 = now();
+  for (long n = 1; n <= NVALS; n++) deque_push(&d, n);
+  while (deque_pop(&d, &v)) sum += v;
+  double secs = now() - t0;
+  printf("owner, push all then pop all: %6.1f M values/s%s\n", NVALS / secs / 1e6,
+         (sum == (long long)NVALS * (NVALS + 1) / 2 ? "" : "  WRONG SUM"));
+
+  sum = 0;
+  t0 = now();
+  for (long n = 1; n <= NVALS; n++) {
+    deque_push(&d, n);
+    if (deque_pop(&d, &v)) sum += v;
+  }
+  secs = now() - t0;
+  printf("owner, push and pop each:     %6.1f M values/s%s\n", NVALS / secs / 1e6,
+         (sum == (long long)NVALS * (NVALS + 1) / 2 ? "" : "  WRONG SUM"));
+  deque_free(&d);
+}
+
+static void with_thieves(int nthieves) {
+  struct shared *s = calloc(1, sizeof(struct shared));
+  deque_init(&s->d, 4);
+  pthread_t thr[NTHIEVES];
+  for (int n = 0; n < nthieves; n++) pthread_create(thr + n, 0, thief, s);
+  long long sum = 0;
+  double t0 = now();
+  for (long n = 1; n <= NVALS;) {
+    for (long end = n + BURST; n < end && n <= NVALS; n++) deque_push(&s->d, n);
+    lh_value v;
+    for (int k = 0; k < BURST / 2 && deque_pop(&s->d, &v); k++) sum += v;
+  }
+  lh_value v;
+  while (deque_pop(&s->d, &v)) sum += v;
+  atomic_store(&s->done, true);
+  for (int n = 0; n < nthieves; n++) pthread_join(thr[n], 0);
+  double secs = now() - t0;
+  sum += atomic_load(&s->sum);
+  printf("%d thieves: %6.1f M values/s, %4.1f%% stolen, %ld lost races%s\n", nthieves, NVALS / secs / 1e6,
+         100.0 * atomic_load(&s->stolen) / NVALS, atomic_load(&s->lost),
+         (sum == (long long)NVALS * (NVALS + 1) / 2 ? "" : "  WRONG SUM"));
+  deque_free(&s->d);
+  free(s);
+}
+
+int main(void) {
+  owner_alone();
+  for (int n = 1; n <= NTHIEVES; n++) with_thieves(n);
+}
@@ -0,0 +1,109 @@
+// Stress test of the work-stealing deque, meant to be run under TSan
+//
+//   clang-18 -O1 -g -fsanitize=thread -I../src/handlers deque.c deque_test.c -lpthread -o deque_test
+//
+// For 1 to NTHIEVES thieves, the owner of a deque that starts tiny (so
+// that it grows under the thieves) pushes NVALS values in bursts of
+// varying size, and pops some of each burst back. Each value points to a
+// cell whose payload the owner writes before the push, and whoever takes
+// the value checks the payload and counts the cell. Every value must be
+// taken exactly once, and the owner's pops must come out in LIFO order.
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./deque.h"
+
+#define NVALS 200000
+#define NTHIEVES 3
+
+struct cell {
+  long payload;  // written by the owner before the push, plain
+  _Atomic int taken;
+};
+
+struct shared {
+  struct deque d;
+  struct cell *cells;
+  _Atomic bool done;
+  _Atomic long errors;
+  _Atomic long stolen;
+};
+
+static void take(struct shared *s, lh_value v) {
+  struct cell *c = lh_ptr_value(v);
+  if (c < s->cells || c >= s->cells + NVALS || c->payload != (c - s->cells) * 3 + 1) {
+    atomic_fetch_add(&s->errors, 1);
+    return;
+  }
+  atomic_fetch_add(&c->taken, 1);
+}
+
+static void *thief(void *arg) {
+  struct shared *s = arg;
+  for (;;) {
+    bool done = atomic_load(&s->done);  // before the steal, so empty means empty
+    lh_value v;
+    int r = deque_steal(&s->d, &v);
+    if (r > 0) {
+      take(s, v);
+      atomic_fetch_add(&s->stolen, 1);
+    } else if (r == 0) {
+      if (done) return 0;
+      sched_yield();
+    }
+  }
+}
+
+static long run(int nthieves, long *stolen) {
+  struct shared *s = calloc(1, sizeof(struct shared));
+  s->cells = calloc(NVALS, sizeof(struct cell));
+  deque_init(&s->d, 1);
+  pthread_t thr[NTHIEVES];
+  for (int n = 0; n < nthieves; n++) pthread_create(thr + n, 0, thief, s);
+
+  unsigned rng = 1;
+  for (long i = 0; i < NVALS;) {
+    rng = rng * 1103515245 + 12345;
+    long burst = (rng >> 16) % 64 + 1;
+    long first = i;
+    for (; i < NVALS && i < first + burst; i++) {
+      s->cells[i].payload = i * 3 + 1;
+      if (!deque_push(&s->d, lh_value_any_ptr(s->cells + i))) abort();
+    }
+    // pop back about half of the burst, newest first
+    long last = i;
+    for (long k = 0; k < burst / 2; k++) {
+      lh_value v;
+      if (!deque_pop(&s->d, &v)) break;
+      struct cell *c = lh_ptr_value(v);
+      if (c - s->cells >= last) atomic_fetch_add(&s->errors, 1);
+      last = c - s->cells;
+      take(s, v);
+    }
+  }
+  lh_value v;
+  while (deque_pop(&s->d, &v)) take(s, v);
+  atomic_store(&s->done, true);
+  for (int n = 0; n < nthieves; n++) pthread_join(thr[n], 0);
+
+  long errors = atomic_load(&s->errors);
+  for (long i = 0; i < NVALS; i++) errors += (atomic_load(&s->cells[i].taken) != 1);
+  *stolen = atomic_load(&s->stolen);
+  deque_free(&s->d);
+  free(s->cells);
+  free(s);
+  return errors;
+}
+
+int main(void) {
+  long failed = 0;
+  for (int n = 1; n <= NTHIEVES; n++) {
+    long stolen;
+    long errors = run(n, &stolen);
+    printf("%d thieves: %s, %ld stolen\n", n, errors == 0 ? "ok" : "FAILED", stolen);
+    failed += (errors != 0);
+  }
+  return failed != 0;
+}
@@ -1 +1,13 @@
-clang-18 -O3 queue.c queue_example.c -lpthread
\ No newline at end of file
+clang-18 -O3 queue.c queue_example.c -lpthread
+clang-18 -O3 queue.c queue64.c queue64_bench.c -lpthread -o queue64_bench
+clang-18 -O3 queue_mpmc.c queue_mpmc_bench.c -lpthread -o queue_mpmc_bench
+clang-18 -O1 -g -fsanitize=thread queue_mpmc.c queue_mpmc_test.c -lpthread -o queue_mpmc_test
+clang-18 -O3 queue.c queue_batch_bench.c -lpthread -o queue_batch_bench
+clang-18 -O3 queue.c queue_wait.c queue_wait_bench.c -lpthread -o queue_wait_bench
+clang-18 -O3 queue.c queue_spsc.c queue_spsc_bench.c -lpthread -o queue_spsc_bench
+clang-18 -O3 queue.c queue_seg.c queue_seg_bench.c -lpthread -o queue_seg_bench
+clang-18 -O3 -I../src/handlers queue.c queue64.c queue_mpmc.c queue_spsc.c queue_seg.c queue_wait.c deque.c queue_shm.c queue_bcast.c queue_bench.c -lpthread -lrt -o queue_bench
+clang-18 -O3 -I../src/handlers deque.c deque_bench.c -lpthread -o deque_bench
+clang-18 -O1 -g -fsanitize=thread -I../src/handlers deque.c deque_test.c -lpthread -o deque_test
+clang-18 -O3 queue.c queue_shm.c queue_shm_bench.c -lpthread -lrt -o queue_shm_bench
+clang-18 -O3 queue.c queue_bcast.c queue_bcast_bench.c -lpthread -o queue_bcast_bench
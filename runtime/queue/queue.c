@@ -75,4 +75,78 @@ int queue_mpop(_Atomic uint32_t *q, int exp, uint32_t *save) {
 // from the beginning.
 _Bool queue_mpop_commit(_Atomic uint32_t *q, uint32_t save) {
   return atomic_compare_exchange_strong(q, &save, save + 0x10000);
-}
\ No newline at end of file
+}
+
+// Batch variants. They reserve up to max contiguous slots in one step and
+// commit them all with a single atomic, so the cost of the shared state is
+// paid once per batch rather than once per element. The batch never wraps
+// around the end of the array, so fewer than max slots may be returned
+// even when more are free; call again after the commit for the rest.
+
+// Like queue_push() but reserves up to max slots, starting at the returned
+// array index, and stores their number in *n. Returns -1 if the queue is
+// full.
+int queue_push_batch(_Atomic uint32_t *q, int exp, int max, int *n) {
+  uint32_t r = *q;
+
+  int mask = (1u << exp) - 1;
+  int head = r & mask;
+  int tail = r >> 16 & mask;
+  int free = (tail - head - 1) & mask;
+  int room = mask + 1 - head;  // up to the end of the array
+  if (r & 0x8000) {  // avoid overflow on commit, which adds at most 1 << 15
+    *q &= ~0x8000;
+  }
+  *n = free < room ? free : room;
+  *n = max < *n ? max : *n;
+  return *n == 0 ? -1 : head;
+}
+
+// Commits the n pushes reserved by queue_push_batch(). All n values appear
+// at once. This operation cannot fail.
+void queue_push_batch_commit(_Atomic uint32_t *q, int n) {
+  *q += n;
+}
+
+// Like queue_pop() but reserves up to max values, starting at the returned
+// array index, and stores their number in *n. Returns -1 if the queue is
+// empty.
+int queue_pop_batch(_Atomic uint32_t *q, int exp, int max, int *n) {
+  uint32_t r = *q;
+  int mask = (1u << exp) - 1;
+  int head = r & mask;
+  int tail = r >> 16 & mask;
+  int used = (head - tail) & mask;
+  int room = mask + 1 - tail;
+  *n = used < room ? used : room;
+  *n = max < *n ? max : *n;
+  return *n == 0 ? -1 : tail;
+}
+
+// Commits the n pops reserved by queue_pop_batch(). This operation cannot
+// fail.
+void queue_pop_batch_commit(_Atomic uint32_t *q, int n) {
+  *q += (uint32_t)n << 16;
+}
+
+// Like queue_mpop() but for a batch of up to max values, as above. The
+// whole batch is claimed by a single CAS at commit.
+int queue_mpop_batch(_Atomic uint32_t *q, int exp, int max, int *n, uint32_t *save) {
+  uint32_t r = *save = *q;
+  int mask = (1u << exp) - 1;
+  int head = r & mask;
+  int tail = r >> 16 & mask;
+  int used = (head - tail) & mask;
+  int room = mask + 1 - tail;
+  *n = used < room ? used : room;
+  *n = max < *n ? max : *n;
+  return *n == 0 ? -1 : tail;
+}
+
+// Like queue_mpop_commit() for the n values of queue_mpop_batch(). It may
+// fail if another consumer pops concurrently, in which case the batch must
+// be retried from the beginning.
+_Bool queue_mpop_batch_commit(_Atomic uint32_t *q, int n, uint32_t save) {
+  return atomic_compare_exchange_strong(q, &save, save + ((uint32_t)n << 16));
+}
+
@@ -0,0 +1,71 @@
+// A lock-free, concurrent, generic queue in 64 bits
+//
+// The head is in the low 32 bits and the tail in the high 32 bits. Only the
+// producer changes the head, so it can wrap it around within its half
+// instead of letting it carry into the tail; the tail carries out of the
+// top of the word, which wraps it for free.
+//
+// Ref: https://nullprogram.com/blog/2022/05/14/
+// This is free and unencumbered software released into the public domain.
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Return the array index for then next value to be pushed. The size of this
+// array must be (1 << exp) elements, with exp at most 31. Write the value
+// into this array index, then commit it. With a single-consumer queue, this
+// element store need not be atomic. The value will appear in the queue after
+// the commit. Returns -1 if the queue is full.
+long queue64_push(_Atomic uint64_t *q, int exp) {
+  uint64_t r = *q;
+  uint32_t head = (uint32_t)r;
+  uint32_t tail = (uint32_t)(r >> 32);
+  uint32_t size = 1u << exp;
+  return head - tail == size ? -1 : (long)(head & (size - 1));
+}
+
+// Commits and completes the push operation. Do this after storing into the
+// array. This operation cannot fail.
+void queue64_push_commit(_Atomic uint64_t *q) {
+  uint32_t head = (uint32_t)atomic_load_explicit(q, memory_order_relaxed);
+  if (head == UINT32_MAX) {
+    *q -= UINT32_MAX;  // wrap to 0 without a carry into the tail
+  } else {
+    *q += 1;
+  }
+}
+
+// Return the array index for the next value to be popped. The size of this
+// array must be (1 << exp) elements. Read from this array index, then
+// commit the pop. This element load need not be atomic. The value will be
+// removed from the queue after the commit. Returns -1 if the queue is
+// empty.
+long queue64_pop(_Atomic uint64_t *q, int exp) {
+  uint64_t r = *q;
+  uint32_t head = (uint32_t)r;
+  uint32_t tail = (uint32_t)(r >> 32);
+  return head == tail ? -1 : (long)(tail & ((1u << exp) - 1));
+}
+
+// Commits and completes the pop operation. Do this after loading from the
+// array. This operation cannot fail.
+void queue64_pop_commit(_Atomic uint64_t *q) {
+  *q += (uint64_t)1 << 32;
+}
+
+// Like queue64_pop() but for multiple-consumer queues. The element load must
+// be atomic since it is concurrent with the producer's push, though it can
+// use a relaxed memory order. The loaded value must not be used unless the
+// commit is successful. Stores a temporary "save" to be used at commit.
+long queue64_mpop(_Atomic uint64_t *q, int exp, uint64_t *save) {
+  uint64_t r = *save = *q;
+  uint32_t head = (uint32_t)r;
+  uint32_t tail = (uint32_t)(r >> 32);
+  return head == tail ? -1 : (long)(tail & ((1u << exp) - 1));
+}
+
+// Like queue64_pop_commit() but for multiple-consumer queues. It may fail if
+// another consumer pops concurrently, in which case the pop must be retried
+// from the beginning.
+_Bool queue64_mpop_commit(_Atomic uint64_t *q, uint64_t save) {
+  return atomic_compare_exchange_strong(q, &save, save + ((uint64_t)1 << 32));
+}
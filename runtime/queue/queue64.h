@@ -0,0 +1,42 @@
+// A lock-free, concurrent, generic queue in 64 bits
+//
+// The same protocol as queue.h, with the head and the tail as 32-bit
+// counters packed into one _Atomic uint64_t, so that `exp` can go up to 31
+// (2G slots). The counters run freely and wrap around, so the queue holds
+// up to (1 << exp) values, one more than the 32-bit queue. See
+// queue64_bench.c for a comparison with the 32-bit queue.
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Return the array index for then next value to be pushed. The size of this
+// array must be (1 << exp) elements, with exp at most 31. Write the value
+// into this array index, then commit it. With a single-consumer queue, this
+// element store need not be atomic. The value will appear in the queue after
+// the commit. Returns -1 if the queue is full.
+long queue64_push(_Atomic uint64_t *q, int exp);
+
+// Commits and completes the push operation. Do this after storing into the
+// array. This operation cannot fail.
+void queue64_push_commit(_Atomic uint64_t *q);
+
+// Return the array index for the next value to be popped. The size of this
+// array must be (1 << exp) elements. Read from this array index, then
+// commit the pop. This element load need not be atomic. The value will be
+// removed from the queue after the commit. Returns -1 if the queue is
+// empty.
+long queue64_pop(_Atomic uint64_t *q, int exp);
+
+// Commits and completes the pop operation. Do this after loading from the
+// array. This operation cannot fail.
+void queue64_pop_commit(_Atomic uint64_t *q);
+
+// Like queue64_pop() but for multiple-consumer queues. The element load must
+// be atomic since it is concurrent with the producer's push, though it can
+// use a relaxed memory order. The loaded value must not be used unless the
+// commit is successful. Stores a temporary "save" to be used at commit.
+long queue64_mpop(_Atomic uint64_t *q, int exp, uint64_t *save);
+
+// Like queue64_pop_commit() but for multiple-consumer queues. It may fail if
+// another consumer pops concurrently, in which case the pop must be retried
+// from the beginning.
+_Bool queue64_mpop_commit(_Atomic uint64_t *q, uint64_t save);
@@ -0,0 +1,173 @@
+// Throughput of the 64-bit queue against the 32-bit one
+//
+//   clang-18 -O3 queue.c queue64.c queue64_bench.c -lpthread -o queue64_bench
+//
+// One producer pushes NVALS values to one consumer (spsc) or to NCONS
+// consumers (spmc) through each queue, at the largest capacity of the
+// 32-bit queue and at capacities only the 64-bit queue can have. The sums
+// on both sides are compared. The `wrap` runs start the 64-bit queue with
+// its head and tail just below 2^32, so that both wrap around halfway.
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+#include "./queue64.h"
+
+#define NVALS 10000000
+#define NCONS 2
+
+static uint64_t value(long n) {
+  uint64_t x = -n - 1;
+  x *= 1111111111111111111U;
+  x ^= x >> 32;
+  return x | 1;  // never 0, which stops a consumer
+}
+
+struct task {
+  void *q;
+  int exp;
+  int nthr;
+  _Atomic uint64_t *slots;
+  uint64_t result;
+};
+
+/*-----------------------------------------------------------------
+  32-bit queue
+-----------------------------------------------------------------*/
+
+static void *consume32(void *arg) {
+  struct task *t = arg;
+  _Atomic uint32_t *q = t->q;
+  uint64_t sum = 0;
+  for (;;) {
+    int i, spins = 0;
+    uint64_t v;
+    if (t->nthr == 1) {
+      while ((i = queue_pop(q, t->exp)) < 0) backoff(&spins);
+      v = atomic_load_explicit(t->slots + i, memory_order_relaxed);
+      queue_pop_commit(q);
+    } else {
+      uint32_t save;
+      do {
+        while ((i = queue_mpop(q, t->exp, &save)) < 0) backoff(&spins);
+        v = atomic_load_explicit(t->slots + i, memory_order_relaxed);
+      } while (!queue_mpop_commit(q, save));
+    }
+    if (!v) break;
+    sum += v;
+  }
+  t->result = sum;
+  return 0;
+}
+
+static void produce32(_Atomic uint32_t *q, int exp, _Atomic uint64_t *slots, uint64_t v) {
+  int i, spins = 0;
+  while ((i = queue_push(q, exp)) < 0) backoff(&spins);
+  atomic_store_explicit(slots + i, v, memory_order_relaxed);
+  queue_push_commit(q);
+}
+
+/*-----------------------------------------------------------------
+  64-bit queue
+-----------------------------------------------------------------*/
+
+static void *consume64(void *arg) {
+  struct task *t = arg;
+  _Atomic uint64_t *q = t->q;
+  uint64_t sum = 0;
+  for (;;) {
+    long i;
+    int spins = 0;
+    uint64_t v;
+    if (t->nthr == 1) {
+      while ((i = queue64_pop(q, t->exp)) < 0) backoff(&spins);
+      v = atomic_load_explicit(t->slots + i, memory_order_relaxed);
+      queue64_pop_commit(q);
+    } else {
+      uint64_t save;
+      do {
+        while ((i = queue64_mpop(q, t->exp, &save)) < 0) backoff(&spins);
+        v = atomic_load_explicit(t->slots + i, memory_order_relaxed);
+      } while (!queue64_mpop_commit(q, save));
+    }
+    if (!v) break;
+    sum += v;
+  }
+  t->result = sum;
+  return 0;
+}
+
+static void produce64(_Atomic uint64_t *q, int exp, _Atomic uint64_t *slots, uint64_t v) {
+  long i;
+  int spins = 0;
+  while ((i = queue64_push(q, exp)) < 0) backoff(&spins);
+  atomic_store_explicit(slots + i, v, memory_order_relaxed);
+  queue64_push_commit(q);
+}
+
+/*-----------------------------------------------------------------
+  Runs
+-----------------------------------------------------------------*/
+
+static void run(const char *name, bool wide, int exp, int nthr, uint64_t start) {
+  _Atomic uint32_t q32 = 0;
+  _Atomic uint64_t q64 = start;
+  _Atomic uint64_t *slots = malloc(sizeof(uint64_t) << exp);
+  pthread_t thr[NCONS];
+  struct task tasks[NCONS];
+  for (int n = 0; n < nthr; n++) {
+    tasks[n].q = (wide ? (void *)&q64 : (void *)&q32);
+    tasks[n].exp = exp;
+    tasks[n].nthr = nthr;
+    tasks[n].slots = slots;
+    pthread_create(thr + n, 0, (wide ? consume64 : consume32), tasks + n);
+  }
+  double t0 = now();
+  uint64_t sum = 0;
+  for (long n = 0; n < NVALS; n++) {
+    uint64_t v = value(n);
+    sum += v;
+    if (wide) {
+      produce64(&q64, exp, slots, v);
+    } else {
+      produce32(&q32, exp, slots, v);
+    }
+  }
+  for (int n = 0; n < nthr; n++) {
+    if (wide) {
+      produce64(&q64, exp, slots, 0);
+    } else {
+      produce32(&q32, exp, slots, 0);
+    }
+  }
+  uint64_t got = 0;
+  for (int n = 0; n < nthr; n++) {
+    pthread_join(thr[n], 0);
+    got += tasks[n].result;
+  }
+  double secs = now() - t0;
+  printf("%-8s %s exp %2d: %6.1f M values/s%s\n", name, (nthr == 1 ? "spsc" : "spmc"), exp, NVALS / secs / 1e6,
+         (got == sum ? "" : "  WRONG SUM"));
+  free(slots);
+}
+
+int main(void) {
+  for (int nthr = 1; nthr <= NCONS; nthr++) {
+    run("queue", false, 10, nthr, 0);
+    run("queue64", true, 10, nthr, 0);
+    run("queue", false, 15, nthr, 0);
+    run("queue64", true, 15, nthr, 0);
+    run("queue64", true, 22, nthr, 0);
+  }
+  // head and tail both just below the wrap of their 32-bit halves
+  uint64_t near = UINT32_MAX - NVALS / 2;
+  run("wrap", true, 4, 1, near << 32 | near);
+  run("wrap", true, 4, 2, near << 32 | near);
+}
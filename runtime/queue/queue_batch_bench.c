@@ -0,0 +1,158 @@
+// Throughput of the batch operations of the 32-bit queue
+//
+//   clang-18 -O3 queue.c queue_batch_bench.c -lpthread -o queue_batch_bench
+//
+// One producer pushes NVALS small values to one consumer (spsc) or to NCONS
+// consumers (spmc), one at a time with queue_push()/queue_pop(), then in
+// batches of 1 to 64 values with the batch operations, which touch the
+// shared state once per batch. The sums on both sides are compared.
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+
+#define NVALS 20000000
+#define NCONS 2
+#define QEXP 12
+
+struct task {
+  _Atomic uint32_t *q;
+  _Atomic uint32_t *slots;
+  _Atomic bool *done;  // set by the consumer that pops the final 0
+  int nthr;
+  int batch;  // 0 for the single-value operations
+  uint64_t result;
+};
+
+// Reserve the next values to pop, and return their count, or 0 once the
+// queue is empty for good.
+static int reserve(struct task *t, int *i, uint32_t *save) {
+  int n = 1, spins = 0;
+  for (;;) {
+    if (t->batch == 0 && t->nthr == 1) {
+      *i = queue_pop(t->q, QEXP);
+    } else if (t->batch == 0) {
+      *i = queue_mpop(t->q, QEXP, save);
+    } else if (t->nthr == 1) {
+      *i = queue_pop_batch(t->q, QEXP, t->batch, &n);
+    } else {
+      *i = queue_mpop_batch(t->q, QEXP, t->batch, &n, save);
+    }
+    if (*i >= 0) return n;
+    if (atomic_load(t->done)) return 0;
+    backoff(&spins);
+  }
+}
+
+static bool commit(struct task *t, int n, uint32_t save) {
+  if (t->batch == 0 && t->nthr == 1) {
+    queue_pop_commit(t->q);
+  } else if (t->batch == 0) {
+    return queue_mpop_commit(t->q, save);
+  } else if (t->nthr == 1) {
+    queue_pop_batch_commit(t->q, n);
+  } else {
+    return queue_mpop_batch_commit(t->q, n, save);
+  }
+  return true;
+}
+
+static void *consume(void *arg) {
+  struct task *t = arg;
+  uint64_t sum = 0;
+  for (;;) {
+    int i, n;
+    uint32_t save;
+    uint64_t got;
+    bool last;
+    do {
+      if (!(n = reserve(t, &i, &save))) {
+        t->result = sum;
+        return 0;
+      }
+      got = 0;
+      last = false;
+      for (int k = 0; k < n; k++) {
+        uint32_t v = atomic_load_explicit(t->slots + i + k, memory_order_relaxed);
+        got += v;
+        last |= (v == 0);
+      }
+    } while (!commit(t, n, save));
+    sum += got;
+    if (last) atomic_store(t->done, true);
+  }
+}
+
+static void produce(struct task *t, uint32_t *vals, int count) {
+  while (count > 0) {
+    int i, n = 1, spins = 0;
+    if (t->batch == 0) {
+      while ((i = queue_push(t->q, QEXP)) < 0) backoff(&spins);
+    } else {
+      while ((i = queue_push_batch(t->q, QEXP, count < t->batch ? count : t->batch, &n)) < 0) {
+        backoff(&spins);
+      }
+    }
+    for (int k = 0; k < n; k++) {
+      atomic_store_explicit(t->slots + i + k, vals[k], memory_order_relaxed);
+    }
+    if (t->batch == 0) {
+      queue_push_commit(t->q);
+    } else {
+      queue_push_batch_commit(t->q, n);
+    }
+    vals += n;
+    count -= n;
+  }
+}
+
+static void run(int nthr, int batch) {
+  _Atomic uint32_t q = 0;
+  _Atomic bool done = false;
+  _Atomic uint32_t *slots = malloc(sizeof(uint32_t) << QEXP);
+  pthread_t thr[NCONS];
+  struct task tasks[NCONS];
+  for (int n = 0; n < nthr; n++) {
+    tasks[n] = (struct task){&q, slots, &done, nthr, batch, 0};
+    pthread_create(thr + n, 0, consume, tasks + n);
+  }
+  int chunk = batch ? batch : 1;
+  uint32_t *vals = malloc(sizeof(uint32_t) * chunk);
+  double t0 = now();
+  uint64_t sum = 0;
+  for (long n = 0; n < NVALS; n += chunk) {
+    for (int k = 0; k < chunk; k++) {
+      vals[k] = (uint32_t)(n + k) | 1;  // never 0
+      sum += vals[k];
+    }
+    produce(tasks, vals, chunk);
+  }
+  uint32_t zero = 0;  // behind every other value
+  produce(tasks, &zero, 1);
+  uint64_t got = 0;
+  for (int n = 0; n < nthr; n++) {
+    pthread_join(thr[n], 0);
+    got += tasks[n].result;
+  }
+  double secs = now() - t0;
+  printf("%s batch %2d: %6.1f M values/s%s\n", (nthr == 1 ? "spsc" : "spmc"), batch, NVALS / secs / 1e6,
+         (got == sum ? "" : "  WRONG SUM"));
+  free(vals);
+  free(slots);
+}
+
+int main(void) {
+  static const int batches[] = {0, 1, 4, 16, 64};
+  for (int nthr = 1; nthr <= NCONS; nthr++) {
+    for (int b = 0; b < (int)(sizeof(batches) / sizeof(*batches)); b++) {
+      run(nthr, batches[b]);
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// A concurrent, generic, bounded single-producer broadcast ring
+//
+// Head and cursors are free-running 32-bit positions. The ring is full
+// when head is (1 << exp) ahead of the slowest cursor, and empty for a
+// subscriber when its cursor has reached head. The producer's copy of the
+// slowest cursor only ever lags behind it, and a subscriber's copy of head
+// likewise, so a stale copy can only make the ring look fuller, or
+// emptier, than it is.
+//
+// This is free and unencumbered software released into the public domain.
+#include "./queue_bcast.h"
+
+// Initialize an empty ring for nsubs subscribers, numbered from 0, with
+// their cursors in an array of nsubs. The array of values must be
+// (1 << exp) elements, with exp at most 31.
+void queue_bcast_init(struct queue_bcast *b, struct queue_bcast_cursor *cursors, int nsubs) {
+  atomic_init(&b->head, 0);
+  b->gate = 0;
+  b->nsubs = nsubs;
+  b->cursors = cursors;
+  for (int i = 0; i < nsubs; i++) {
+    atomic_init(&cursors[i].pos, 0);
+    cursors[i].head_cache = 0;
+  }
+}
+
+// Return the array index for the next value to be pushed. Write the value
+// into this array index, then commit it. The element store need not be
+// atomic. Returns -1 if the slowest subscriber is a whole ring behind.
+int queue_bcast_push(struct queue_bcast *b, int exp) {
+  uint32_t head = atomic_load_explicit(&b->head, memory_order_relaxed);
+  if (head - b->gate >= 1u << exp) {
+    uint32_t lag = 0;  // of the slowest cursor
+    for (int i = 0; i < b->nsubs; i++) {
+      uint32_t pos = atomic_load_explicit(&b->cursors[i].pos, memory_order_acquire);
+      lag = (head - pos > lag ? head - pos : lag);
+    }
+    b->gate = head - lag;
+    if (lag == 1u << exp) return -1;
+  }
+  return head & ((1u << exp) - 1);
+}
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_bcast_push_commit(struct queue_bcast *b) {
+  uint32_t head = atomic_load_explicit(&b->head, memory_order_relaxed);
+  atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+// Return the array index of the next values for subscriber `sub`, and their
+// number, up to max, in *n. The batch never wraps around the end of the
+// array. Read from these array indices, then commit the read. The element
+// loads need not be atomic. Returns -1 if the subscriber has seen all the
+// values.
+int queue_bcast_read(struct queue_bcast *b, int sub, int exp, int max, int *n) {
+  struct queue_bcast_cursor *c = b->cursors + sub;
+  uint32_t pos = atomic_load_explicit(&c->pos, memory_order_relaxed);
+  if (pos == c->head_cache) {
+    c->head_cache = atomic_load_explicit(&b->head, memory_order_acquire);
+    if (pos == c->head_cache) return -1;
+  }
+  uint32_t mask = (1u << exp) - 1;
+  uint32_t avail = c->head_cache - pos;
+  uint32_t room = mask + 1 - (pos & mask);  // up to the end of the array
+  avail = (avail < room ? avail : room);
+  *n = (int)(avail < (uint32_t)max ? avail : (uint32_t)max);
+  return pos & mask;
+}
+
+// Commits the n reads of queue_bcast_read(). This operation cannot fail.
+void queue_bcast_read_commit(struct queue_bcast *b, int sub, int n) {
+  struct queue_bcast_cursor *c = b->cursors + sub;
+  uint32_t pos = atomic_load_explicit(&c->pos, memory_order_relaxed);
+  atomic_store_explicit(&c->pos, pos + n, memory_order_release);
+}
@@ -0,0 +1,51 @@
+// A concurrent, generic, bounded single-producer broadcast ring
+//
+// Unlike queue.h, where consumers compete for the values, every subscriber
+// sees every value, in order, through its own cursor. The producer may
+// only overwrite a slot once the slowest subscriber has read past it, and
+// keeps a copy of that cursor so that it only scans all of the cursors
+// when the ring looks full. Subscribers read in batches of contiguous
+// slots and commit each batch with a single store. The caller owns the
+// array of values, as with queue.h, and the subscribers are fixed at
+// initialization.
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+
+// One per subscriber, each on its own cache line
+struct queue_bcast_cursor {
+  _Alignas(64) _Atomic uint32_t pos;  // next position to read
+  uint32_t head_cache;                // the subscriber's copy of head
+};
+
+struct queue_bcast {
+  _Alignas(64) _Atomic uint32_t head;  // next position to push
+  uint32_t gate;                       // the producer's copy of the slowest cursor
+  int nsubs;
+  struct queue_bcast_cursor *cursors;
+};
+
+// Initialize an empty ring for nsubs subscribers, numbered from 0, with
+// their cursors in an array of nsubs. The array of values must be
+// (1 << exp) elements, with exp at most 31.
+void queue_bcast_init(struct queue_bcast *b, struct queue_bcast_cursor *cursors, int nsubs);
+
+// Return the array index for the next value to be pushed. Write the value
+// into this array index, then commit it. The element store need not be
+// atomic. Returns -1 if the slowest subscriber is a whole ring behind.
+int queue_bcast_push(struct queue_bcast *b, int exp);
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_bcast_push_commit(struct queue_bcast *b);
+
+// Return the array index of the next values for subscriber `sub`, and their
+// number, up to max, in *n. The batch never wraps around the end of the
+// array. Read from these array indices, then commit the read. The element
+// loads need not be atomic. Returns -1 if the subscriber has seen all the
+// values.
+int queue_bcast_read(struct queue_bcast *b, int sub, int exp, int max, int *n);
+
+// Commits the n reads of queue_bcast_read(). This operation cannot fail.
+void queue_bcast_read_commit(struct queue_bcast *b, int sub, int n);
@@ -0,0 +1,109 @@
+// Throughput of the broadcast ring against one queue per consumer
+//
+//   clang-18 -O3 queue.c queue_bcast.c queue_bcast_bench.c -lpthread -o queue_bcast_bench
+//
+// One producer sends NVALS values to each of 1 to NSUBS consumers: through
+// one broadcast ring, with reads one at a time and in batches of up to
+// BATCH, and by pushing every value into a separate queue.h ring per
+// consumer. Every consumer must see every value, and sums them.
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+#include "./queue_bcast.h"
+
+#define NVALS 5000000
+#define NSUBS 4
+#define BATCH 64
+#define QEXP 10
+
+struct shared {
+  int batch;  // 0 for the separate queues
+  struct queue_bcast b;
+  struct queue_bcast_cursor cursors[NSUBS];
+  uint64_t ring[1 << QEXP];
+  struct {
+    _Alignas(64) _Atomic uint32_t q;
+    uint64_t slots[1 << QEXP];
+  } queues[NSUBS];
+};
+
+struct task {
+  struct shared *s;
+  int sub;
+  uint64_t result;
+};
+
+static void *consume(void *arg) {
+  struct task *t = arg;
+  struct shared *s = t->s;
+  uint64_t sum = 0;
+  for (long seen = 0; seen < NVALS;) {
+    int i, n = 1, spins = 0;
+    if (s->batch) {
+      while ((i = queue_bcast_read(&s->b, t->sub, QEXP, s->batch, &n)) < 0) backoff(&spins);
+      for (int k = 0; k < n; k++) sum += s->ring[i + k];
+      queue_bcast_read_commit(&s->b, t->sub, n);
+    } else {
+      _Atomic uint32_t *q = &s->queues[t->sub].q;
+      while ((i = queue_pop(q, QEXP)) < 0) backoff(&spins);
+      sum += s->queues[t->sub].slots[i];
+      queue_pop_commit(q);
+    }
+    seen += n;
+  }
+  t->result = sum;
+  return 0;
+}
+
+static void run(int nsubs, int batch) {
+  struct shared *s = aligned_alloc(64, (sizeof(struct shared) + 63) & ~(size_t)63);
+  s->batch = batch;
+  queue_bcast_init(&s->b, s->cursors, nsubs);
+  for (int n = 0; n < nsubs; n++) atomic_init(&s->queues[n].q, 0);
+  pthread_t thr[NSUBS];
+  struct task tasks[NSUBS];
+  for (int n = 0; n < nsubs; n++) {
+    tasks[n] = (struct task){s, n, 0};
+    pthread_create(thr + n, 0, consume, tasks + n);
+  }
+  double t0 = now();
+  for (uint64_t v = 1; v <= NVALS; v++) {
+    int i, spins = 0;
+    if (batch) {
+      while ((i = queue_bcast_push(&s->b, QEXP)) < 0) backoff(&spins);
+      s->ring[i] = v;
+      queue_bcast_push_commit(&s->b);
+    } else {
+      for (int n = 0; n < nsubs; n++) {
+        while ((i = queue_push(&s->queues[n].q, QEXP)) < 0) backoff(&spins);
+        s->queues[n].slots[i] = v;
+        queue_push_commit(&s->queues[n].q);
+      }
+    }
+  }
+  bool ok = true;
+  for (int n = 0; n < nsubs; n++) {
+    pthread_join(thr[n], 0);
+    ok &= (tasks[n].result == (uint64_t)NVALS * (NVALS + 1) / 2);
+  }
+  double secs = now() - t0;
+  char name[32];
+  snprintf(name, sizeof(name), batch ? "bcast batch %d" : "%d queues", batch ? batch : nsubs);
+  printf("%d consumers, %-15s %6.1f M values/s%s\n", nsubs, name, NVALS / secs / 1e6, (ok ? "" : "  WRONG SUM"));
+  free(s);
+}
+
+int main(void) {
+  for (int nsubs = 1; nsubs <= NSUBS; nsubs *= 2) {
+    run(nsubs, 0);
+    run(nsubs, 1);
+    run(nsubs, BATCH);
+  }
+}
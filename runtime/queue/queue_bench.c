@@ -0,0 +1,540 @@
+// Benchmark suite of the queue family, as CSV
+//
+//   clang-18 -O3 -I../src/handlers queue.c queue64.c queue_mpmc.c queue_spsc.c queue_seg.c queue_wait.c deque.c
+//     queue_shm.c queue_bcast.c queue_bench.c -lpthread -lrt -o queue_bench
+//   ./queue_bench [-n values] [-q queue] [-t threads] [-p] > results.csv
+//
+// Sweeps every queue over capacities, element sizes, producer and consumer
+// counts (1, 2, 4, ... up to -t), and batch sizes (for the queue.h batch
+// operations), as far as each queue supports them. Every element carries the time it was made,
+// and the consumers record the one-way latency of each value in a
+// log-linear histogram (32 buckets per power of two). For each
+// configuration one CSV line gives the throughput and latency percentiles.
+// The sums of the timestamps on both sides are compared, and any mismatch
+// goes to stderr.
+//
+//   -n values  values per configuration (default 1000000)
+//   -q queue   only this queue
+//   -t threads most producers, and most consumers (default 4, at most 64)
+//   -p         pin the threads to distinct cores, producers first
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./bench.h"
+#include "./deque.h"
+#include "./queue.h"
+#include "./queue64.h"
+#include "./queue_bcast.h"
+#include "./queue_mpmc.h"
+#include "./queue_seg.h"
+#include "./queue_shm.h"
+#include "./queue_spsc.h"
+#include "./queue_wait.h"
+
+#define MAXTHR 64
+#define MANY MAXTHR  // as many threads as -t allows
+#define MAXBATCH 16
+#define MAXWORDS 8
+#define NBUCKETS (64 + (40 - 6) * 32)  // up to 2^40 ns
+
+/*-----------------------------------------------------------------
+  Latency histogram
+-----------------------------------------------------------------*/
+
+static int bucket(uint64_t ns) {
+  if (ns < 64) return (int)ns;
+  int e = 63 - __builtin_clzll(ns);
+  if (e >= 40) return NBUCKETS - 1;
+  return 64 + (e - 6) * 32 + (int)(ns >> (e - 5) & 31);
+}
+
+// The lower bound of a bucket
+static uint64_t bucket_ns(int b) {
+  if (b < 64) return b;
+  int e = (b - 64) / 32 + 6;
+  return (uint64_t)(32 + (b - 64) % 32) << (e - 5);
+}
+
+static uint64_t percentile(const uint64_t *hist, uint64_t total, double p) {
+  uint64_t rank = (uint64_t)(p * total);
+  rank = (rank < total ? rank : total - 1);
+  uint64_t seen = 0;
+  for (int b = 0; b < NBUCKETS; b++) {
+    seen += hist[b];
+    if (seen > rank) return bucket_ns(b);
+  }
+  return bucket_ns(NBUCKETS - 1);
+}
+
+/*-----------------------------------------------------------------
+  Queue drivers
+-----------------------------------------------------------------*/
+
+// An element is `words` 64-bit words, the first of which is its timestamp
+// (0 stops a consumer). The words are copied with relaxed atomics, as the
+// multiple-consumer queues require.
+struct bench {
+  const struct driver *d;
+  int exp, words, batch, nprod, ncons;
+  _Atomic uint64_t *slots;  // for the queues with array indices
+
+  _Alignas(64) _Atomic uint32_t q32;
+  _Alignas(64) _Atomic uint64_t q64;
+  struct queue_mpmc mpmc;
+  struct queue_spsc spsc;
+  struct queue_wait wait;
+  struct queue_seg *seg;
+  struct deque deque;
+  struct queue_shm *shm_tx, *shm_rx;  // two mappings of one ring
+  struct queue_bcast bcast;
+
+  _Alignas(64) _Atomic int stopped;  // stop values popped
+  _Atomic uint64_t psum, csum;
+  pthread_barrier_t start;
+};
+
+struct driver {
+  const char *name;
+  int maxexp;
+  int maxprod, maxcons;
+  int maxwords;    // largest element
+  bool batch;      // has batch operations
+  bool broadcast;  // every consumer pops every value
+  // Push up to n elements, or pop up to n, and return how many. Only the
+  // blocking queue waits instead of returning 0.
+  int (*push)(struct bench *b, const uint64_t *elems, int n);
+  int (*pop)(struct bench *b, uint64_t *elems, int n);
+};
+
+static void put(struct bench *b, _Atomic uint64_t *dst, const uint64_t *src, int n) {
+  for (int k = 0; k < n * b->words; k++) atomic_store_explicit(dst + k, src[k], memory_order_relaxed);
+}
+
+static void get(struct bench *b, uint64_t *dst, _Atomic uint64_t *src, int n) {
+  for (int k = 0; k < n * b->words; k++) dst[k] = atomic_load_explicit(src + k, memory_order_relaxed);
+}
+
+static _Atomic uint64_t *element(struct bench *b, long i) {
+  return b->slots + i * b->words;
+}
+
+static int queue32_push(struct bench *b, const uint64_t *elems, int n) {
+  int i = (b->batch > 1 ? queue_push_batch(&b->q32, b->exp, n, &n) : queue_push(&b->q32, b->exp));
+  if (i < 0) return 0;
+  n = (b->batch > 1 ? n : 1);
+  put(b, element(b, i), elems, n);
+  if (b->batch > 1) {
+    queue_push_batch_commit(&b->q32, n);
+  } else {
+    queue_push_commit(&b->q32);
+  }
+  return n;
+}
+
+static int queue32_pop(struct bench *b, uint64_t *elems, int n) {
+  int i;
+  uint32_t save;
+  if (b->ncons == 1) {
+    i = (b->batch > 1 ? queue_pop_batch(&b->q32, b->exp, n, &n) : queue_pop(&b->q32, b->exp));
+    if (i < 0) return 0;
+    n = (b->batch > 1 ? n : 1);
+    get(b, elems, element(b, i), n);
+    if (b->batch > 1) {
+      queue_pop_batch_commit(&b->q32, n);
+    } else {
+      queue_pop_commit(&b->q32);
+    }
+    return n;
+  }
+  int max = n;
+  do {
+    i = (b->batch > 1 ? queue_mpop_batch(&b->q32, b->exp, max, &n, &save) : queue_mpop(&b->q32, b->exp, &save));
+    if (i < 0) return 0;
+    n = (b->batch > 1 ? n : 1);
+    get(b, elems, element(b, i), n);
+  } while (b->batch > 1 ? !queue_mpop_batch_commit(&b->q32, n, save) : !queue_mpop_commit(&b->q32, save));
+  return n;
+}
+
+static int queue64_push1(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  long i = queue64_push(&b->q64, b->exp);
+  if (i < 0) return 0;
+  put(b, element(b, i), elems, 1);
+  queue64_push_commit(&b->q64);
+  return 1;
+}
+
+static int queue64_pop1(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  long i;
+  if (b->ncons == 1) {
+    if ((i = queue64_pop(&b->q64, b->exp)) < 0) return 0;
+    get(b, elems, element(b, i), 1);
+    queue64_pop_commit(&b->q64);
+    return 1;
+  }
+  uint64_t save;
+  do {
+    if ((i = queue64_mpop(&b->q64, b->exp, &save)) < 0) return 0;
+    get(b, elems, element(b, i), 1);
+  } while (!queue64_mpop_commit(&b->q64, save));
+  return 1;
+}
+
+static int mpmc_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  uint32_t ticket;
+  int i = queue_mpmc_push(&b->mpmc, b->exp, &ticket);
+  if (i < 0) return 0;
+  put(b, element(b, i), elems, 1);
+  queue_mpmc_push_commit(&b->mpmc, b->exp, ticket);
+  return 1;
+}
+
+static int mpmc_pop(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  uint32_t ticket;
+  int i = queue_mpmc_pop(&b->mpmc, b->exp, &ticket);
+  if (i < 0) return 0;
+  get(b, elems, element(b, i), 1);
+  queue_mpmc_pop_commit(&b->mpmc, b->exp, ticket);
+  return 1;
+}
+
+static int spsc_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  int i = queue_spsc_push(&b->spsc, b->exp);
+  if (i < 0) return 0;
+  put(b, element(b, i), elems, 1);
+  queue_spsc_push_commit(&b->spsc);
+  return 1;
+}
+
+static int spsc_pop(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  int i = queue_spsc_pop(&b->spsc, b->exp);
+  if (i < 0) return 0;
+  get(b, elems, element(b, i), 1);
+  queue_spsc_pop_commit(&b->spsc);
+  return 1;
+}
+
+static int seg_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  _Atomic uint64_t *p = queue_seg_push(b->seg);
+  if (!p) return 0;
+  put(b, p, elems, 1);
+  queue_seg_push_commit(b->seg);
+  return 1;
+}
+
+static int seg_pop(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  struct queue_seg_save save;
+  do {
+    _Atomic uint64_t *p = queue_seg_pop(b->seg, &save);
+    if (!p) return 0;
+    get(b, elems, p, 1);
+  } while (!queue_seg_pop_commit(b->seg, &save));
+  return 1;
+}
+
+static int wait_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  put(b, element(b, queue_push_wait(&b->wait, b->exp)), elems, 1);
+  queue_push_wait_commit(&b->wait);
+  return 1;
+}
+
+static int wait_pop(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  if (b->ncons == 1) {
+    get(b, elems, element(b, queue_pop_wait(&b->wait, b->exp)), 1);
+    queue_pop_wait_commit(&b->wait);
+    return 1;
+  }
+  uint32_t save;
+  do {
+    get(b, elems, element(b, queue_mpop_wait(&b->wait, b->exp, &save)), 1);
+  } while (!queue_mpop_wait_commit(&b->wait, save));
+  return 1;
+}
+
+// The owner pushes, thieves steal; the values are a single lh_value
+static int deque_push1(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  return (deque_push(&b->deque, (lh_value)elems[0]) ? 1 : 0);
+}
+
+static int deque_steal1(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  lh_value v;
+  if (deque_steal(&b->deque, &v) <= 0) return 0;
+  elems[0] = (uint64_t)v;
+  return 1;
+}
+
+// The messages are copied in and out of the shared mapping
+static int shm_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  void *p = queue_shm_push(b->shm_tx, b->words * sizeof(uint64_t));
+  if (!p) return 0;
+  memcpy(p, elems, b->words * sizeof(uint64_t));
+  queue_shm_push_commit(b->shm_tx);
+  return 1;
+}
+
+// The subscriber number of a consumer thread of the broadcast ring
+static __thread int subscriber;
+
+static int bcast_push(struct bench *b, const uint64_t *elems, int n) {
+  (void)n;
+  int i = queue_bcast_push(&b->bcast, b->exp);
+  if (i < 0) return 0;
+  put(b, element(b, i), elems, 1);
+  queue_bcast_push_commit(&b->bcast);
+  return 1;
+}
+
+static int bcast_read(struct bench *b, uint64_t *elems, int n) {
+  int i = queue_bcast_read(&b->bcast, subscriber, b->exp, n, &n);
+  if (i < 0) return 0;
+  get(b, elems, element(b, i), n);
+  queue_bcast_read_commit(&b->bcast, subscriber, n);
+  return n;
+}
+
+static int shm_pop(struct bench *b, uint64_t *elems, int n) {
+  (void)n;
+  uint32_t len;
+  const void *p = queue_shm_pop(b->shm_rx, &len);
+  if (!p) return 0;
+  memcpy(elems, p, len);
+  queue_shm_pop_commit(b->shm_rx);
+  return 1;
+}
+
+static const struct driver drivers[] = {
+    {"queue", 15, 1, MANY, MAXWORDS, true, false, queue32_push, queue32_pop},
+    {"queue64", 31, 1, MANY, MAXWORDS, false, false, queue64_push1, queue64_pop1},
+    {"queue_mpmc", 30, MANY, MANY, MAXWORDS, false, false, mpmc_push, mpmc_pop},
+    {"queue_spsc", 31, 1, 1, MAXWORDS, false, false, spsc_push, spsc_pop},
+    {"queue_seg", 15, 1, MANY, MAXWORDS, false, false, seg_push, seg_pop},
+    {"queue_wait", 15, 1, MANY, MAXWORDS, false, false, wait_push, wait_pop},
+    {"deque", 30, 1, MANY, 1, false, false, deque_push1, deque_steal1},
+    {"queue_shm", 15, 1, 1, MAXWORDS, false, false, shm_push, shm_pop},
+    {"queue_bcast", 31, 1, MANY, MAXWORDS, true, true, bcast_push, bcast_read},
+};
+
+/*-----------------------------------------------------------------
+  Runs
+-----------------------------------------------------------------*/
+
+static bool pin;
+static long nvals = 1000000;
+static int maxthr = 4;
+
+struct worker {
+  struct bench *b;
+  int cpu;
+  long count;       // values to push, for a producer
+  uint64_t *hist;   // for a consumer
+  uint64_t popped;  // values popped, for a consumer
+  uint64_t max;     // worst latency, for a consumer
+};
+
+static void pin_to(int cpu) {
+  if (!pin) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void push_all(struct bench *b, const uint64_t *elems, int n) {
+  int spins = 0;
+  while (n > 0) {
+    int k = b->d->push(b, elems, n);
+    if (!k) {
+      backoff(&spins);
+      continue;
+    }
+    elems += k * b->words;
+    n -= k;
+  }
+}
+
+static void *producer(void *arg) {
+  struct worker *w = arg;
+  struct bench *b = w->b;
+  uint64_t elems[MAXBATCH * MAXWORDS] = {0};
+  uint64_t sum = 0;
+  pin_to(w->cpu);
+  pthread_barrier_wait(&b->start);
+  for (long done = 0; done < w->count;) {
+    int n = (w->count - done < b->batch ? (int)(w->count - done) : b->batch);
+    for (int k = 0; k < n; k++) {
+      uint64_t ts = now_ns();
+      elems[k * b->words] = ts;
+      sum += ts;
+    }
+    push_all(b, elems, n);
+    done += n;
+  }
+  atomic_fetch_add(&b->psum, sum);
+  return 0;
+}
+
+static void *consumer(void *arg) {
+  struct worker *w = arg;
+  struct bench *b = w->b;
+  uint64_t elems[MAXBATCH * MAXWORDS];
+  uint64_t sum = 0;
+  subscriber = w->cpu - b->nprod;
+  pin_to(w->cpu);
+  pthread_barrier_wait(&b->start);
+  for (int spins = 0;;) {
+    int n = b->d->pop(b, elems, b->batch);
+    if (!n) {
+      // another consumer may have taken our stop value with its batch
+      if (atomic_load(&b->stopped) >= b->ncons) break;
+      backoff(&spins);
+      continue;
+    }
+    spins = 0;
+    uint64_t t = now_ns();
+    int stops = 0;
+    for (int k = 0; k < n; k++) {
+      uint64_t ts = elems[k * b->words];
+      if (!ts) {
+        stops++;
+        continue;
+      }
+      uint64_t ns = (t > ts ? t - ts : 0);
+      sum += ts;
+      w->hist[bucket(ns)]++;
+      w->max = (ns > w->max ? ns : w->max);
+      w->popped++;
+    }
+    if (stops) {
+      atomic_fetch_add(&b->stopped, stops);
+      break;
+    }
+  }
+  atomic_fetch_add(&b->csum, sum);
+  return 0;
+}
+
+static void run(const struct driver *d, int exp, int words, int nprod, int ncons, int batch) {
+  struct bench *b = aligned_alloc(64, (sizeof(struct bench) + 63) & ~(size_t)63);
+  *b = (struct bench){.d = d, .exp = exp, .words = words, .batch = batch, .nprod = nprod, .ncons = ncons};
+  b->slots = calloc((size_t)words << exp, sizeof(uint64_t));
+  _Atomic uint32_t *seq = malloc(sizeof(uint32_t) << exp);
+  queue_mpmc_init(&b->mpmc, seq, exp);
+  queue_spsc_init(&b->spsc);
+  if (d->push == seg_push) b->seg = queue_seg_new(words * sizeof(uint64_t), exp, 0);
+  if (d->push == deque_push1) deque_init(&b->deque, exp);
+  struct queue_bcast_cursor *cursors = NULL;
+  if (d->broadcast) {
+    cursors = aligned_alloc(64, ncons * sizeof(struct queue_bcast_cursor));
+    queue_bcast_init(&b->bcast, cursors, ncons);
+  }
+  if (d->push == shm_push) {
+    b->shm_tx = queue_shm_create(NULL, exp, words * sizeof(uint64_t));
+    b->shm_rx = queue_shm_attach_fd(queue_shm_fd(b->shm_tx));
+  }
+  pthread_barrier_init(&b->start, 0, nprod + ncons + 1);
+
+  pthread_t thr[2 * MAXTHR];
+  struct worker workers[2 * MAXTHR];
+  for (int n = 0; n < nprod + ncons; n++) {
+    bool prod = (n < nprod);
+    workers[n] = (struct worker){b, n, (prod ? nvals / nprod + (n < nvals % nprod) : 0), 0, 0, 0};
+    if (!prod) workers[n].hist = calloc(NBUCKETS, sizeof(uint64_t));
+    pthread_create(thr + n, 0, (prod ? producer : consumer), workers + n);
+  }
+  pthread_barrier_wait(&b->start);
+  uint64_t t0 = now_ns();
+  for (int n = 0; n < nprod; n++) pthread_join(thr[n], 0);
+  uint64_t stop[MAXWORDS] = {0};
+  for (int n = 0; n < (d->broadcast ? 1 : ncons); n++) push_all(b, stop, 1);  // every consumer sees a broadcast
+  for (int n = nprod; n < nprod + ncons; n++) pthread_join(thr[n], 0);
+  double secs = (now_ns() - t0) / 1e9;
+
+  uint64_t hist[NBUCKETS] = {0}, popped = 0, max = 0;
+  for (int n = nprod; n < nprod + ncons; n++) {
+    for (int k = 0; k < NBUCKETS; k++) hist[k] += workers[n].hist[k];
+    popped += workers[n].popped;
+    max = (workers[n].max > max ? workers[n].max : max);
+    free(workers[n].hist);
+  }
+  uint64_t copies = (d->broadcast ? ncons : 1);
+  if (popped != copies * nvals || copies * atomic_load(&b->psum) != atomic_load(&b->csum)) {
+    fprintf(stderr, "%s exp %d size %d %dx%d batch %d: WRONG SUM\n", d->name, exp, words * 8, nprod, ncons, batch);
+  }
+  printf("%s,%d,%d,%d,%d,%d,%ld,%.4f,%.3f,%llu,%llu,%llu,%llu,%llu\n", d->name, 1 << exp, words * 8, nprod, ncons,
+         batch, nvals, secs, nvals / secs / 1e6, (unsigned long long)percentile(hist, popped, 0.5),
+         (unsigned long long)percentile(hist, popped, 0.9), (unsigned long long)percentile(hist, popped, 0.99),
+         (unsigned long long)percentile(hist, popped, 0.999), (unsigned long long)max);
+  fflush(stdout);
+
+  pthread_barrier_destroy(&b->start);
+  if (b->seg) queue_seg_free(b->seg);
+  if (d->push == deque_push1) deque_free(&b->deque);
+  free(cursors);
+  if (b->shm_rx) queue_shm_close(b->shm_rx);
+  if (b->shm_tx) queue_shm_close(b->shm_tx);
+  free(seq);
+  free(b->slots);
+  free(b);
+}
+
+int main(int argc, char **argv) {
+  const char *only = 0;
+  for (int opt; (opt = getopt(argc, argv, "n:q:t:p")) != -1;) {
+    if (opt == 'n') {
+      nvals = atol(optarg);
+    } else if (opt == 'q') {
+      only = optarg;
+    } else if (opt == 't' && atoi(optarg) >= 1 && atoi(optarg) <= MAXTHR) {
+      maxthr = atoi(optarg);
+    } else if (opt == 'p') {
+      pin = true;
+    } else {
+      fprintf(stderr, "usage: %s [-n values] [-q queue] [-t threads (1 to %d)] [-p]\n", argv[0], MAXTHR);
+      return 1;
+    }
+  }
+
+  static const int exps[] = {6, 12};
+  static const int sizes[] = {8, 64};  // bytes, at most MAXWORDS words
+  static const int batches[] = {1, MAXBATCH};
+  printf("queue,capacity,size,producers,consumers,batch,values,seconds,mvalues_per_s,p50_ns,p90_ns,p99_ns,p999_ns,"
+         "max_ns\n");
+  for (int q = 0; q < (int)(sizeof(drivers) / sizeof(*drivers)); q++) {
+    const struct driver *d = drivers + q;
+    if (only && strcmp(only, d->name)) continue;
+    for (int e = 0; e < (int)(sizeof(exps) / sizeof(*exps)); e++) {
+      for (int s = 0; s < (int)(sizeof(sizes) / sizeof(*sizes)); s++) {
+        if (sizes[s] / 8 > d->maxwords) continue;
+        for (int nprod = 1; nprod <= d->maxprod && nprod <= maxthr; nprod *= 2) {
+          for (int ncons = 1; ncons <= d->maxcons && ncons <= maxthr; ncons *= 2) {
+            for (int k = 0; k < (int)(sizeof(batches) / sizeof(*batches)); k++) {
+              if (batches[k] > 1 && !d->batch) continue;
+              run(d, (exps[e] < d->maxexp ? exps[e] : d->maxexp), sizes[s] / 8, nprod, ncons, batches[k]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
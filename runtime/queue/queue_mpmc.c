@@ -0,0 +1,76 @@
+// A concurrent, generic, bounded multiple-producer multiple-consumer queue
+//
+// Slot i holds the sequence number of the operation it waits for. For a
+// position p mapping to slot i, seq == p means "free for the push at p",
+// and seq == p + 1 means "full, for the pop at p". A pop commits by setting
+// seq to p + (1 << exp), the push of the next lap. Positions are 32-bit and
+// wrap around; they are compared through their signed difference.
+//
+// Ref: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// This is free and unencumbered software released into the public domain.
+#include "./queue_mpmc.h"
+
+void queue_mpmc_init(struct queue_mpmc *q, _Atomic uint32_t *seq, int exp) {
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  q->seq = seq;
+  for (uint32_t i = 0; i < 1u << exp; i++) {
+    atomic_init(seq + i, i);
+  }
+}
+
+// Return the array index for the next value to be pushed, and its ticket.
+// Write the value into this array index, then commit it with the ticket.
+// The element store need not be atomic. Returns -1 if the queue is full.
+int queue_mpmc_push(struct queue_mpmc *q, int exp, uint32_t *ticket) {
+  uint32_t mask = (1u << exp) - 1;
+  uint32_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  for (;;) {
+    uint32_t seq = atomic_load_explicit(q->seq + (pos & mask), memory_order_acquire);
+    int32_t dif = (int32_t)(seq - pos);
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *ticket = pos;
+        return pos & mask;
+      }
+    } else if (dif < 0) {
+      return -1;  // the slot still holds the value of the previous lap
+    } else {
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+}
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_mpmc_push_commit(struct queue_mpmc *q, int exp, uint32_t ticket) {
+  atomic_store_explicit(q->seq + (ticket & ((1u << exp) - 1)), ticket + 1, memory_order_release);
+}
+
+// Return the array index for the next value to be popped, and its ticket.
+// Read from this array index, then commit the pop with the ticket. The
+// element load need not be atomic. Returns -1 if the queue is empty.
+int queue_mpmc_pop(struct queue_mpmc *q, int exp, uint32_t *ticket) {
+  uint32_t mask = (1u << exp) - 1;
+  uint32_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  for (;;) {
+    uint32_t seq = atomic_load_explicit(q->seq + (pos & mask), memory_order_acquire);
+    int32_t dif = (int32_t)(seq - (pos + 1));
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *ticket = pos;
+        return pos & mask;
+      }
+    } else if (dif < 0) {
+      return -1;  // not pushed yet
+    } else {
+      pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    }
+  }
+}
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_mpmc_pop_commit(struct queue_mpmc *q, int exp, uint32_t ticket) {
+  atomic_store_explicit(q->seq + (ticket & ((1u << exp) - 1)), ticket + (1u << exp), memory_order_release);
+}
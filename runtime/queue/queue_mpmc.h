@@ -0,0 +1,41 @@
+// A concurrent, generic, bounded multiple-producer multiple-consumer queue
+//
+// Like queue.h the caller owns the array of values, and pushes and pops in
+// two steps: reserve an index, access the array there, then commit. Each
+// slot also has a sequence number, so producers only contend on the CAS
+// that claims a position, and a slot being written never blocks the other
+// slots. A producer or consumer that stops between its reserve and its
+// commit holds up the consumers (or producers) that come around to its
+// slot, but nobody else.
+//
+// Ref: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct queue_mpmc {
+  _Alignas(64) _Atomic uint32_t head;  // next position to push
+  _Alignas(64) _Atomic uint32_t tail;  // next position to pop
+  _Alignas(64) _Atomic uint32_t *seq;  // (1 << exp) sequence numbers
+};
+
+// Initialize an empty queue. The array of sequence numbers and the array of
+// values must both be (1 << exp) elements, with exp at most 30.
+void queue_mpmc_init(struct queue_mpmc *q, _Atomic uint32_t *seq, int exp);
+
+// Return the array index for the next value to be pushed, and its ticket.
+// Write the value into this array index, then commit it with the ticket.
+// The element store need not be atomic. Returns -1 if the queue is full.
+int queue_mpmc_push(struct queue_mpmc *q, int exp, uint32_t *ticket);
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_mpmc_push_commit(struct queue_mpmc *q, int exp, uint32_t ticket);
+
+// Return the array index for the next value to be popped, and its ticket.
+// Read from this array index, then commit the pop with the ticket. The
+// element load need not be atomic. Returns -1 if the queue is empty.
+int queue_mpmc_pop(struct queue_mpmc *q, int exp, uint32_t *ticket);
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_mpmc_pop_commit(struct queue_mpmc *q, int exp, uint32_t ticket);
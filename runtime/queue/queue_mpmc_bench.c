@@ -0,0 +1,126 @@
+// Throughput of the MPMC queue against a ring behind a mutex
+//
+//   clang-18 -O3 queue_mpmc.c queue_mpmc_bench.c -lpthread -o queue_mpmc_bench
+//
+// NVALS values in total go from 1, 2 or 4 producers to 1, 2 or 4
+// consumers, through the MPMC queue and through the same ring guarded by a
+// pthread mutex, which is how fan-in paths serialize producers today.
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue_mpmc.h"
+
+#define NVALS 4000000
+#define QEXP 10
+#define MAXTHR 4
+
+struct shared {
+  bool locked;  // use the mutex ring instead of the MPMC queue
+  struct queue_mpmc q;
+  pthread_mutex_t lock;
+  uint32_t head, tail;  // the mutex ring
+  uint64_t slots[1 << QEXP];
+  long per_producer;
+  _Atomic int producing;
+  _Atomic uint64_t sum;
+};
+
+static bool push(struct shared *s, uint64_t v) {
+  if (s->locked) {
+    pthread_mutex_lock(&s->lock);
+    bool ok = (s->head - s->tail < (1u << QEXP));
+    if (ok) s->slots[s->head++ & ((1u << QEXP) - 1)] = v;
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+  }
+  uint32_t ticket;
+  int i = queue_mpmc_push(&s->q, QEXP, &ticket);
+  if (i < 0) return false;
+  s->slots[i] = v;
+  queue_mpmc_push_commit(&s->q, QEXP, ticket);
+  return true;
+}
+
+static bool pop(struct shared *s, uint64_t *v) {
+  if (s->locked) {
+    pthread_mutex_lock(&s->lock);
+    bool ok = (s->head != s->tail);
+    if (ok) *v = s->slots[s->tail++ & ((1u << QEXP) - 1)];
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+  }
+  uint32_t ticket;
+  int i = queue_mpmc_pop(&s->q, QEXP, &ticket);
+  if (i < 0) return false;
+  *v = s->slots[i];
+  queue_mpmc_pop_commit(&s->q, QEXP, ticket);
+  return true;
+}
+
+static void *producer(void *arg) {
+  struct shared *s = arg;
+  for (long n = 1; n <= s->per_producer; n++) {
+    int spins = 0;
+    while (!push(s, (uint64_t)n)) backoff(&spins);
+  }
+  atomic_fetch_sub(&s->producing, 1);
+  return 0;
+}
+
+static void *consumer(void *arg) {
+  struct shared *s = arg;
+  uint64_t sum = 0;
+  int spins = 0;
+  for (;;) {
+    bool done = (atomic_load(&s->producing) == 0);
+    uint64_t v;
+    if (pop(s, &v)) {
+      sum += v;
+      spins = 0;
+    } else if (done) {
+      break;
+    } else {
+      backoff(&spins);
+    }
+  }
+  atomic_fetch_add(&s->sum, sum);
+  return 0;
+}
+
+static double run(bool locked, int nprod, int ncons) {
+  static _Atomic uint32_t seq[1 << QEXP];
+  struct shared *s = calloc(1, sizeof(struct shared));
+  s->locked = locked;
+  queue_mpmc_init(&s->q, seq, QEXP);
+  pthread_mutex_init(&s->lock, NULL);
+  s->per_producer = NVALS / nprod;
+  atomic_store(&s->producing, nprod);
+  pthread_t thr[2 * MAXTHR];
+  double t0 = now();
+  for (int n = 0; n < ncons; n++) pthread_create(thr + n, 0, consumer, s);
+  for (int n = 0; n < nprod; n++) pthread_create(thr + ncons + n, 0, producer, s);
+  for (int n = 0; n < ncons + nprod; n++) pthread_join(thr[n], 0);
+  double secs = now() - t0;
+  uint64_t expect = (uint64_t)nprod * s->per_producer * (s->per_producer + 1) / 2;
+  if (atomic_load(&s->sum) != expect) printf("WRONG SUM\n");
+  pthread_mutex_destroy(&s->lock);
+  double rate = nprod * s->per_producer / secs;
+  free(s);
+  return rate;
+}
+
+int main(void) {
+  printf("producers consumers   mpmc          mutex\n");
+  for (int nprod = 1; nprod <= MAXTHR; nprod *= 2) {
+    for (int ncons = 1; ncons <= MAXTHR; ncons *= 2) {
+      double mpmc = run(false, nprod, ncons);
+      double locked = run(true, nprod, ncons);
+      printf("%9d %9d   %5.1f M/s     %5.1f M/s\n", nprod, ncons, mpmc / 1e6, locked / 1e6);
+    }
+  }
+}
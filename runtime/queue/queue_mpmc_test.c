@@ -0,0 +1,116 @@
+// Stress test of the MPMC queue, meant to be run under TSan
+//
+//   clang-18 -O1 -g -fsanitize=thread queue_mpmc.c queue_mpmc_test.c -lpthread -o queue_mpmc_test
+//
+// For every combination of up to NTHR producers and NTHR consumers, on a
+// small queue so that it is full and empty all the time, each producer
+// pushes NVALS values tagged with its id. Every consumer checks that the
+// values of each producer come out in order, and at the end every value
+// must have been popped exactly once.
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./queue_mpmc.h"
+
+#define NVALS 100000
+#define NTHR 4
+#define QEXP 3
+
+struct shared {
+  struct queue_mpmc q;
+  uint64_t *slots;  // producer id in the high 32 bits, value + 1 in the low ones
+  _Atomic long popped[NTHR];  // per producer
+  _Atomic uint64_t sums[NTHR];
+  _Atomic int producing;
+  _Atomic long errors;
+};
+
+struct task {
+  struct shared *s;
+  int id;
+};
+
+static void *producer(void *arg) {
+  struct task *t = arg;
+  struct shared *s = t->s;
+  for (uint32_t v = 1; v <= NVALS; v++) {
+    uint32_t ticket;
+    int i;
+    while ((i = queue_mpmc_push(&s->q, QEXP, &ticket)) < 0) sched_yield();
+    s->slots[i] = (uint64_t)t->id << 32 | v;
+    queue_mpmc_push_commit(&s->q, QEXP, ticket);
+  }
+  atomic_fetch_sub(&s->producing, 1);
+  return 0;
+}
+
+static void *consumer(void *arg) {
+  struct task *t = arg;
+  struct shared *s = t->s;
+  uint32_t last[NTHR] = {0};
+  for (;;) {
+    // if all producers were done before the pop, empty means empty
+    int done = (atomic_load(&s->producing) == 0);
+    uint32_t ticket;
+    int i = queue_mpmc_pop(&s->q, QEXP, &ticket);
+    if (i < 0) {
+      if (done) return 0;
+      sched_yield();
+      continue;
+    }
+    uint64_t x = s->slots[i];
+    queue_mpmc_pop_commit(&s->q, QEXP, ticket);
+    int id = (int)(x >> 32);
+    uint32_t v = (uint32_t)x;
+    if (id < 0 || id >= NTHR || v <= last[id]) {
+      atomic_fetch_add(&s->errors, 1);
+      continue;
+    }
+    last[id] = v;
+    atomic_fetch_add(&s->popped[id], 1);
+    atomic_fetch_add(&s->sums[id], v);
+  }
+}
+
+static long run(int nprod, int ncons) {
+  struct shared *s = calloc(1, sizeof(struct shared));
+  _Atomic uint32_t *seq = malloc(sizeof(uint32_t) << QEXP);
+  s->slots = malloc(sizeof(uint64_t) << QEXP);
+  queue_mpmc_init(&s->q, seq, QEXP);
+  atomic_store(&s->producing, nprod);
+  pthread_t prod[NTHR], cons[NTHR];
+  struct task ptasks[NTHR], ctasks[NTHR];
+  for (int n = 0; n < ncons; n++) {
+    ctasks[n] = (struct task){s, n};
+    pthread_create(cons + n, 0, consumer, ctasks + n);
+  }
+  for (int n = 0; n < nprod; n++) {
+    ptasks[n] = (struct task){s, n};
+    pthread_create(prod + n, 0, producer, ptasks + n);
+  }
+  for (int n = 0; n < nprod; n++) pthread_join(prod[n], 0);
+  for (int n = 0; n < ncons; n++) pthread_join(cons[n], 0);
+  long errors = atomic_load(&s->errors);
+  uint64_t expect = (uint64_t)NVALS * (NVALS + 1) / 2;
+  for (int n = 0; n < nprod; n++) {
+    if (atomic_load(&s->popped[n]) != NVALS || atomic_load(&s->sums[n]) != expect) errors++;
+  }
+  free(s->slots);
+  free(seq);
+  free(s);
+  return errors;
+}
+
+int main(void) {
+  long failed = 0;
+  for (int nprod = 1; nprod <= NTHR; nprod++) {
+    for (int ncons = 1; ncons <= NTHR; ncons++) {
+      long errors = run(nprod, ncons);
+      printf("%d producers, %d consumers: %s\n", nprod, ncons, errors == 0 ? "ok" : "FAILED");
+      failed += (errors != 0);
+    }
+  }
+  return failed != 0;
+}
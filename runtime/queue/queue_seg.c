@@ -0,0 +1,214 @@
+// An unbounded single-producer multiple-consumer queue of queue.h rings
+//
+// A segment stops receiving pushes once the producer has linked its next
+// segment, so a consumer that finds it empty after seeing `next` knows it
+// is exhausted, and unlinks it from the head with a CAS. Consumers that
+// loaded the head earlier may still be reading it, so the unlinked segment
+// goes onto a `retired` stack, and the producer only reuses it after a
+// grace period:
+//
+// Consumers register in one of two counters, `active[epoch]`, for the
+// whole of a pop. The producer takes the retired segments into its own
+// `limbo` list, flips the epoch, and moves the limbo to its free list once
+// the counter of the old epoch has drained. Any consumer that could hold a
+// retired segment registered before the flip, under the old epoch, since
+// the producer never flips again before the previous epoch has drained.
+// The producer never waits for it either: until then it allocates (or, at
+// the limit, fails).
+//
+// This is free and unencumbered software released into the public domain.
+#include "./queue_seg.h"
+
+#include <stdlib.h>
+
+#include "./queue.h"
+
+struct queue_seg_segment {
+  _Atomic uint32_t q;                      // queue.h state
+  struct queue_seg_segment *_Atomic next;  // set once the producer moved on
+  struct queue_seg_segment *link;          // on the retired, limbo or free list
+  _Alignas(64) unsigned char slots[];
+};
+
+struct queue_seg {
+  // consumers
+  _Alignas(64) struct queue_seg_segment *_Atomic head;
+  struct queue_seg_segment *_Atomic retired;
+  _Alignas(64) _Atomic int epoch;
+  _Atomic long active[2];
+
+  // producer
+  _Alignas(64) struct queue_seg_segment *tail;
+  struct queue_seg_segment *limbo;  // retired, waiting for the grace period
+  int limbo_epoch;
+  struct queue_seg_segment *free;  // ready for reuse
+  int count;  // segments allocated
+
+  size_t size;
+  int exp;
+  int max;
+};
+
+static struct queue_seg_segment *segment_new(struct queue_seg *q) {
+  size_t bytes = sizeof(struct queue_seg_segment) + (q->size << q->exp);
+  struct queue_seg_segment *s = aligned_alloc(64, (bytes + 63) & ~(size_t)63);
+  if (s) q->count++;
+  return s;
+}
+
+// Return a pointer to the element at array index i of segment s
+static void *slot(struct queue_seg *q, struct queue_seg_segment *s, int i) {
+  return s->slots + q->size * i;
+}
+
+// Return a new empty queue of elements of `size` bytes, in segments of
+// (1 << exp) elements, with exp at most 15. With max > 0 the queue holds
+// at most max segments, including recycled ones. Returns NULL when out of
+// memory.
+struct queue_seg *queue_seg_new(size_t size, int exp, int max) {
+  struct queue_seg *q = aligned_alloc(64, (sizeof(struct queue_seg) + 63) & ~(size_t)63);
+  if (!q) return NULL;
+  *q = (struct queue_seg){.size = size, .exp = exp, .max = max};
+  struct queue_seg_segment *s = segment_new(q);
+  if (!s) {
+    free(q);
+    return NULL;
+  }
+  atomic_init(&s->q, 0);
+  atomic_init(&s->next, NULL);
+  s->link = NULL;
+  atomic_init(&q->head, s);
+  q->tail = s;
+  return q;
+}
+
+static void free_list(struct queue_seg_segment *s, _Bool chain) {
+  while (s) {
+    struct queue_seg_segment *next = (chain ? atomic_load(&s->next) : s->link);
+    free(s);
+    s = next;
+  }
+}
+
+// Free the queue, which no thread may be using anymore.
+void queue_seg_free(struct queue_seg *q) {
+  free_list(atomic_load(&q->head), 1);
+  free_list(atomic_load(&q->retired), 0);
+  free_list(q->limbo, 0);
+  free_list(q->free, 0);
+  free(q);
+}
+
+/*-----------------------------------------------------------------
+  Producer
+-----------------------------------------------------------------*/
+
+// Move the limbo to the free list if its grace period is over, and start
+// the next one
+static void reclaim(struct queue_seg *q) {
+  if (q->limbo && atomic_load(&q->active[q->limbo_epoch]) == 0) {
+    struct queue_seg_segment *s = q->limbo;
+    while (s->link) s = s->link;
+    s->link = q->free;
+    q->free = q->limbo;
+    q->limbo = NULL;
+  }
+  if (!q->limbo && atomic_load_explicit(&q->retired, memory_order_relaxed)) {
+    q->limbo = atomic_exchange(&q->retired, NULL);
+    q->limbo_epoch = atomic_load(&q->epoch);
+    atomic_store(&q->epoch, !q->limbo_epoch);
+  }
+}
+
+// Return an empty segment, or NULL at the limit or when out of memory
+static struct queue_seg_segment *segment_get(struct queue_seg *q) {
+  reclaim(q);
+  struct queue_seg_segment *s = q->free;
+  if (s) {
+    q->free = s->link;
+  } else if (q->max <= 0 || q->count < q->max) {
+    s = segment_new(q);
+    if (!s) return NULL;
+  } else {
+    return NULL;
+  }
+  atomic_store_explicit(&s->q, 0, memory_order_relaxed);
+  atomic_store_explicit(&s->next, NULL, memory_order_relaxed);
+  s->link = NULL;
+  return s;
+}
+
+// Return a pointer to the next element to be pushed. Write the value into
+// it, then commit it. The stores must be atomic, though they can use a
+// relaxed memory order, since a consumer may load the element concurrently
+// (and then discard it). Returns NULL only if the queue is at its maximum
+// number of segments and they are all full, or when out of memory. Only
+// one thread may push.
+void *queue_seg_push(struct queue_seg *q) {
+  int i = queue_push(&q->tail->q, q->exp);
+  if (i >= 0) return slot(q, q->tail, i);
+  struct queue_seg_segment *s = segment_get(q);
+  if (!s) return NULL;
+  atomic_store_explicit(&q->tail->next, s, memory_order_release);
+  q->tail = s;
+  return slot(q, s, queue_push(&s->q, q->exp));
+}
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_seg_push_commit(struct queue_seg *q) {
+  queue_push_commit(&q->tail->q);
+}
+
+/*-----------------------------------------------------------------
+  Consumers
+-----------------------------------------------------------------*/
+
+static int enter(struct queue_seg *q) {
+  for (;;) {
+    int epoch = atomic_load(&q->epoch);
+    atomic_fetch_add(&q->active[epoch], 1);
+    if (atomic_load(&q->epoch) == epoch) return epoch;
+    atomic_fetch_sub(&q->active[epoch], 1);  // flipped meanwhile
+  }
+}
+
+static void leave(struct queue_seg *q, int epoch) {
+  atomic_fetch_sub(&q->active[epoch], 1);
+}
+
+// Return a pointer to the next element to be popped, and fill `save` for
+// the commit. The loads must be atomic, though they can use a relaxed
+// memory order, and the loaded value must not be used unless the commit is
+// successful. Returns NULL if the queue is empty, and then needs no commit.
+void *queue_seg_pop(struct queue_seg *q, struct queue_seg_save *save) {
+  save->epoch = enter(q);
+  for (;;) {
+    struct queue_seg_segment *s = atomic_load(&q->head);
+    int i = queue_mpop(&s->q, q->exp, &save->state);
+    if (i >= 0) {
+      save->segment = s;
+      return slot(q, s, i);
+    }
+    struct queue_seg_segment *next = atomic_load_explicit(&s->next, memory_order_acquire);
+    if (!next) break;
+    // no push can follow `next`, but one may have just preceded it
+    if (queue_mpop(&s->q, q->exp, &save->state) >= 0) continue;
+    if (atomic_compare_exchange_strong(&q->head, &s, next)) {
+      struct queue_seg_segment *top = atomic_load_explicit(&q->retired, memory_order_relaxed);
+      do {
+        s->link = top;
+      } while (!atomic_compare_exchange_weak_explicit(&q->retired, &top, s, memory_order_release,
+                                                      memory_order_relaxed));
+    }
+  }
+  leave(q, save->epoch);
+  return NULL;
+}
+
+// Commits the pop operation. It may fail if another consumer pops
+// concurrently, in which case the pop must be retried from the beginning.
+_Bool queue_seg_pop_commit(struct queue_seg *q, struct queue_seg_save *save) {
+  _Bool ok = queue_mpop_commit(&save->segment->q, save->state);
+  leave(q, save->epoch);
+  return ok;
+}
@@ -0,0 +1,58 @@
+// An unbounded single-producer multiple-consumer queue of queue.h rings
+//
+// The queue is a linked list of segments, each a queue.h ring of
+// (1 << exp) elements of a fixed size. When the producer finds its segment
+// full, it links a new one instead of failing, so a burst grows the queue
+// rather than stalling the producer. Consumers pop from the oldest segment
+// and unlink it once it is empty and the producer has moved on. Unlinked
+// segments are recycled by the producer, through a free list, once every
+// consumer that could still see them has left. An optional limit on the
+// number of segments bounds the growth, and then a push may fail again.
+//
+// Unlike queue.h the queue owns its elements: the operations return
+// pointers to them rather than array indices.
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct queue_seg;
+
+// What a consumer holds between queue_seg_pop() and its commit
+struct queue_seg_save {
+  struct queue_seg_segment *segment;
+  uint32_t state;
+  int epoch;
+};
+
+// Return a new empty queue of elements of `size` bytes, in segments of
+// (1 << exp) elements, with exp at most 15. With max > 0 the queue holds
+// at most max segments, including recycled ones. Returns NULL when out of
+// memory.
+struct queue_seg *queue_seg_new(size_t size, int exp, int max);
+
+// Free the queue, which no thread may be using anymore.
+void queue_seg_free(struct queue_seg *q);
+
+// Return a pointer to the next element to be pushed. Write the value into
+// it, then commit it. The stores must be atomic, though they can use a
+// relaxed memory order, since a consumer may load the element concurrently
+// (and then discard it). Returns NULL only if the queue is at its maximum
+// number of segments and they are all full, or when out of memory. Only
+// one thread may push.
+void *queue_seg_push(struct queue_seg *q);
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_seg_push_commit(struct queue_seg *q);
+
+// Return a pointer to the next element to be popped, and fill `save` for
+// the commit. The loads must be atomic, though they can use a relaxed
+// memory order, and the loaded value must not be used unless the commit is
+// successful. Returns NULL if the queue is empty, and then needs no commit.
+void *queue_seg_pop(struct queue_seg *q, struct queue_seg_save *save);
+
+// Commits the pop operation. It may fail if another consumer pops
+// concurrently, in which case the pop must be retried from the beginning.
+_Bool queue_seg_pop_commit(struct queue_seg *q, struct queue_seg_save *save);
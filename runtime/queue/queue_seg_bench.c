@@ -0,0 +1,122 @@
+// Producer stalls on bursts: the 32-bit queue against the segmented queue
+//
+//   clang-18 -O3 queue.c queue_seg.c queue_seg_bench.c -lpthread -o queue_seg_bench
+//
+// The producer pushes NBURSTS bursts of BURST values as fast as it can,
+// pausing GAP_US microseconds between bursts, to NCONS consumers that spend
+// some WORK on each value, so that a burst outruns them. A ring of
+// (1 << QEXP) elements fills up and stalls the producer, while the
+// segmented queue grows instead, or grows up to a limit. The producer's
+// total stall time (while a push fails) and its worst burst are reported,
+// and the sums on both sides are compared.
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+#include "./queue_seg.h"
+
+#define NBURSTS 50
+#define BURST 20000
+#define GAP_US 20000
+#define WORK 100
+#define NCONS 2
+#define QEXP 10
+
+struct shared {
+  struct queue_seg *seg;  // NULL for the ring
+  _Atomic uint32_t q;
+  _Atomic uint64_t slots[1 << QEXP];
+  _Atomic uint64_t sum;
+};
+
+static void *consume(void *arg) {
+  struct shared *s = arg;
+  uint64_t sum = 0;
+  for (;;) {
+    uint64_t v;
+    int spins = 0;
+    if (s->seg) {
+      struct queue_seg_save save;
+      _Atomic uint64_t *p;
+      do {
+        while (!(p = queue_seg_pop(s->seg, &save))) backoff(&spins);
+        v = atomic_load_explicit(p, memory_order_relaxed);
+      } while (!queue_seg_pop_commit(s->seg, &save));
+    } else {
+      uint32_t save;
+      int i;
+      do {
+        while ((i = queue_mpop(&s->q, QEXP, &save)) < 0) backoff(&spins);
+        v = atomic_load_explicit(s->slots + i, memory_order_relaxed);
+      } while (!queue_mpop_commit(&s->q, save));
+    }
+    if (!v) break;
+    sum += v;
+    for (volatile int n = 0; n < WORK; n++) {
+    }
+  }
+  atomic_fetch_add(&s->sum, sum);
+  return 0;
+}
+
+// Push v and return the seconds spent stalled on a full queue
+static double produce(struct shared *s, uint64_t v) {
+  double t0 = 0;
+  int spins = 0;
+  if (s->seg) {
+    _Atomic uint64_t *p;
+    while (!(p = queue_seg_push(s->seg))) {
+      if (!t0) t0 = now();
+      backoff(&spins);
+    }
+    atomic_store_explicit(p, v, memory_order_relaxed);
+    queue_seg_push_commit(s->seg);
+  } else {
+    int i;
+    while ((i = queue_push(&s->q, QEXP)) < 0) {
+      if (!t0) t0 = now();
+      backoff(&spins);
+    }
+    atomic_store_explicit(s->slots + i, v, memory_order_relaxed);
+    queue_push_commit(&s->q);
+  }
+  return t0 ? now() - t0 : 0;
+}
+
+static void run(const char *name, bool seg, int max) {
+  struct shared *s = calloc(1, sizeof(struct shared));
+  if (seg) s->seg = queue_seg_new(sizeof(uint64_t), QEXP, max);
+  pthread_t thr[NCONS];
+  for (int n = 0; n < NCONS; n++) pthread_create(thr + n, 0, consume, s);
+  uint64_t sum = 0;
+  double stalled = 0, worst = 0;
+  for (int b = 0; b < NBURSTS; b++) {
+    double t0 = now();
+    for (long n = 1; n <= BURST; n++) {
+      stalled += produce(s, n);
+      sum += n;
+    }
+    double secs = now() - t0;
+    worst = secs > worst ? secs : worst;
+    nanosleep(&(struct timespec){0, GAP_US * 1000L}, 0);
+  }
+  for (int n = 0; n < NCONS; n++) produce(s, 0);
+  for (int n = 0; n < NCONS; n++) pthread_join(thr[n], 0);
+  printf("%-19s stalled %7.1f ms, worst burst %6.2f ms%s\n", name, stalled * 1e3, worst * 1e3,
+         (atomic_load(&s->sum) == sum ? "" : "  WRONG SUM"));
+  if (seg) queue_seg_free(s->seg);
+  free(s);
+}
+
+int main(void) {
+  run("queue", false, 0);
+  run("queue_seg max 4", true, 4);
+  run("queue_seg max 32", true, 32);
+  run("queue_seg unbounded", true, 0);
+}
@@ -0,0 +1,218 @@
+// A cross-process ring over shared memory
+//
+// The mapping starts with a header, then the slots, each a 64-bit length
+// followed by the message, padded to a whole number of cache lines. The
+// creator fills the header and sets its magic number last, with a release
+// store, so that an attacher that sees the magic also sees the rest. An
+// attacher that comes in before that, while the object is still empty or
+// the magic is still 0, waits for the creator for up to a second.
+//
+// This is free and unencumbered software released into the public domain.
+#define _GNU_SOURCE
+#include "./queue_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./queue.h"
+
+#define MAGIC 0x51534852  // "QSHR"
+#define ATTACH_WAIT_US 1000000  // how long an attacher waits for the creator
+
+struct header {
+  _Atomic uint32_t magic;
+  uint32_t exp;
+  uint32_t size;    // largest message
+  uint32_t stride;  // bytes per slot
+  _Alignas(64) _Atomic uint32_t q;  // queue.h state
+};
+
+struct slot {
+  uint64_t len;
+  _Alignas(8) unsigned char payload[];
+};
+
+// The geometry is copied out of the header when mapping, so that another
+// process scribbling over the header cannot make this one read or write
+// outside the mapping.
+struct queue_shm {
+  struct header *h;
+  unsigned char *slots;
+  size_t bytes;  // of the mapping
+  int fd;
+  int exp;
+  uint32_t size, stride;
+};
+
+#define SLOTS_OFFSET ((sizeof(struct header) + 63) & ~(size_t)63)
+
+static struct slot *slot(struct queue_shm *s, int i) {
+  return (struct slot *)(s->slots + (size_t)s->stride * i);
+}
+
+static struct queue_shm *map(int fd, size_t bytes) {
+  struct queue_shm *s = malloc(sizeof(struct queue_shm));
+  if (!s) return NULL;
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    free(s);
+    return NULL;
+  }
+  s->h = p;
+  s->slots = (unsigned char *)p + SLOTS_OFFSET;
+  s->bytes = bytes;
+  s->fd = fd;
+  return s;
+}
+
+// Create a ring of (1 << exp) slots of messages of up to `size` bytes,
+// with exp at most 15. With a name (like "/name") it is a POSIX shared
+// memory object, which must not exist yet; without one it is a memfd.
+// Returns NULL with errno set on failure, and EINVAL if the ring would be
+// too large.
+struct queue_shm *queue_shm_create(const char *name, int exp, uint32_t size) {
+  size_t stride = (sizeof(struct slot) + (size_t)size + 63) & ~(size_t)63;
+  if (exp < 1 || exp > 15 || stride > UINT32_MAX || stride > (SIZE_MAX - SLOTS_OFFSET) >> exp) {
+    errno = EINVAL;
+    return NULL;
+  }
+  int fd = (name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : memfd_create("queue_shm", 0));
+  if (fd < 0) return NULL;
+  size_t bytes = SLOTS_OFFSET + (stride << exp);
+  struct queue_shm *s = NULL;
+  if (ftruncate(fd, bytes) == 0) s = map(fd, bytes);
+  if (!s) {
+    int err = errno;
+    if (name) shm_unlink(name);
+    close(fd);
+    errno = err;
+    return NULL;
+  }
+  s->h->exp = s->exp = exp;
+  s->h->size = s->size = size;
+  s->h->stride = s->stride = (uint32_t)stride;
+  atomic_store_explicit(&s->h->q, 0, memory_order_relaxed);
+  atomic_store_explicit(&s->h->magic, MAGIC, memory_order_release);
+  return s;
+}
+
+// Copy the geometry out of the header of a mapped ring, and check that it
+// fits in the mapping. Returns 1 if it does, 0 if the creator has not set
+// the magic yet, and -1 if it is not a ring.
+static int adopt(struct queue_shm *s) {
+  uint32_t magic = atomic_load_explicit(&s->h->magic, memory_order_acquire);
+  if (magic == 0) return 0;
+  if (magic != MAGIC) return -1;
+  s->exp = s->h->exp;
+  s->size = s->h->size;
+  s->stride = s->h->stride;
+  bool fits = s->exp >= 1 && s->exp <= 15 && s->stride >= sizeof(struct slot) + s->size &&
+              s->stride <= (SIZE_MAX - SLOTS_OFFSET) >> s->exp &&
+              SLOTS_OFFSET + ((size_t)s->stride << s->exp) <= s->bytes;
+  return (fits ? 1 : -1);
+}
+
+// Attach to a ring created under `name`, or from the fd of its creator
+// (see queue_shm_fd()), which is duplicated. Returns NULL with errno set
+// on failure, EINVAL if it is not a ring, and EAGAIN if its creator did
+// not finish setting it up within a second.
+struct queue_shm *queue_shm_attach_fd(int fd) {
+  fd = dup(fd);
+  if (fd < 0) return NULL;
+  struct queue_shm *s = NULL;
+  int err = EAGAIN;
+  for (long waited = 0, us = 1; waited < ATTACH_WAIT_US; waited += us, us = (us < 1000 ? 2 * us : us)) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      err = errno;
+      break;
+    }
+    if ((size_t)st.st_size >= SLOTS_OFFSET) {  // otherwise not sized yet
+      if (!(s = map(fd, st.st_size))) {
+        err = errno;
+        break;
+      }
+      int ok = adopt(s);
+      if (ok > 0) return s;
+      munmap(s->h, s->bytes);
+      free(s);
+      s = NULL;
+      if (ok < 0) {
+        err = EINVAL;
+        break;
+      }
+    }
+    nanosleep(&(struct timespec){0, us * 1000}, NULL);
+  }
+  close(fd);
+  errno = err;
+  return NULL;
+}
+
+struct queue_shm *queue_shm_attach(const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) return NULL;
+  struct queue_shm *s = queue_shm_attach_fd(fd);
+  int err = errno;
+  close(fd);
+  errno = err;
+  return s;
+}
+
+// The fd of the mapping, to pass to another process.
+int queue_shm_fd(struct queue_shm *s) {
+  return s->fd;
+}
+
+// Unmap the ring in this process. The ring lives on while other processes
+// have it mapped, and a named one until it is unlinked.
+void queue_shm_close(struct queue_shm *s) {
+  munmap(s->h, s->bytes);
+  close(s->fd);
+  free(s);
+}
+
+// Remove the name of a ring. Returns -1 with errno set on failure.
+int queue_shm_unlink(const char *name) {
+  return shm_unlink(name);
+}
+
+// Return the buffer for the next message to be pushed, of len bytes.
+// Write the message into it, then commit it. Returns NULL if the queue is
+// full, or if len is larger than the slots.
+void *queue_shm_push(struct queue_shm *s, uint32_t len) {
+  if (len > s->size) return NULL;
+  int i = queue_push(&s->h->q, s->exp);
+  if (i < 0) return NULL;
+  struct slot *t = slot(s, i);
+  t->len = len;
+  return t->payload;
+}
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_shm_push_commit(struct queue_shm *s) {
+  queue_push_commit(&s->h->q);
+}
+
+// Return the next message to be popped, and its length in *len. Read it,
+// then commit the pop. Returns NULL if the queue is empty.
+const void *queue_shm_pop(struct queue_shm *s, uint32_t *len) {
+  int i = queue_pop(&s->h->q, s->exp);
+  if (i < 0) return NULL;
+  struct slot *t = slot(s, i);
+  *len = (uint32_t)(t->len < s->size ? t->len : s->size);
+  return t->payload;
+}
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_shm_pop_commit(struct queue_shm *s) {
+  queue_pop_commit(&s->h->q);
+}
@@ -0,0 +1,59 @@
+// A cross-process ring over shared memory
+//
+// The queue.h state and its slot array live together in one shared
+// mapping, either named (shm_open) so that unrelated processes can attach
+// by name, or anonymous (memfd_create) and passed on by fd, over fork() or
+// a Unix socket. Each slot holds a message of up to `size` bytes and its
+// length. Pushing and popping are the queue.h reserve/commit operations on
+// the shared state, so the fast path needs no syscall, and a message is
+// written and read in place, without copies through the kernel.
+//
+// A ring has one producer and one consumer, each in any process: the
+// payloads are plain memory, which rules out the racing loads of
+// queue_mpop(). Use one ring per pair. Linux only.
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdint.h>
+
+struct queue_shm;
+
+// Create a ring of (1 << exp) slots of messages of up to `size` bytes,
+// with exp at most 15. With a name (like "/name") it is a POSIX shared
+// memory object, which must not exist yet; without one it is a memfd.
+// Returns NULL with errno set on failure, and EINVAL if the ring would be
+// too large.
+struct queue_shm *queue_shm_create(const char *name, int exp, uint32_t size);
+
+// Attach to a ring created under `name`, or from the fd of its creator
+// (see queue_shm_fd()), which is duplicated. An attacher that comes in
+// while the creator is still setting the ring up waits for it. Returns
+// NULL with errno set on failure, EINVAL if it is not a ring, and EAGAIN
+// if its creator did not finish setting it up within a second.
+struct queue_shm *queue_shm_attach(const char *name);
+struct queue_shm *queue_shm_attach_fd(int fd);
+
+// The fd of the mapping, to pass to another process.
+int queue_shm_fd(struct queue_shm *s);
+
+// Unmap the ring in this process. The ring lives on while other processes
+// have it mapped, and a named one until it is unlinked.
+void queue_shm_close(struct queue_shm *s);
+
+// Remove the name of a ring. Returns -1 with errno set on failure.
+int queue_shm_unlink(const char *name);
+
+// Return the buffer for the next message to be pushed, of len bytes.
+// Write the message into it, then commit it. Returns NULL if the queue is
+// full, or if len is larger than the slots.
+void *queue_shm_push(struct queue_shm *s, uint32_t len);
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_shm_push_commit(struct queue_shm *s);
+
+// Return the next message to be popped, and its length in *len. Read it,
+// then commit the pop. Returns NULL if the queue is empty.
+const void *queue_shm_pop(struct queue_shm *s, uint32_t *len);
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_shm_pop_commit(struct queue_shm *s);
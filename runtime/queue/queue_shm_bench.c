@@ -0,0 +1,134 @@
+// Cross-process throughput of the shared-memory ring, against a pipe
+//
+//   clang-18 -O3 queue.c queue_shm.c queue_shm_bench.c -lpthread -lrt -o queue_shm_bench
+//
+// A forked child attaches to a named ring and consumes NMSGS messages of
+// each size, which the parent produces; then the same messages go through
+// a pipe, each behind its length. Both sides checksum the first word of
+// every message, and the child reports its sum through a shared page.
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./bench.h"
+#include "./queue_shm.h"
+
+#define NMSGS 1000000
+#define QEXP 10
+#define MAXSIZE 4096
+
+static void fill(unsigned char *buf, uint32_t len, uint64_t n) {
+  memcpy(buf, &n, sizeof(n));
+  memset(buf + sizeof(n), (int)n, len - sizeof(n));
+}
+
+static void read_all(int fd, void *buf, size_t len) {
+  for (size_t got = 0; got < len;) {
+    ssize_t r = read(fd, (char *)buf + got, len - got);
+    if (r <= 0) exit(1);
+    got += r;
+  }
+}
+
+static void write_all(int fd, const void *buf, size_t len) {
+  for (size_t put = 0; put < len;) {
+    ssize_t r = write(fd, (const char *)buf + put, len - put);
+    if (r <= 0) exit(1);
+    put += r;
+  }
+}
+
+static uint64_t consume_ring(const char *name, uint32_t len) {
+  struct queue_shm *s = queue_shm_attach(name);
+  if (!s) exit(1);
+  unsigned char buf[MAXSIZE];
+  uint64_t sum = 0;
+  for (long n = 0; n < NMSGS; n++) {
+    const unsigned char *msg;
+    uint32_t got;
+    int spins = 0;
+    while (!(msg = queue_shm_pop(s, &got))) backoff(&spins);
+    memcpy(buf, msg, got);  // as a consumer would, to get it out of the ring
+    queue_shm_pop_commit(s);
+    uint64_t first;
+    memcpy(&first, buf, sizeof(first));
+    sum += first + (got == len ? 0 : 1);
+  }
+  queue_shm_close(s);
+  return sum;
+}
+
+static uint64_t consume_pipe(int fd, uint32_t len) {
+  unsigned char buf[MAXSIZE];
+  uint64_t sum = 0;
+  for (long n = 0; n < NMSGS; n++) {
+    uint32_t got;
+    read_all(fd, &got, sizeof(got));
+    read_all(fd, buf, got);
+    uint64_t first;
+    memcpy(&first, buf, sizeof(first));
+    sum += first + (got == len ? 0 : 1);
+  }
+  return sum;
+}
+
+static void run(uint32_t len, _Atomic uint64_t *result) {
+  char name[64];
+  snprintf(name, sizeof(name), "/queue_shm_bench.%d", (int)getpid());
+  struct queue_shm *s = queue_shm_create(name, QEXP, MAXSIZE);
+  if (!s) {
+    perror("queue_shm_create");
+    exit(1);
+  }
+  int fds[2];
+  if (pipe(fds)) exit(1);
+
+  uint64_t sum = 0;
+  unsigned char buf[MAXSIZE];
+  double secs[2];
+  for (int via_pipe = 0; via_pipe < 2; via_pipe++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      atomic_store(result, via_pipe ? consume_pipe(fds[0], len) : consume_ring(name, len));
+      _exit(0);
+    }
+    double t0 = now();
+    sum = 0;
+    for (uint64_t n = 1; n <= NMSGS; n++) {
+      if (via_pipe) {
+        fill(buf, len, n);
+        write_all(fds[1], &len, sizeof(len));
+        write_all(fds[1], buf, len);
+      } else {
+        unsigned char *msg;
+        int spins = 0;
+        while (!(msg = queue_shm_push(s, len))) backoff(&spins);
+        fill(msg, len, n);
+        queue_shm_push_commit(s);
+      }
+      sum += n;
+    }
+    waitpid(pid, 0, 0);
+    secs[via_pipe] = now() - t0;
+    if (atomic_load(result) != sum) printf("WRONG SUM\n");
+  }
+  printf("%4u bytes: ring %6.2f M msgs/s %7.1f MB/s   pipe %6.2f M msgs/s %7.1f MB/s\n", len, NMSGS / secs[0] / 1e6,
+         NMSGS * (double)len / secs[0] / 1e6, NMSGS / secs[1] / 1e6, NMSGS * (double)len / secs[1] / 1e6);
+  close(fds[0]);
+  close(fds[1]);
+  queue_shm_close(s);
+  queue_shm_unlink(name);
+}
+
+int main(void) {
+  _Atomic uint64_t *result = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  static const uint32_t sizes[] = {8, 64, 512, 4096};
+  for (int k = 0; k < (int)(sizeof(sizes) / sizeof(*sizes)); k++) run(sizes[k], result);
+}
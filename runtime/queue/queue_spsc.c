@@ -0,0 +1,55 @@
+// A concurrent, generic, bounded single-producer single-consumer queue
+//
+// Head and tail are free-running 32-bit positions, and the queue is full
+// when they are (1 << exp) apart. Each index has a single writer, so the
+// commits are plain release stores rather than read-modify-writes, and the
+// stale copies are safe: the tail copy only lags, so the producer may see
+// the queue full when it is not, and the head copy likewise for empty.
+//
+// This is free and unencumbered software released into the public domain.
+#include "./queue_spsc.h"
+
+// Initialize an empty queue. The array of values must be (1 << exp)
+// elements, with exp at most 31.
+void queue_spsc_init(struct queue_spsc *q) {
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  q->tail_cache = 0;
+  q->head_cache = 0;
+}
+
+// Return the array index for the next value to be pushed. Write the value
+// into this array index, then commit it. The element store need not be
+// atomic. Returns -1 if the queue is full.
+int queue_spsc_push(struct queue_spsc *q, int exp) {
+  uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  if (head - q->tail_cache == 1u << exp) {
+    q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - q->tail_cache == 1u << exp) return -1;
+  }
+  return head & ((1u << exp) - 1);
+}
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_spsc_push_commit(struct queue_spsc *q) {
+  uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+// Return the array index for the next value to be popped. Read from this
+// array index, then commit the pop. The element load need not be atomic.
+// Returns -1 if the queue is empty.
+int queue_spsc_pop(struct queue_spsc *q, int exp) {
+  uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  if (tail == q->head_cache) {
+    q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail == q->head_cache) return -1;
+  }
+  return tail & ((1u << exp) - 1);
+}
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_spsc_pop_commit(struct queue_spsc *q) {
+  uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
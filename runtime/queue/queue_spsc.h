@@ -0,0 +1,41 @@
+// A concurrent, generic, bounded single-producer single-consumer queue
+//
+// Unlike queue.h, where both sides update one shared word, the producer
+// owns the head and the consumer owns the tail, each on its own cache line.
+// Each side also keeps a copy of the other side's index next to its own,
+// and reads the real one only when its copy says the queue is full (or
+// empty). On a busy queue the lines then move between cores about once per
+// lap, not on every push and pop. The usual reserve/commit protocol is the
+// same as in queue.h, but the whole array is usable.
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct queue_spsc {
+  _Alignas(64) _Atomic uint32_t head;  // next position to push
+  uint32_t tail_cache;                 // the producer's copy of tail
+  _Alignas(64) _Atomic uint32_t tail;  // next position to pop
+  uint32_t head_cache;                 // the consumer's copy of head
+};
+
+// Initialize an empty queue. The array of values must be (1 << exp)
+// elements, with exp at most 31.
+void queue_spsc_init(struct queue_spsc *q);
+
+// Return the array index for the next value to be pushed. Write the value
+// into this array index, then commit it. The element store need not be
+// atomic. Returns -1 if the queue is full.
+int queue_spsc_push(struct queue_spsc *q, int exp);
+
+// Commits and completes the push operation. This operation cannot fail.
+void queue_spsc_push_commit(struct queue_spsc *q);
+
+// Return the array index for the next value to be popped. Read from this
+// array index, then commit the pop. The element load need not be atomic.
+// Returns -1 if the queue is empty.
+int queue_spsc_pop(struct queue_spsc *q, int exp);
+
+// Commits and completes the pop operation. This operation cannot fail.
+void queue_spsc_pop_commit(struct queue_spsc *q);
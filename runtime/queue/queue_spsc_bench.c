@@ -0,0 +1,116 @@
+// Throughput of the SPSC queue against the 32-bit queue
+//
+//   clang-18 -O3 queue.c queue_spsc.c queue_spsc_bench.c -lpthread -o queue_spsc_bench
+//
+// One producer pushes NVALS values to one consumer through each queue, at
+// a few capacities. Besides the rate, it reports how often each side read
+// the index owned by the other side, per value and for both sides
+// together, as a proxy for cross-core traffic: the 32-bit queue keeps both
+// indices in one word, so every attempt reads (and every commit writes) the
+// shared line, while the SPSC queue only reads it to refresh its copy.
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+#include "./queue_spsc.h"
+
+#define NVALS 20000000
+
+struct task {
+  bool spsc;
+  int exp;
+  _Atomic uint32_t q32;
+  struct queue_spsc q;
+  uint64_t *slots;
+  uint64_t result;
+  long remote;  // reads of the producer's index by the consumer
+};
+
+static void *consume(void *arg) {
+  struct task *t = arg;
+  uint64_t sum = 0;
+  long remote = 0;
+  for (;;) {
+    int i, spins = 0;
+    uint64_t v;
+    if (t->spsc) {
+      for (;;) {
+        uint32_t seen = t->q.head_cache;
+        i = queue_spsc_pop(&t->q, t->exp);
+        remote += (t->q.head_cache != seen || i < 0);
+        if (i >= 0) break;
+        backoff(&spins);
+      }
+      v = t->slots[i];
+      queue_spsc_pop_commit(&t->q);
+    } else {
+      while (remote++, (i = queue_pop(&t->q32, t->exp)) < 0) backoff(&spins);
+      v = t->slots[i];
+      queue_pop_commit(&t->q32);
+    }
+    if (!v) break;
+    sum += v;
+  }
+  t->result = sum;
+  t->remote = remote;
+  return 0;
+}
+
+// Push v and return the number of reads of the consumer's index
+static long produce(struct task *t, uint64_t v) {
+  int i, spins = 0;
+  long remote = 0;
+  if (t->spsc) {
+    for (;;) {
+      uint32_t seen = t->q.tail_cache;
+      i = queue_spsc_push(&t->q, t->exp);
+      remote += (t->q.tail_cache != seen || i < 0);
+      if (i >= 0) break;
+      backoff(&spins);
+    }
+    t->slots[i] = v;
+    queue_spsc_push_commit(&t->q);
+  } else {
+    while (remote++, (i = queue_push(&t->q32, t->exp)) < 0) backoff(&spins);
+    t->slots[i] = v;
+    queue_push_commit(&t->q32);
+  }
+  return remote;
+}
+
+static void run(bool spsc, int exp) {
+  struct task *t = aligned_alloc(64, sizeof(struct task));
+  *t = (struct task){.spsc = spsc, .exp = exp};
+  queue_spsc_init(&t->q);
+  t->slots = malloc(sizeof(uint64_t) << exp);
+  pthread_t thr;
+  pthread_create(&thr, 0, consume, t);
+  double t0 = now();
+  uint64_t sum = 0;
+  long remote = 0;
+  for (long n = 1; n <= NVALS; n++) {
+    remote += produce(t, n);
+    sum += n;
+  }
+  remote += produce(t, 0);
+  pthread_join(thr, 0);
+  double secs = now() - t0;
+  printf("%-10s exp %2d: %6.1f M values/s, %5.3f remote index reads/value%s\n", (spsc ? "queue_spsc" : "queue"), exp,
+         NVALS / secs / 1e6, (double)(remote + t->remote) / NVALS, (t->result == sum ? "" : "  WRONG SUM"));
+  free(t->slots);
+  free(t);
+}
+
+int main(void) {
+  static const int exps[] = {6, 10, 15};
+  for (int e = 0; e < (int)(sizeof(exps) / sizeof(*exps)); e++) {
+    run(false, exps[e]);
+    run(true, exps[e]);
+  }
+}
@@ -0,0 +1,100 @@
+// Blocking waits for the 32-bit queue
+//
+// A waiter announces itself in its sleeper count, then checks the state
+// once more and sleeps only if it has not changed. The committer changes
+// the state, then reads the count. Both sides use sequentially consistent
+// operations, so either the committer sees the sleeper, or the sleeper sees
+// the new state (in the check, or in FUTEX_WAIT, which returns at once when
+// the word no longer holds the expected value). Sleepers are woken all at
+// once, since consumers and producers share one futex word and the kernel
+// cannot tell them apart.
+//
+// This is free and unencumbered software released into the public domain.
+#include "./queue_wait.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./queue.h"
+
+#define SPINS 64   // failed attempts before yielding
+#define YIELDS 16  // yields before sleeping
+
+static void futex_wait(_Atomic uint32_t *word, uint32_t expect) {
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expect, NULL, NULL, 0);  // EAGAIN and EINTR just retry
+}
+
+static void futex_wake(_Atomic uint32_t *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// After a failed attempt: spin, then yield, then sleep until the state is
+// no longer `seen`
+static void backoff(struct queue_wait *w, _Atomic uint32_t *sleepers, uint32_t seen, int *round) {
+  int n = (*round)++;
+  if (n < SPINS) return;
+  if (n < SPINS + YIELDS) {
+    sched_yield();
+    return;
+  }
+  atomic_fetch_add(sleepers, 1);
+  if (atomic_load(&w->q) == seen) futex_wait(&w->q, seen);
+  atomic_fetch_sub(sleepers, 1);
+}
+
+// The state is loaded before each attempt, so that a sleeper only sleeps
+// if the state it found full (or empty) has not changed since.
+
+// Like queue_push() but waits while the queue is full, so it always
+// returns an array index.
+int queue_push_wait(struct queue_wait *w, int exp) {
+  for (int round = 0;;) {
+    uint32_t seen = atomic_load(&w->q);
+    int i = queue_push(&w->q, exp);
+    if (i >= 0) return i;
+    backoff(w, &w->pushers, seen, &round);
+  }
+}
+
+// Like queue_push_commit(), and wakes the consumers if any sleep.
+void queue_push_wait_commit(struct queue_wait *w) {
+  queue_push_commit(&w->q);
+  if (atomic_load(&w->poppers)) futex_wake(&w->q);
+}
+
+// Like queue_pop() but waits while the queue is empty, so it always returns
+// an array index.
+int queue_pop_wait(struct queue_wait *w, int exp) {
+  for (int round = 0;;) {
+    uint32_t seen = atomic_load(&w->q);
+    int i = queue_pop(&w->q, exp);
+    if (i >= 0) return i;
+    backoff(w, &w->poppers, seen, &round);
+  }
+}
+
+// Like queue_pop_commit(), and wakes the producers if any sleep.
+void queue_pop_wait_commit(struct queue_wait *w) {
+  queue_pop_commit(&w->q);
+  if (atomic_load(&w->pushers)) futex_wake(&w->q);
+}
+
+// Like queue_mpop() but waits while the queue is empty.
+int queue_mpop_wait(struct queue_wait *w, int exp, uint32_t *save) {
+  for (int round = 0;;) {
+    int i = queue_mpop(&w->q, exp, save);
+    if (i >= 0) return i;
+    backoff(w, &w->poppers, *save, &round);
+  }
+}
+
+// Like queue_mpop_commit(), and wakes the producers if any sleep and the
+// commit succeeded.
+_Bool queue_mpop_wait_commit(struct queue_wait *w, uint32_t save) {
+  if (!queue_mpop_commit(&w->q, save)) return 0;
+  if (atomic_load(&w->pushers)) futex_wake(&w->q);
+  return 1;
+}
@@ -0,0 +1,40 @@
+// Blocking waits for the 32-bit queue
+//
+// Wraps the queue.h state so that a consumer facing an empty queue, or a
+// producer facing a full one, spins and yields briefly, then sleeps on a
+// futex on the state word itself until a commit changes it. Each side
+// counts its sleepers, so a commit only pays for the wake syscall when the
+// other side actually sleeps; otherwise the fast path is the queue.h one
+// plus a load from the same cache line. Linux only.
+//
+// This is free and unencumbered software released into the public domain.
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct queue_wait {
+  _Atomic uint32_t q;        // the queue.h state, initially 0
+  _Atomic uint32_t poppers;  // consumers asleep on an empty queue
+  _Atomic uint32_t pushers;  // producers asleep on a full queue
+};
+
+// Like queue_push() but waits while the queue is full, so it always
+// returns an array index.
+int queue_push_wait(struct queue_wait *w, int exp);
+
+// Like queue_push_commit(), and wakes the consumers if any sleep.
+void queue_push_wait_commit(struct queue_wait *w);
+
+// Like queue_pop() but waits while the queue is empty, so it always returns
+// an array index.
+int queue_pop_wait(struct queue_wait *w, int exp);
+
+// Like queue_pop_commit(), and wakes the producers if any sleep.
+void queue_pop_wait_commit(struct queue_wait *w);
+
+// Like queue_mpop() but waits while the queue is empty.
+int queue_mpop_wait(struct queue_wait *w, int exp, uint32_t *save);
+
+// Like queue_mpop_commit(), and wakes the producers if any sleep and the
+// commit succeeded.
+_Bool queue_mpop_wait_commit(struct queue_wait *w, uint32_t save);
@@ -0,0 +1,109 @@
+// Throughput and idle CPU of the blocking waits, against spinning
+//
+//   clang-18 -O3 queue.c queue_wait.c queue_wait_bench.c -lpthread -o queue_wait_bench
+//
+// First one producer pushes NVALS values to one consumer, both spinning on
+// queue.h (with a sched_yield() every SPINS attempts, as the other
+// benchmarks do) or both using queue_wait.h. Then the producer sends only
+// NTICKS values, one every TICK_US microseconds, and the consumer's CPU
+// time is reported as a share of the wall time: a spinning consumer burns
+// its core while it waits, a sleeping one should cost next to nothing.
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "./bench.h"
+#include "./queue.h"
+#include "./queue_wait.h"
+
+#define NVALS 10000000
+#define NTICKS 200
+#define TICK_US 5000
+#define QEXP 10
+
+static double seconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct task {
+  struct queue_wait w;  // the spinning runs use w.q only
+  bool wait;
+  uint64_t slots[1 << QEXP];
+  uint64_t result;
+  double cpu;  // consumer CPU seconds
+};
+
+static void *consume(void *arg) {
+  struct task *t = arg;
+  uint64_t sum = 0;
+  for (;;) {
+    int i, spins = 0;
+    if (t->wait) {
+      i = queue_pop_wait(&t->w, QEXP);
+    } else {
+      while ((i = queue_pop(&t->w.q, QEXP)) < 0) backoff(&spins);
+    }
+    uint64_t v = t->slots[i];
+    if (t->wait) {
+      queue_pop_wait_commit(&t->w);
+    } else {
+      queue_pop_commit(&t->w.q);
+    }
+    if (!v) break;
+    sum += v;
+  }
+  t->result = sum;
+  t->cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+  return 0;
+}
+
+static void produce(struct task *t, uint64_t v) {
+  int i, spins = 0;
+  if (t->wait) {
+    i = queue_push_wait(&t->w, QEXP);
+  } else {
+    while ((i = queue_push(&t->w.q, QEXP)) < 0) backoff(&spins);
+  }
+  t->slots[i] = v;
+  if (t->wait) {
+    queue_push_wait_commit(&t->w);
+  } else {
+    queue_push_commit(&t->w.q);
+  }
+}
+
+static void run(bool wait, long nvals, long tick_us) {
+  static struct task t;
+  t = (struct task){.wait = wait};
+  pthread_t thr;
+  pthread_create(&thr, 0, consume, &t);
+  double t0 = seconds(CLOCK_MONOTONIC);
+  uint64_t sum = 0;
+  for (long n = 1; n <= nvals; n++) {
+    if (tick_us) nanosleep(&(struct timespec){0, tick_us * 1000}, 0);
+    produce(&t, n);
+    sum += n;
+  }
+  produce(&t, 0);
+  pthread_join(thr, 0);
+  double secs = seconds(CLOCK_MONOTONIC) - t0;
+  const char *name = (wait ? "wait" : "spin");
+  const char *check = (t.result == sum ? "" : "  WRONG SUM");
+  if (tick_us) {
+    printf("%s idle:  consumer cpu %5.1f%% of %.2f s%s\n", name, 100 * t.cpu / secs, secs, check);
+  } else {
+    printf("%s busy:  %6.1f M values/s%s\n", name, nvals / secs / 1e6, check);
+  }
+}
+
+int main(void) {
+  run(false, NVALS, 0);
+  run(true, NVALS, 0);
+  run(false, NTICKS, TICK_US);
+  run(true, NTICKS, TICK_US);
+}
@@ -31,6 +31,7 @@ static void hstack_init(hstack* hs) {
 
 static count hstack_topsize(const hstack* hs);
 static void* checked_realloc(void* p, size_t size);
+static void stats_hstack_size(count size);
 
 static count hstack_goodsize(count needed) {
   if (needed > HMAXEXPAND) {
@@ -50,9 +51,7 @@ static void hstack_realloc_(ref hstack* hs, count needed) {
   hs->hframes = (byte*)checked_realloc(hs->hframes, newsize);
   hs->size = newsize;
   hs->top = hstack_at(hs, topsize);
-#ifdef _STATS
-  if (newsize > stats.hstack_max) stats.hstack_max = newsize;
-#endif
+  stats_hstack_size(newsize);
 }
 
 // Ensure the handler stack is big enough for `extracount` handlers.
@@ -43,14 +43,24 @@
 #include <errno.h>
 #include <setjmp.h>  // jmpbuf
 #include <stdarg.h>  // varargs
+#include <limits.h>  // LONG_MAX
+#include <pthread.h>  // pthread_once
 #include <stddef.h>  // ptrdiff_t
 #include <stdint.h>  // intptr_t
 #include <stdio.h>   // fprintf, vfprintf
 #include <stdlib.h>  // exit, malloc
 #include <string.h>  // memcpy
+#include <stdatomic.h>  // atomic_store_explicit
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap
+#include <time.h>       // clock_gettime
+#include <ucontext.h>   // makecontext
+#include <unistd.h>     // ftruncate, getpid
 
 #include "./cenv.h"  // configure generated
 #include "./hstack.h"
+#include "./lzstack.h"
+#include "./metrics.h"
 #include "./types.h"
 
 // maintain cheap statistics
@@ -193,14 +203,14 @@ static __noinline void* get_stack_top() {
   return _stack_address(&top);
 }
 
-// true if the stack grows up
+// true if the stack grows up (set once by `lh_init_globals`)
 static bool stackup = false;
 
-// base of our c stack
-static const void* stackbottom = NULL;
+// base of our c stack (per thread)
+static __thread const void* stackbottom = NULL;
 
 // infer the direction in which the stack grows and the size of a stack frame
-static __noinline void infer_stackdir() {
+static __noinline void infer_stackdir(void) {
   void* mark = _stack_address(&mark);
   void* top = get_stack_top();
   stackup = (mark < top);
@@ -246,7 +256,7 @@ lh_value lh_check_value_ptr(const void* p) {
   Effect and optag names
 -----------------------------------------------------------------*/
 
-static bool op_is_release(lh_handlerdef* op) {
+static bool op_is_release(const lh_handlerdef* op) {
   assert(op != NULL);
   return (op->opkind != LH_OP_NORESUMEX);
 }
@@ -259,37 +269,71 @@ static bool op_is_release(lh_handlerdef* op) {
 #define _DEBUG_STATS
 #endif
 
+// Statistics are counted per thread in `tstats` and only added into the shared
+// `stats` once per metrics period, when the outermost handler returns, and when
+// the statistics are printed or published (see `stats_flush`).
 static struct {
-  long rcont_captured_scoped;
+  _Atomic long rcont_captured_scoped;
+  _Atomic long rcont_captured_resume;
+  _Atomic long rcont_captured_fragment;
+  _Atomic long rcont_captured_empty;
+  _Atomic count rcont_captured_size;
+
+  _Atomic long rcont_resumed_scoped;
+  _Atomic long rcont_resumed_resume;
+  _Atomic long rcont_resumed_fragment;
+  _Atomic long rcont_resumed_tail;
+
+  _Atomic long rcont_released;
+  _Atomic count rcont_released_size;
+
+  _Atomic long rcont_compressed;
+  _Atomic count rcont_compressed_saved;
+  _Atomic long rcont_decompressed;
+
+  _Atomic long operations;
+  _Atomic count hstack_max;
+} stats;
+
+// Statistics of this thread not yet added to `stats`
+static __thread struct {
   long rcont_captured_resume;
   long rcont_captured_fragment;
   long rcont_captured_empty;
   count rcont_captured_size;
 
-  long rcont_resumed_scoped;
   long rcont_resumed_resume;
   long rcont_resumed_fragment;
-  long rcont_resumed_tail;
 
   long rcont_released;
   count rcont_released_size;
 
+  long rcont_compressed;
+  count rcont_compressed_saved;
+  long rcont_decompressed;
+
   long operations;
-  count hstack_max;
-} stats = {
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-};
+  unsigned ticks;  // events since the last flush
+} tstats;
+
+// Count an event in this thread; only in debug builds or while a metrics page is open (see `stats_enabled`)
+#define stats_add(field, n)                   \
+  do {                                        \
+    if (stats_enabled()) tstats.field += (n); \
+  } while (0)
+#define stats_get(field) atomic_load_explicit(&stats.field, memory_order_relaxed)
+
+// Add the statistics of this thread to `stats`
+static void stats_flush();
+
+// Called from `hstack_realloc_` whenever a handler stack grows
+static void stats_hstack_size(count size) {
+#ifdef _STATS
+  count max = stats_get(hstack_max);
+  while (size > max && !atomic_compare_exchange_weak_explicit(&stats.hstack_max, &max, size, memory_order_relaxed, memory_order_relaxed)) {
+  }
+#endif
+}
 
 #ifdef LH_IN_ENCLAVE
 void lh_print_stats(void* h) {
@@ -300,55 +344,232 @@ void lh_print_stats(FILE* h) {
   static const char* line = "--------------------------------------------------------------\n";
 #ifdef _STATS
   if (h == NULL) h = stderr;
+  stats_flush();
   fputs(line, h);
-  long captured = stats.rcont_captured_scoped + stats.rcont_captured_resume + stats.rcont_captured_fragment;
-  long resumed = stats.rcont_resumed_scoped + stats.rcont_resumed_resume + stats.rcont_resumed_fragment + stats.rcont_resumed_tail;
-  if (captured != stats.rcont_released) {
+  long captured = stats_get(rcont_captured_scoped) + stats_get(rcont_captured_resume) + stats_get(rcont_captured_fragment);
+  long resumed = stats_get(rcont_resumed_scoped) + stats_get(rcont_resumed_resume) + stats_get(rcont_resumed_fragment) + stats_get(rcont_resumed_tail);
+#ifdef _DEBUG_STATS
+  if (captured != stats_get(rcont_released)) {
     fputs("libhandler: memory leaked: not all continuations are released!\n", h);
-  } else {
+  } else
+#endif
+  {
     fputs("libhandler statistics:\n", h);
   }
   if (captured > 0) {
     fputs("resume cont:\n", h);
     fprintf(h, "  resumed     :%li\n", resumed);
-    fprintf(h, "    resume    :%6li\n", stats.rcont_resumed_resume);
-    fprintf(h, "    scoped    :%6li\n", stats.rcont_resumed_scoped);
-    fprintf(h, "    fragment  :%6li\n", stats.rcont_resumed_fragment);
+    fprintf(h, "    resume    :%6li\n", stats_get(rcont_resumed_resume));
+    fprintf(h, "    scoped    :%6li\n", stats_get(rcont_resumed_scoped));
+    fprintf(h, "    fragment  :%6li\n", stats_get(rcont_resumed_fragment));
 #ifdef _DEBUG_STATS
-    fprintf(h, "    tail      :%6li\n", stats.rcont_resumed_tail);
+    fprintf(h, "    tail      :%6li\n", stats_get(rcont_resumed_tail));
 #endif
     fprintf(h, "  captured    :%li\n", captured);
-    fprintf(h, "    resume    :%6li\n", stats.rcont_captured_resume);
-    fprintf(h, "    scoped    :%6li\n", stats.rcont_captured_scoped);
-    fprintf(h, "    fragment  :%6li\n", stats.rcont_captured_fragment);
-    fprintf(h, "    empty     :%6li\n", stats.rcont_captured_empty);
-    fprintf(h, "    total size:%6li kb\n", (long)((stats.rcont_captured_size + 1023) / 1024));
-    fprintf(h, "    avg size  :%6li bytes\n", (long)((stats.rcont_captured_size / (captured > 0 ? captured : 1))));
-    if (captured != stats.rcont_released) {
-      fprintf(h, "  released    :%li\n", stats.rcont_released);
-      fprintf(h, "    total size:%6li kb\n", (long)((stats.rcont_released_size + 1023) / 1024));
+    fprintf(h, "    resume    :%6li\n", stats_get(rcont_captured_resume));
+    fprintf(h, "    scoped    :%6li\n", stats_get(rcont_captured_scoped));
+    fprintf(h, "    fragment  :%6li\n", stats_get(rcont_captured_fragment));
+    fprintf(h, "    empty     :%6li\n", stats_get(rcont_captured_empty));
+    fprintf(h, "    total size:%6li kb\n", (long)((stats_get(rcont_captured_size) + 1023) / 1024));
+    fprintf(h, "    avg size  :%6li bytes\n", (long)((stats_get(rcont_captured_size) / (captured > 0 ? captured : 1))));
+    if (captured != stats_get(rcont_released)) {
+      fprintf(h, "  released    :%li\n", stats_get(rcont_released));
+      fprintf(h, "    total size:%6li kb\n", (long)((stats_get(rcont_released_size) + 1023) / 1024));
+    }
+    if (stats_get(rcont_compressed) > 0) {
+      fprintf(h, "  compressed  :%li\n", stats_get(rcont_compressed));
+      fprintf(h, "    saved     :%6li kb\n", (long)((stats_get(rcont_compressed_saved) + 1023) / 1024));
+      fprintf(h, "    restored  :%6li\n", stats_get(rcont_decompressed));
     }
-    fprintf(h, "  hstack max  :%li kb\n", (long)(stats.hstack_max + 1023) / 1024);
+    fprintf(h, "  hstack max  :%li kb\n", (long)(stats_get(hstack_max) + 1023) / 1024);
   }
 #ifdef _DEBUG_STATS
   fputs("operations:\n", h);
-  fprintf(h, "  total       :%6li\n", stats.operations);
+  fprintf(h, "  total       :%6li\n", stats_get(operations));
 #endif
   fputs(line, h);
 #endif
 }
 #endif
 
+/*-----------------------------------------------------------------
+   Shared-memory metrics page
+   Counters are copied from `stats` into the mapped page under a
+   seqlock. Publishing is rate limited to once every `metrics_period`
+   statistics events of a thread so the hot paths only pay a thread
+   local counter increment.
+-----------------------------------------------------------------*/
+#ifdef _STATS
+
+#define METRICS_DEFAULT_PERIOD 1024
+
+static _Atomic(lh_metrics_page*) metrics = NULL;
+static unsigned metrics_mask = METRICS_DEFAULT_PERIOD - 1;  // written before `metrics` is set
+
+static struct {
+  _Atomic uint32_t* q;
+  uint32_t mask;
+} metrics_queues[LH_METRICS_MAX_QUEUES];
+
+static uint64_t metrics_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+static void metrics_store(_Atomic uint64_t* field, uint64_t value) {
+  atomic_store_explicit(field, value, memory_order_relaxed);
+}
+
+static void metrics_publish_(lh_metrics_page* m) {
+  // take the write side of the seqlock; skip if another thread is publishing
+  uint64_t seq = atomic_load_explicit(&m->seq, memory_order_relaxed);
+  if ((seq & 1) != 0 || !atomic_compare_exchange_strong_explicit(&m->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed)) {
+    return;
+  }
+  atomic_thread_fence(memory_order_release);
+  metrics_store(&m->timestamp_ns, metrics_now_ns());
+  metrics_store(&m->operations, (uint64_t)stats_get(operations));
+  metrics_store(&m->captured, (uint64_t)(stats_get(rcont_captured_scoped) + stats_get(rcont_captured_resume) + stats_get(rcont_captured_fragment)));
+  metrics_store(&m->resumed, (uint64_t)(stats_get(rcont_resumed_scoped) + stats_get(rcont_resumed_resume) + stats_get(rcont_resumed_fragment) + stats_get(rcont_resumed_tail)));
+  metrics_store(&m->released, (uint64_t)stats_get(rcont_released));
+  metrics_store(&m->captured_bytes, (uint64_t)stats_get(rcont_captured_size));
+  metrics_store(&m->hstack_max, (uint64_t)stats_get(hstack_max));
+  uint32_t nqueues = atomic_load_explicit(&m->queue_count, memory_order_acquire);
+  for (uint32_t i = 0; i < nqueues; i++) {
+    uint32_t r = atomic_load_explicit(metrics_queues[i].q, memory_order_relaxed);
+    uint32_t mask = metrics_queues[i].mask;
+    metrics_store(&m->queues[i].depth, ((r & mask) - (r >> 16 & mask)) & mask);
+  }
+  metrics_store(&m->publishes, atomic_load_explicit(&m->publishes, memory_order_relaxed) + 1);
+  atomic_store_explicit(&m->seq, seq + 2, memory_order_release);
+}
+
+// True if statistics should be counted
+static bool stats_enabled() {
+#ifdef _DEBUG_STATS
+  return true;
+#else
+  return (atomic_load_explicit(&metrics, memory_order_relaxed) != NULL);
+#endif
+}
+
+#define stats_fold(field)                                                          \
+  do {                                                                             \
+    if (tstats.field != 0) {                                                       \
+      atomic_fetch_add_explicit(&stats.field, tstats.field, memory_order_relaxed); \
+      tstats.field = 0;                                                            \
+    }                                                                              \
+  } while (0)
+
+static void stats_flush() {
+  stats_fold(rcont_captured_resume);
+  stats_fold(rcont_captured_fragment);
+  stats_fold(rcont_captured_empty);
+  stats_fold(rcont_captured_size);
+  stats_fold(rcont_resumed_resume);
+  stats_fold(rcont_resumed_fragment);
+  stats_fold(rcont_released);
+  stats_fold(rcont_released_size);
+  stats_fold(rcont_compressed);
+  stats_fold(rcont_compressed_saved);
+  stats_fold(rcont_decompressed);
+  stats_fold(operations);
+  tstats.ticks = 0;
+}
+
+// Called after every statistics event; adds them to `stats` and publishes once per period.
+static void stats_tick() {
+  if (stats_enabled() && ++tstats.ticks > metrics_mask) {
+    stats_flush();
+    lh_metrics_page* m = atomic_load_explicit(&metrics, memory_order_acquire);
+    if (m != NULL) metrics_publish_(m);
+  }
+}
+
+int lh_metrics_open(const char* path, unsigned period) {
+  if (atomic_load(&metrics) != NULL) return EBUSY;
+  unsigned p = 1;
+  if (period == 0) period = METRICS_DEFAULT_PERIOD;
+  while (p < period) p *= 2;
+  metrics_mask = p - 1;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return errno;
+  if (ftruncate(fd, sizeof(lh_metrics_page)) != 0) {
+    int err = errno;
+    close(fd);
+    return err;
+  }
+  void* page = mmap(NULL, sizeof(lh_metrics_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);  // the mapping keeps the file alive
+  if (page == MAP_FAILED) return errno;
+
+  lh_metrics_page* m = (lh_metrics_page*)page;
+  memset(m, 0, sizeof(lh_metrics_page));
+  m->version = LH_METRICS_VERSION;
+  m->size = sizeof(lh_metrics_page);
+  m->pid = (uint32_t)getpid();
+  metrics_publish_(m);
+  // the magic is written last so readers never see a half initialized page
+  atomic_thread_fence(memory_order_release);
+  m->magic = LH_METRICS_MAGIC;
+  lh_metrics_page* expected = NULL;
+  if (!atomic_compare_exchange_strong(&metrics, &expected, m)) {
+    munmap(m, sizeof(lh_metrics_page));
+    return EBUSY;
+  }
+  return 0;
+}
+
+void lh_metrics_close() {
+  lh_metrics_page* m = atomic_exchange(&metrics, NULL);
+  if (m == NULL) return;
+  stats_flush();
+  metrics_publish_(m);
+  munmap(m, sizeof(lh_metrics_page));
+}
+
+void lh_metrics_publish() {
+  lh_metrics_page* m = atomic_load_explicit(&metrics, memory_order_acquire);
+  if (m == NULL) return;
+  stats_flush();
+  metrics_publish_(m);
+}
+
+int lh_metrics_register_queue(const char* name, _Atomic uint32_t* q, int exp) {
+  lh_metrics_page* m = atomic_load_explicit(&metrics, memory_order_acquire);
+  if (m == NULL) return -1;
+  uint32_t i = atomic_load_explicit(&m->queue_count, memory_order_relaxed);
+  if (i >= LH_METRICS_MAX_QUEUES) return -1;
+  metrics_queues[i].q = q;
+  metrics_queues[i].mask = (1u << exp) - 1;
+  strncpy(m->queues[i].name, name, LH_METRICS_QUEUE_NAME - 1);
+  atomic_store_explicit(&m->queue_count, i + 1, memory_order_release);
+  return (int)i;
+}
+
+#else
+static void stats_tick() {}
+static void stats_flush() {}
+int lh_metrics_open(const char* path, unsigned period) { return ENOTSUP; }
+void lh_metrics_close() {}
+void lh_metrics_publish() {}
+int lh_metrics_register_queue(const char* name, _Atomic uint32_t* q, int exp) { return -1; }
+#endif
+
 #ifdef LH_IN_ENCLAVE
 void lh_check_memory(void* h) {
   /* void */
 }
 #else
 // Check if all continuations were released. If not, print out statistics.
+// Only in debug builds, as release builds count only while a metrics page is open.
 void lh_check_memory(FILE* h) {
-#ifdef _STATS
-  count captured = stats.rcont_captured_scoped + stats.rcont_captured_resume + stats.rcont_captured_fragment;
-  if (captured != stats.rcont_released) {
+#ifdef _DEBUG_STATS
+  stats_flush();
+  count captured = stats_get(rcont_captured_scoped) + stats_get(rcont_captured_resume) + stats_get(rcont_captured_fragment);
+  if (captured != stats_get(rcont_released)) {
     lh_print_stats(h);
   }
 #endif
@@ -363,6 +584,7 @@ static void cstack_init(ref cstack* cs) {
   cs->base = NULL;
   cs->size = 0;
   cs->frames = NULL;
+  cs->zsize = 0;
 }
 
 static void cstack_free(ref cstack* cs) {
@@ -401,8 +623,8 @@ static ptrdiff_t ptrdiff(const void* p, const void* q) {
 // release a continuation; returns `true` if it was released
 static __noinline void fragment_free_(fragment* f) {
 #ifdef _STATS
-  stats.rcont_released++;
-  stats.rcont_released_size += (long)f->cstack.size;
+  stats_add(rcont_released, 1);
+  stats_add(rcont_released_size, (long)f->cstack.size);
 #endif
   cstack_free(&f->cstack);
   checked_free(f);
@@ -444,14 +666,21 @@ static fragment* fragment_acquire(fragment* f) {
 -----------------------------------------------------------------*/
 // Forward
 static void hstack_free(ref hstack* hs, bool do_release);
+static handler* hstack_bottom(const hstack* hs);
+static bool is_effecthandler(const handler* h);
+static void* effecthandler_local(effecthandler* h, count idx);
+
+static void resume_unpark(resume* r);
 
 // release a resumptions; returns `true` if it was released
 static __noinline void _resume_free(resume* r) {
   assert(r->refcount == -1);
 #ifdef _STATS
-  stats.rcont_released++;
-  stats.rcont_released_size += (long)r->cstack.size + (long)r->hstack.size;
+  stats_add(rcont_released, 1);
+  stats_add(rcont_released_size, (long)r->cstack.size + (long)r->hstack.size);
+  stats_tick();
 #endif
+  resume_unpark(r);
   cstack_free(&r->cstack);
   hstack_free(&r->hstack, true);
   checked_free(r);
@@ -490,6 +719,169 @@ static resume* resume_acquire(resume* r) {
   return r;
 }
 
+/*-----------------------------------------------------------------
+  Parked resumptions
+  While compression is enabled for them (an idle threshold is set, or
+  their policy is eager), general resumptions are linked in the list of
+  the thread that captured them until they are freed. `lh_compress_idle`
+  walks the list and compresses the captured stacks of the ones that
+  are idle for longer than the threshold; `jumpto_resume` decompresses
+  them again. The list is not locked, so linked resumptions must be
+  released on the thread that captured them.
+-----------------------------------------------------------------*/
+
+static unsigned long compress_threshold_ms = 0;
+
+// thread local list of parked general resumptions
+static __thread resume* __parked = NULL;
+
+static uint64_t parked_now_ns() {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);  // resolution of a few ms is plenty
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+// Mark a resumption as idle from now on.
+static void resume_idle(resume* r) {
+  if (compress_threshold_ms > 0) r->idle_since = parked_now_ns();
+}
+
+// Should `lh_compress_idle` consider this resumption?
+static bool resume_compressible(const resume* r) {
+  return (r->lhresume.rkind == GeneralResume &&
+          (r->compress == LH_COMPRESS_EAGER || (r->compress == LH_COMPRESS_IDLE && compress_threshold_ms > 0)));
+}
+
+static void resume_park(resume* r) {
+  r->parked = &__parked;
+  r->parked_prev = NULL;
+  r->parked_next = __parked;
+  if (__parked != NULL) __parked->parked_prev = r;
+  __parked = r;
+  resume_idle(r);
+}
+
+// Unlink from the list of the capturing thread, which is not necessarily the current one.
+static void resume_unpark(resume* r) {
+  if (r->parked == NULL) return;
+  if (r->parked_prev != NULL) {
+    r->parked_prev->parked_next = r->parked_next;
+  } else {
+    assert(*r->parked == r);
+    *r->parked = r->parked_next;
+  }
+  if (r->parked_next != NULL) r->parked_next->parked_prev = r->parked_prev;
+  r->parked = NULL;
+  r->parked_prev = r->parked_next = NULL;
+}
+
+// Decompress a captured stack into `frames` of `cs->size` bytes.
+static void cstack_inflate_into(const cstack* cs, byte* frames) {
+  if (!lz_decompress(cs->frames, cs->zsize, frames, cs->size)) {
+    fatal(EFAULT, "Corrupted compressed stack in a resumption");
+  }
+#ifdef _STATS
+  stats_add(rcont_decompressed, 1);
+#endif
+}
+
+// Decompress the captured stack of a resumption if needed.
+static void resume_inflate(resume* r) {
+  if (r->cstack.zsize == 0) return;
+  byte* frames = (byte*)checked_malloc(r->cstack.size);
+  cstack_inflate_into(&r->cstack, frames);
+  checked_free(r->cstack.frames);
+  r->cstack.frames = frames;
+  r->cstack.zsize = 0;
+}
+
+// Point `lhresume.local` at the inline state in the captured handler stack, or `NULL` once it is gone.
+static void resume_set_local(resume* r) {
+  if (r->hstack.hframes == NULL) {
+    r->lhresume.local = NULL;
+  } else {
+    effecthandler* h = (effecthandler*)hstack_bottom(&r->hstack);
+    assert(is_effecthandler(to_handler(h)));
+    r->lhresume.local = effecthandler_local(h, h->first);
+  }
+}
+
+// Shrink the captured handler stack of a resumption to fit; it is allocated with room to grow.
+static count resume_compact(resume* r) {
+  hstack* hs = &r->hstack;
+  count saved = hs->size - hs->count;
+  if (saved <= 0 || hs->count == 0) return 0;
+  count top = ptrdiff(hs->top, hs->hframes);
+  hs->hframes = (byte*)checked_realloc(hs->hframes, hs->count);
+  hs->size = hs->count;
+  hs->top = (handler*)(hs->hframes + top);
+  resume_set_local(r);  // the frames may have moved
+  return saved;
+}
+
+// Compress the captured stack of a resumption using `scratch` of at least `lz_bound(r->cstack.size)` bytes.
+// Returns the number of bytes saved.
+static count resume_deflate(resume* r, byte* scratch) {
+  count size = r->cstack.size;
+  count zsize = lz_compress(r->cstack.frames, size, scratch);
+  if (zsize > size - size / 8) {
+    r->incompressible = true;  // the captured stack never changes so there is no need to try again
+    return 0;
+  }
+  byte* frames = (byte*)checked_malloc(zsize);
+  memcpy(frames, scratch, zsize);
+  checked_free(r->cstack.frames);
+  r->cstack.frames = frames;
+  r->cstack.zsize = zsize;
+#ifdef _STATS
+  stats_add(rcont_compressed, 1);
+  stats_add(rcont_compressed_saved, size - zsize);
+#endif
+  return size - zsize;
+}
+
+void lh_compress_threshold(unsigned long idle_ms) {
+  compress_threshold_ms = idle_ms;
+}
+
+void lh_resume_compress(lh_resume r, lh_compress_policy policy) {
+  if (r->rkind == TailResume) return;
+  resume* rc = (resume*)r;
+  rc->compress = (byte)policy;
+  if (!resume_compressible(rc)) {
+    resume_unpark(rc);
+  } else if (rc->parked == NULL) {
+    resume_park(rc);
+  }
+}
+
+size_t lh_compress_idle() {
+  uint64_t now = (compress_threshold_ms > 0 ? parked_now_ns() : 0);
+  uint64_t idle_ns = (uint64_t)compress_threshold_ms * 1000000u;
+  byte* scratch = NULL;
+  count scratch_size = 0;
+  size_t saved = 0;
+  for (resume* r = __parked; r != NULL; r = r->parked_next) {
+    if (r->cstack.zsize != 0 || r->incompressible || r->cstack.frames == NULL) continue;
+    if (r->compress == LH_COMPRESS_NEVER) continue;
+    if (r->compress == LH_COMPRESS_IDLE && (compress_threshold_ms == 0 || now - r->idle_since < idle_ns)) continue;
+    count needed = lz_bound(r->cstack.size);
+    if (needed > scratch_size) {
+      if (scratch != NULL) checked_free(scratch);
+      scratch = (byte*)checked_malloc(needed);
+      scratch_size = needed;
+    }
+    saved += resume_compact(r);
+    saved += resume_deflate(r, scratch);
+  }
+  if (scratch != NULL) checked_free(scratch);
+  return saved;
+}
+
 /*-----------------------------------------------------------------
   Handler
 -----------------------------------------------------------------*/
@@ -510,18 +902,62 @@ static bool is_scopedhandler(const handler* h) {
 static bool is_effecthandler(const handler* h) {
   return (!is_skiphandler(h) && !is_fragmenthandler(h) && !is_scopedhandler(h));
 }
-static count handler_size(const lh_effect effect) {
-  if (effect == LH_EFFECT(__skip))
+static count handler_size(const handler* h) {
+  if (is_skiphandler(h))
     return sizeof(skiphandler);
-  else if (effect == LH_EFFECT(__fragment))
+  else if (is_fragmenthandler(h))
     return sizeof(fragmenthandler);
-  else if (effect == LH_EFFECT(__scoped))
+  else if (is_scopedhandler(h))
     return sizeof(scopedhandler);
   else
-    return sizeof(effecthandler);
+    return sizeof(effecthandler) + ((const effecthandler*)h)->localsize;
 }
 #endif
 
+/*-----------------------------------------------------------------
+  Inline handler state
+  Every definition handled by an effect handler frame has its own
+  block of `localsize` bytes right after the frame; since the frames
+  are copied with `memcpy` the state is copied along with them, and
+  the `localcopy` and `localrelease` functions of the definitions are
+  only called when registered.
+-----------------------------------------------------------------*/
+
+static count local_size(const lh_handlerdef* def) {
+  return (count)((def->localsize + LH_LOCAL_ALIGN - 1) & ~(LH_LOCAL_ALIGN - 1));
+}
+
+// Total inline state size for `ndefs` definitions
+static count locals_size(const lh_handlerdef* defs, count ndefs) {
+  count size = 0;
+  for (count i = 0; i < ndefs; i++) size += local_size(&defs[i]);
+  return size;
+}
+
+// The inline state of definition `idx` in effect handler `h`, or `NULL` if it has none
+static void* effecthandler_local(effecthandler* h, count idx) {
+  if (h->hdef[idx].localsize == 0) return NULL;
+  byte* local = (byte*)h + sizeof(effecthandler);
+  for (count i = 0; i < idx; i++) local += local_size(&h->hdef[i]);
+  return local;
+}
+
+// Release the inline state of definitions `from` up to `to`
+static void effecthandler_release(effecthandler* h, count from, count to) {
+  if (h->localsize == 0) return;
+  for (count i = from; i < to; i++) {
+    if (h->hdef[i].localrelease != NULL) h->hdef[i].localrelease(effecthandler_local(h, i));
+  }
+}
+
+// Fix up a byte-wise copy of the inline state of the handled definitions
+static void effecthandler_acquire(effecthandler* h) {
+  if (h->localsize == 0) return;
+  for (count i = h->first; i < h->ndefs; i++) {
+    if (h->hdef[i].localcopy != NULL) h->hdef[i].localcopy(effecthandler_local(h, i));
+  }
+}
+
 // Return the handler below on the stack
 static handler* _handler_prev(const handler* h) {
   assert(h->prev >= 0);  // may be equal to zero, in which case the same handler is returned! (bottom frame)
@@ -543,7 +979,8 @@ static void handler_release(handler* h) {
     /* nothing */
   } else {
     assert(is_effecthandler(h));
-    /* nothing */
+    effecthandler* eh = (effecthandler*)h;
+    effecthandler_release(eh, eh->first, eh->ndefs);
   }
 }
 
@@ -557,7 +994,7 @@ static handler* handler_acquire(handler* h) {
     /* nothing */
   } else {
     assert(is_effecthandler(h));
-    /* nothing */
+    effecthandler_acquire((effecthandler*)h);
   }
   return h;
 }
@@ -588,7 +1025,7 @@ static bool hstack_contains(const hstack* hs, const handler* h) {
 
 static bool valid_handler(const hstack* hs, const handler* h) {
   return (h != NULL && hstack_contains(hs, h) &&
-          (h->prev == 0 || h->prev == handler_size(_handler_prev(h)->effect)));
+          (h->prev == 0 || h->prev == handler_size(_handler_prev(h))));
 }
 
 static bool hstack_follows(const hstack* hs, const handler* h, const handler* g) {
@@ -676,7 +1113,7 @@ static fragment* hstack_pop_fragment(hstack* hs) {
 
 // Push a new uninitialized handler frame and return a reference to it.
 static handler* _hstack_push(ref hstack* hs, lh_effect effect, count size) {
-  assert(size == handler_size(effect));
+  assert(size >= (count)sizeof(struct _handler));
   handler* h = hstack_ensure_space(hs, size);
   h->effect = effect;
   h->prev = ptrdiff(h, hs->top);
@@ -686,12 +1123,43 @@ static handler* _hstack_push(ref hstack* hs, lh_effect effect, count size) {
   return h;
 }
 
-// Push an effect handler
-static effecthandler* hstack_push_effect(ref hstack* hs, const lh_handlerdef* hdef, void* stackbase) {
-  static count id = 1000;
-  effecthandler* h = (effecthandler*)_hstack_push(hs, hdef->effect, sizeof(effecthandler));
-  h->id = id++;
+// Handler ids are taken from per-thread blocks so they are unique across threads
+#define HANDLER_ID_BLOCK 1024
+static _Atomic count handler_id_blocks = 1000;
+static __thread count handler_id_next = 0;
+static __thread count handler_id_end = 0;
+
+static count handler_id() {
+  if (handler_id_next == handler_id_end) {
+    handler_id_next = atomic_fetch_add_explicit(&handler_id_blocks, HANDLER_ID_BLOCK, memory_order_relaxed);
+    handler_id_end = handler_id_next + HANDLER_ID_BLOCK;
+  }
+  return handler_id_next++;
+}
+
+// Push an effect handler for the `ndefs` handler definitions in `hdef`.
+// The inline state of `hdef[i]` is initialized from `locals[i]`, or zeroed if that is `NULL`.
+// (`locals` may point into the handler stack just above the current top; they are moved into place.)
+static effecthandler* hstack_push_effect(ref hstack* hs, const lh_handlerdef* hdef, count ndefs, void* stackbase, const void* const* locals) {
+  assert(ndefs >= 1);
+  count localsize = (ndefs == 1 ? local_size(hdef) : locals_size(hdef, ndefs));
+  effecthandler* h = (effecthandler*)_hstack_push(hs, (ndefs == 1 ? hdef->effect : LH_EFFECT(__many)), sizeof(effecthandler) + localsize);
+  h->id = handler_id();
   h->hdef = hdef;
+  h->first = 0;
+  h->ndefs = ndefs;
+  h->localsize = localsize;
+  if (localsize > 0) {
+    byte* local = (byte*)h + sizeof(effecthandler);
+    for (count i = 0; i < ndefs; i++) {
+      if (locals != NULL && locals[i] != NULL) {
+        memmove(local, locals[i], hdef[i].localsize);
+      } else {
+        memset(local, 0, hdef[i].localsize);
+      }
+      local += local_size(&hdef[i]);
+    }
+  }
   h->stackbase = stackbase;
   h->arg = lh_value_null;
   h->arg_op = NULL;
@@ -699,10 +1167,11 @@ static effecthandler* hstack_push_effect(ref hstack* hs, const lh_handlerdef* hd
   return h;
 }
 
-// Push a skip handler
-static skiphandler* hstack_push_skip(ref hstack* hs, count toskip) {
+// Push a skip handler; definitions below `visible` in the skipped-to handler remain visible
+static skiphandler* hstack_push_skip(ref hstack* hs, count toskip, count visible) {
   skiphandler* h = (skiphandler*)_hstack_push(hs, LH_EFFECT(__skip), sizeof(skiphandler));
   h->toskip = toskip;
+  h->visible = visible;
   return h;
 }
 
@@ -748,23 +1217,46 @@ static handler* hstack_append_copyfrom(ref hstack* hs, ref hstack* tocopy, handl
   return bot;
 }
 
+// Find the definition for `optag` among the first `visible` definitions an effect handler handles.
+// Inner definitions shadow outer ones, just like nested handlers.
+static const lh_handlerdef* effecthandler_find(const effecthandler* eh, lh_effect optag, count visible) {
+  for (count i = visible - 1; i >= eh->first; i--) {
+    if (eh->hdef[i].effect == optag) return &eh->hdef[i];
+  }
+  return NULL;
+}
+
 // Find an operation that handles `optag` in the handler stack.
-static effecthandler* hstack_find(ref hstack* hs, lh_effect optag, out lh_handlerdef** op, out count* skipped) {
+static effecthandler* hstack_find(ref hstack* hs, lh_effect optag, out const lh_handlerdef** op, out count* skipped) {
   if (!hstack_empty(hs)) {
     handler* h = hstack_top(hs);
+    count visible = -1;  // set when skipping into a handler; -1 if all its definitions are visible
     do {
       assert(valid_handler(hs, h));
-      if (h->effect == optag) {
+      if (is_skiphandler(h)) {
+        visible = ((skiphandler*)h)->visible;
+        h = hstack_prev_skip(hs, (skiphandler*)h);
+        continue;
+      }
+      if (h->effect == optag && visible < 0) {
+        // single effect handler
         effecthandler* eh = (effecthandler*)h;
-        assert(eh->hdef != NULL);
-        lh_handlerdef* hdef = &eh->hdef;
+        assert(eh->hdef != NULL && eh->ndefs == 1);
         *skipped = hstack_indexof(hs, h);
         assert(*skipped > 0);
-        *op = hdef;
+        *op = eh->hdef;
         return eh;
-      } else if (is_skiphandler(h)) {
-        h = hstack_prev_skip(hs, (skiphandler*)h);
+      } else if (h->effect == optag || h->effect == LH_EFFECT(__many)) {
+        effecthandler* eh = (effecthandler*)h;
+        const lh_handlerdef* hdef = effecthandler_find(eh, optag, (visible < 0 ? eh->ndefs : visible));
+        if (hdef != NULL) {
+          *skipped = hstack_indexof(hs, h);
+          assert(*skipped > 0);
+          *op = hdef;
+          return eh;
+        }
       }
+      visible = -1;
       h = hstack_prev(hs, h);
     } while (h != NULL);
   }
@@ -886,15 +1378,17 @@ static void hstack_pop_upto(ref hstack* hs, ref handler* h, bool do_release, out
   Initialize globals
 -----------------------------------------------------------------*/
 
-static bool initialized = false;
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+
+// Initialize the process wide globals; safe to call from any thread.
+static void lh_init_globals() {
+  pthread_once(&initialized, &infer_stackdir);
+}
 
 static __noinline bool _lh_init(hstack* hs) {
-  if (!initialized) {
-    initialized = true;
-    infer_stackdir();
-  }
+  lh_init_globals();
   stackbottom = get_stack_top();  // in debug mode we use this to check if operation arguments are not passed on the stack
-  assert(__hstack.size == 0 && hs == &__hstack);
+  assert(hs->size == 0);
   hstack_init(hs);
   return true;
 }
@@ -907,8 +1401,9 @@ static bool lh_init(hstack* hs) {
 }
 
 static __noinline void lh_done(hstack* hs) {
-  assert(hs == &__hstack && hs->size > 0 && hs->count == 0 && (byte*)hs->top == &hs->hframes[0]);
+  assert(hs->size > 0 && hs->count == 0 && (byte*)hs->top == &hs->hframes[0]);
   hstack_free(hs, true);
+  stats_flush();  // the outermost handler returned; add the remaining statistics of this thread
 }
 
 #define LH_INIT(hs) \
@@ -928,11 +1423,15 @@ static __noinline void lh_done(hstack* hs) {
 // variables will remain in-tact. The `no_opt` parameter is there so
 // smart compilers (i.e. clang) will not optimize away the `alloca` in `jumpto`.
 static __noinline __noreturn void _jumpto_stack(
-    byte* cframes, ptrdiff_t size, byte* base,
+    const cstack* cs, byte* cframes, ptrdiff_t size, byte* base,
     lh_jmp_buf* entry, bool freecframes, byte* no_opt) {
   if (no_opt != NULL) no_opt[0] = 0;
   // copy the saved stack onto our stack
-  memcpy(base, cframes, size);  // this will not overwrite our stack frame
+  if (cs->zsize != 0) {
+    cstack_inflate_into(cs, base);  // decompress in place; this will not overwrite our stack frame either
+  } else {
+    memcpy(base, cframes, size);  // this will not overwrite our stack frame
+  }
   if (freecframes) {
     free(cframes);
   }  // should be fine to call `free` (assuming it will not mess with the stack above its frame)
@@ -968,7 +1467,7 @@ static __noinline __noreturn void jumpto(
       no_opt = (byte*)lh_alloca(extra);  // allocate room on the stack; in here the new stack will get copied.
     }
 
-    _jumpto_stack(cs->frames, cs->size, (byte*)cstack_base(cs),
+    _jumpto_stack(cs, cs->frames, cs->size, (byte*)cstack_base(cs),
                   entry, freecframes, no_opt);
   }
 }
@@ -982,18 +1481,21 @@ static __noinline __noreturn void jumpto_fragment(fragment* f, lh_value res) {
 
 // jump to a resumption
 static __noinline __noreturn void jumpto_resume(resume* r, lh_value arg) {
-  // first restore the hstack and set the new local
+  if (r->refcount != 1) resume_inflate(r);  // resumed more than once; otherwise `jumpto` decompresses in place
+  resume_idle(r);
+  // first restore the hstack of its context and set the new local
   handler* h = hstack_bottom(&r->hstack);
   assert(is_effecthandler(h));
   if (r->refcount == 1) {
-    h = hstack_append_movefrom(&__hstack, &r->hstack, hstack_bottom(&r->hstack));
+    h = hstack_append_movefrom(r->hs, &r->hstack, hstack_bottom(&r->hstack));
     hstack_free(&r->hstack, false /* no release */);  // zero out the hstack in the resume since we moved it
+    r->lhresume.local = NULL;
   } else {
-    h = hstack_append_copyfrom(&__hstack, &r->hstack, hstack_bottom(&r->hstack));  // does not acquire h
+    h = hstack_append_copyfrom(r->hs, &r->hstack, hstack_bottom(&r->hstack));  // does not acquire h
   }
   assert(is_effecthandler(h));
-  if (r->refcount == 1) {
-    handler_acquire(h);  // acquire now that the new local is in there (as it may alias the original)
+  if (r->refcount != 1) {
+    handler_acquire(h);  // the copy does not acquire the bottom frame; its inline state is still shared with the resumption
   }
   // and then restore the cstack and jump
   r->arg = arg;      // set the argument in the cont slot
@@ -1020,6 +1522,7 @@ static void capture_cstack(cstack* cs, const void* bottom, const void* top) {
     cs->frames = (byte*)checked_malloc(size);
     memcpy(cs->frames, cs->base, size);
   }
+  cs->zsize = 0;
 }
 
 // Capture part of a handler stack (includeing h).
@@ -1039,7 +1542,7 @@ static void capture_hstack(hstack* hs, hstack* to, effecthandler* h, bool copy)
 
 // Return to a handler by unwinding the handler stack.
 static void __noinline __noreturn yield_to_handler(hstack* hs, effecthandler* h,
-                                                   resume* resume, lh_handlerdef* op, lh_value oparg, bool do_release) {
+                                                   resume* resume, const lh_handlerdef* op, lh_value oparg, bool do_release) {
   cstack cs;
   cstack_init(&cs);
   hstack_pop_upto(hs, to_handler(h), do_release, &cs);
@@ -1062,7 +1565,7 @@ static __noinline lh_value capture_resume_call(hstack* hs, resume* r, lh_value r
   f->res = lh_value_null;
 
 #ifdef _STATS
-  stats.rcont_captured_fragment++;
+  stats_add(rcont_captured_fragment, 1);
 #endif
   // and set our jump point
   if (_lh_setjmp(f->entry) != 0) {
@@ -1070,7 +1573,8 @@ static __noinline lh_value capture_resume_call(hstack* hs, resume* r, lh_value r
     lh_value res = f->res;  // get result
 
 #ifdef _STATS
-    stats.rcont_resumed_fragment++;
+    stats_add(rcont_resumed_fragment, 1);
+    stats_tick();
 #endif
     // release our fragment
     fragment_release(f);
@@ -1082,8 +1586,9 @@ static __noinline lh_value capture_resume_call(hstack* hs, resume* r, lh_value r
     void* top = get_stack_top();
     capture_cstack(&f->cstack, cstack_bottom(&r->cstack), top);
 #ifdef _STATS
-    if (f->cstack.frames == NULL) stats.rcont_captured_empty++;
-    stats.rcont_captured_size += (long)f->cstack.size;
+    if (f->cstack.frames == NULL) stats_add(rcont_captured_empty, 1);
+    stats_add(rcont_captured_size, (long)f->cstack.size);
+    stats_tick();
 #endif
     // push a special "fragment" frame to remember to restore the stack when yielding to a handler across non-scoped resumes
     hstack_push_fragment(hs, f);
@@ -1093,23 +1598,32 @@ static __noinline lh_value capture_resume_call(hstack* hs, resume* r, lh_value r
 }
 
 // Capture a first-class resumption and yield to the handler.
-static __noinline lh_value capture_resume_yield(hstack* hs, effecthandler* h, lh_handlerdef* op, lh_value oparg) {
+static __noinline lh_value capture_resume_yield(hstack* hs, effecthandler* h, const lh_handlerdef* op, lh_value oparg) {
   // initialize continuation
   resume* r = (resume*)checked_malloc(sizeof(resume));
   r->lhresume.rkind = (op->opkind <= LH_OP_SCOPED ? ScopedResume : GeneralResume);
+  r->lhresume.local = NULL;  // set once the handler stack is captured
   r->refcount = 1;
   r->resumptions = 0;
   r->arg = lh_value_null;
+  r->hs = hs;
+  r->compress = LH_COMPRESS_IDLE;
+  r->incompressible = false;
+  r->parked = NULL;
+  r->parked_prev = r->parked_next = NULL;
+  r->idle_since = 0;
+  if (resume_compressible(r)) resume_park(r);
 #ifdef _STATS
-  stats.rcont_captured_resume++;
+  stats_add(rcont_captured_resume, 1);
 #endif
   // and set our jump point
   if (_lh_setjmp(r->entry) != 0) {
     // longjmp back here when the resumption is called
-    assert(hs == &__hstack);
+    assert(hs == r->hs);
     lh_value res = r->arg;
 #ifdef _STATS
-    stats.rcont_resumed_resume++;
+    stats_add(rcont_resumed_resume, 1);
+    stats_tick();
 #endif
 
     // release our context
@@ -1120,11 +1634,15 @@ static __noinline lh_value capture_resume_yield(hstack* hs, effecthandler* h, lh
     // we set our jump point; now capture the stack upto the handler
     void* top = get_stack_top();
     capture_cstack(&r->cstack, h->stackbase, top);
-    // capture hstack
+    // capture hstack; a resumed multi-effect frame only handles the definitions from `op` upward,
+    // the ones below are handled around the operation function (see `handle_with`)
     capture_hstack(hs, &r->hstack, h, false);
+    ((effecthandler*)hstack_bottom(&r->hstack))->first = op - h->hdef;
+    resume_set_local(r);  // computed once; `lh_local` reads it inline
 #ifdef _STATS
-    if (r->cstack.frames == NULL) stats.rcont_captured_empty++;
-    stats.rcont_captured_size += (long)r->cstack.size + (long)r->hstack.size;
+    if (r->cstack.frames == NULL) stats_add(rcont_captured_empty, 1);
+    stats_add(rcont_captured_size, (long)r->cstack.size + (long)r->hstack.size);
+    stats_tick();
 #endif
     assert(h->hdef == ((effecthandler*)(r->hstack.hframes))->hdef);  // same handler?
     // and yield to the handler
@@ -1136,6 +1654,54 @@ static __noinline lh_value capture_resume_yield(hstack* hs, effecthandler* h, lh
    Handle
 -----------------------------------------------------------------*/
 
+// forward
+static lh_value handle_upto(hstack* hs, void* base, const lh_handlerdef* defs, count ndefs,
+                            const void* const* locals, lh_actionfun* action, lh_value arg);
+
+// Apply the result functions of `defs[first..last)`, innermost first.
+static lh_value handler_apply_results(const lh_handlerdef* defs, count first, count last, lh_value res) {
+  for (count i = last - 1; i >= first; i--) {
+    lh_resultfun* resfun = defs[i].resultfun;
+    if (resfun != NULL) {
+      void (*ret_fn)(void*, uint8_t*, lh_value) = resfun->function_ptr;
+      ret_fn(&res, resfun->closure, res);
+    }
+  }
+  return res;
+}
+
+// Call the operation function of `op` once its handler frame is popped.
+static lh_value handler_call_op(hstack* hs, const lh_handlerdef* op, resume* resume, lh_value arg) {
+  lh_value res;
+  void (*op_fn)(void*, uint8_t*, lh_resume, lh_value) = op->opfun->function_ptr;
+  // push a scoped frame if necessary
+  if (op->opkind >= LH_OP_SCOPED) {
+    hstack_push_scoped(hs, resume);
+    assert((void*)&resume->lhresume == (void*)resume);
+    op_fn(&res, op->opfun->closure, &resume->lhresume, arg);
+    hstack_pop(hs, op->opkind == LH_OP_SCOPED);
+  } else {
+    // and call the operation handler
+    op_fn(&res, op->opfun->closure, &resume->lhresume, arg);
+  }
+  return res;
+}
+
+// Closure to call an operation function as the action of a handler.
+typedef struct _opcall {
+  void (*function_ptr)(void*, uint8_t*, lh_value);
+  struct _opcall_env {
+    hstack* hs;
+    const lh_handlerdef* op;
+    resume* resume;
+  } env;
+} opcall;
+
+static void opcall_action(void* res, uint8_t* closure, lh_value arg) {
+  struct _opcall_env* env = (struct _opcall_env*)closure;
+  *(lh_value*)res = handler_call_op(env->hs, env->op, env->resume, arg);
+}
+
 // Start a handler
 static __noinline lh_value handle_with(
     hstack* hs, effecthandler* h, lh_actionfun* action, lh_value arg) {
@@ -1147,15 +1713,17 @@ static __noinline lh_value handle_with(
   const lh_handlerdef* hdef = h->hdef;
   void* base = h->stackbase;
 #endif
+  hstack* volatile vhs = hs;
   if (_lh_setjmp(h->entry) != 0) {
-    // needed as some compilers optimize wrongly (e.g. gcc v5.4.0 x86_64 with -O2 on msys2)
-    hs = &__hstack;
+    // reload from memory as some compilers optimize wrongly (e.g. gcc v5.4.0 x86_64 with -O2 on msys2);
+    // a fresh local instead of assigning `hs` so no non-volatile local is modified after the `setjmp`
+    hstack* const jhs = vhs;
     // we yielded back to the handler; the `handler->arg` is filled in.
     // note: if we return trough non-scoped resumes the handler stack may be
     // different and handler `h` will point to a random handler in that stack!
     // ie. we need to load from the top of the current handler stack instead.
     // This is also necessary if the handler stack was reallocated to grow.
-    h = (effecthandler*)(hstack_top(hs));  // re-load our handler
+    h = (effecthandler*)(hstack_top(jhs));  // re-load our handler
     assert(is_effecthandler(to_handler(h)));
 #ifndef NDEBUG
     assert(id == h->id);
@@ -1165,34 +1733,37 @@ static __noinline lh_value handle_with(
     lh_value res = h->arg;
     resume* resume = h->arg_resume;
     const lh_handlerdef* op = h->arg_op;
-    assert(op == NULL || op->effect == h->handler.effect);
-    hstack_pop(hs, (op == NULL) /*|| !op_is_release(op)*/);  // no release if moved into resumption
-    if (op != NULL && op->opfun != NULL) {
-      // push a scoped frame if necessary
-      if (op->opkind >= LH_OP_SCOPED) {
-        hstack_push_scoped(hs, resume);
-
-        assert((void*)&resume->lhresume == (void*)resume);
-        void (*op_fn)(void*, uint8_t*, lh_resume, lh_value) = op->opfun->function_ptr;
-        op_fn(&res, &op->opfun->closure, &resume->lhresume, res);
-        assert(hs == &__hstack);
-
-        hstack_pop(hs, op->opkind == LH_OP_SCOPED);
-      } else {
-        // and call the operation handler
-        void (*op_fn)(void*, uint8_t*, lh_resume, lh_value) = op->opfun->function_ptr;
-        op_fn(&res, &op->opfun->closure, &resume->lhresume, res);
-      }
+    const lh_handlerdef* defs = h->hdef;
+    const count first = h->first;
+    assert(op == NULL || (op >= defs + first && op < defs + h->ndefs));
+    // a tail operation that returned without resuming passes its result
+    const bool returned = (op != NULL && (op->opkind == LH_OP_TAIL || op->opkind == LH_OP_TAIL_NOOP));
+    if (op != NULL && !returned && op->opfun != NULL && op - defs > first) {
+      // in a multi-effect frame the definitions below the operation still handle the operation function;
+      // their state moves into a new frame while the state of the others is released unless it moved into the resumption
+      const count opidx = op - defs;
+      const void** locals = (const void**)lh_alloca((opidx - first) * sizeof(void*));
+      for (count i = first; i < opidx; i++) locals[i - first] = effecthandler_local(h, i);
+      if (resume == NULL) effecthandler_release(h, opidx, h->ndefs);
+      hstack_pop(jhs, false);
+      void* opbase = NULL;
+      opcall call = {&opcall_action, {jhs, op, resume}};
+      return handle_upto(jhs, &opbase, defs + first, opidx - first, locals, (lh_actionfun*)&call, res);
+    }
+    hstack_pop(jhs, resume == NULL);  // no release if moved into resumption
+    if (op != NULL && (returned || op->opfun == NULL)) {
+      // in a multi-effect frame the definitions below the operation are still in scope and see the result
+      res = handler_apply_results(defs, first, op - defs, res);
+    } else if (op != NULL) {
+      res = handler_call_op(jhs, op, resume, res);
     }
     return res;
   } else {
     // we set up the handler, now call the action
     lh_value res;
-    lh_resultfun* resfun = NULL;
 
     void (*action_fn)(void*, uint8_t*, lh_value) = action->function_ptr;
-    action_fn(&res, &action->closure, arg);
-    assert(hs == &__hstack);
+    action_fn(&res, action->closure, arg);
     h = (effecthandler*)hstack_top(hs);  // re-load our handler since the handler stack could have been reallocated
 #ifndef NDEBUG
     assert(id == h->id);
@@ -1200,21 +1771,19 @@ static __noinline lh_value handle_with(
     assert(base == h->stackbase);
 #endif
     // pop our handler
-    resfun = h->hdef->resultfun;
+    const lh_handlerdef* defs = h->hdef;
+    const count first = h->first;
+    const count ndefs = h->ndefs;
     hstack_pop(hs, true);
-    if (resfun != NULL) {
-      void (*ret_fn)(void*, uint8_t*, lh_value) = resfun->function_ptr;
-      ret_fn(&res, &resfun->closure, res);
-    }
-    return res;
+    return handler_apply_results(defs, first, ndefs, res);
   }
 }
 
 // `handle_upto` installs a handler on the stack with a given stack `base`.
-static __noinline lh_value handle_upto(hstack* hs, void* base, const lh_handlerdef* def,
-                                       lh_actionfun* action, lh_value arg) {
+static __noinline lh_value handle_upto(hstack* hs, void* base, const lh_handlerdef* defs, count ndefs,
+                                       const void* const* locals, lh_actionfun* action, lh_value arg) {
   // allocate handler frame on the stack so it will be part of a captured continuation
-  effecthandler* h = hstack_push_effect(hs, def, base);
+  effecthandler* h = hstack_push_effect(hs, defs, ndefs, base, locals);
   fragment* fragment;
   lh_value res;
 
@@ -1228,17 +1797,88 @@ static __noinline lh_value handle_upto(hstack* hs, void* base, const lh_handlerd
   return res;
 }
 
-// `handle` installs a new handler on the stack and calls the given `action` with argument `arg`.
-__noinline lh_value lh_handle(const lh_handlerdef* def, lh_actionfun* action, lh_value arg) {
+// `handle` installs a new handler on the stack of context `hs` and calls the given `action` with argument `arg`.
+__noinline lh_value lh_cx_handle(lh_context* hs, const lh_handlerdef* def, lh_actionfun* action, lh_value arg) {
   void* base = NULL;  // get_stack_top();
-  hstack* hs = &__hstack;
   lh_value res;
   LH_INIT(hs)
-  res = handle_upto(hs, &base, def, action, arg);
+  res = handle_upto(hs, &base, def, 1, NULL, action, arg);
   LH_DONE(hs)
   return res;
 }
 
+// `handle_local` installs a handler with its inline state initialized from `local`.
+__noinline lh_value lh_cx_handle_local(lh_context* hs, const lh_handlerdef* def, const void* local, lh_actionfun* action, lh_value arg) {
+  void* base = NULL;
+  lh_value res;
+  LH_INIT(hs)
+  res = handle_upto(hs, &base, def, 1, &local, action, arg);
+  LH_DONE(hs)
+  return res;
+}
+
+// `handle_many` installs a single handler frame for all `ndefs` definitions in `defs`;
+// it behaves as nested `lh_handle` calls with `defs[0]` as the outermost handler.
+__noinline lh_value lh_cx_handle_many(lh_context* hs, const lh_handlerdef* defs, long ndefs, lh_actionfun* action, lh_value arg) {
+  return lh_cx_handle_many_local(hs, defs, ndefs, NULL, action, arg);
+}
+
+__noinline lh_value lh_cx_handle_many_local(lh_context* hs, const lh_handlerdef* defs, long ndefs, const void* const* locals,
+                                            lh_actionfun* action, lh_value arg) {
+  void* base = NULL;
+  lh_value res;
+  if (ndefs <= 0) fatal(EINVAL, "lh_handle_many needs at least one handler definition");
+  LH_INIT(hs)
+  res = handle_upto(hs, &base, defs, ndefs, locals, action, arg);
+  LH_DONE(hs)
+  return res;
+}
+
+// The thread local versions use the context of the current thread.
+lh_value lh_handle(const lh_handlerdef* def, lh_actionfun* action, lh_value arg) {
+  return lh_cx_handle(&__hstack, def, action, arg);
+}
+
+lh_value lh_handle_local(const lh_handlerdef* def, const void* local, lh_actionfun* action, lh_value arg) {
+  return lh_cx_handle_local(&__hstack, def, local, action, arg);
+}
+
+lh_value lh_handle_many(const lh_handlerdef* defs, long ndefs, lh_actionfun* action, lh_value arg) {
+  return lh_cx_handle_many_local(&__hstack, defs, ndefs, NULL, action, arg);
+}
+
+lh_value lh_handle_many_local(const lh_handlerdef* defs, long ndefs, const void* const* locals,
+                              lh_actionfun* action, lh_value arg) {
+  return lh_cx_handle_many_local(&__hstack, defs, ndefs, locals, action, arg);
+}
+
+/*-----------------------------------------------------------------
+  Contexts
+-----------------------------------------------------------------*/
+
+lh_context* lh_context_new() {
+  hstack* hs = (hstack*)checked_malloc(sizeof(hstack));
+  hstack_init(hs);
+  return hs;
+}
+
+void lh_context_free(lh_context* hs) {
+  if (hs == NULL) return;
+  if (hs->count != 0) fatal(EINVAL, "Cannot free a context that still has handlers installed");
+  if (hs == &__hstack) fatal(EINVAL, "Cannot free the context of a thread");
+  hstack_free(hs, true);
+  checked_free(hs);
+}
+
+lh_context* lh_thread_context() {
+  return &__hstack;
+}
+
+lh_context* lh_resume_context(lh_resume r) {
+  if (r->rkind == TailResume) return ((tailresume*)r)->hs;
+  return ((resume*)r)->hs;
+}
+
 /*-----------------------------------------------------------------
   Linear handlers only have tail resume operations that do not exit themselves.
   In that case we never have to capture a first-class resumption
@@ -1250,7 +1890,7 @@ ptrdiff_t _lh_linear_handler_init(const lh_handlerdef* hdef,  bool* init) {
   hstack* hs = &__hstack;
   bool _init = lh_init(hs);
   if (init != NULL) *init = _init;
-  effecthandler* h = hstack_push_effect(hs, hdef, NULL /*no base*/);
+  effecthandler* h = hstack_push_effect(hs, hdef, 1, NULL /*no base*/, NULL);
   return h->id;
 }
 
@@ -1278,14 +1918,14 @@ lh_value _lh_implicit_get(lh_resume r, lh_value arg) {
   Yield an operation
 -----------------------------------------------------------------*/
 
-// `yieldop` yields to the first enclosing handler that can handle
+// `yieldop` yields to the first enclosing handler in context `hs` that can handle
 //   operation `optag` and passes it the argument `arg`.
-static lh_value yieldop(lh_effect optag, lh_value arg) {
+static lh_value yieldop(hstack* hs, lh_effect optag, lh_value arg) {
   // find the operation handler along the handler stack
-  hstack* hs = &__hstack;
   count skipped;
   const lh_handlerdef* op;
   effecthandler* h = hstack_find(hs, optag, &op, &skipped);
+  const count opidx = op - h->hdef;
 
   // No resume (i.e. like `throw`)
   if (op->opkind <= LH_OP_NORESUME) {
@@ -1298,11 +1938,13 @@ static lh_value yieldop(lh_effect optag, lh_value arg) {
     tailresume r;
     r.lhresume.rkind = TailResume;
     r.resumed = false;
+    r.hs = hs;
+    r.lhresume.local = effecthandler_local(h, opidx);  // computed once; `lh_local` reads it inline
     assert((void*)(&r.lhresume) == (void*)&r);
     lh_value res;
     if (op->opkind != LH_OP_TAIL_NOOP) {
-      // push a skip frame
-      hstack_push_skip(hs, skipped);
+      // push a skip frame; definitions below the operation in a multi-effect frame stay visible
+      hstack_push_skip(hs, skipped, opidx);
       count hidx = hstack_indexof(hs, to_handler(h));
 
       // call the operation handler directly for a tail resumption
@@ -1328,7 +1970,7 @@ static lh_value yieldop(lh_effect optag, lh_value arg) {
     }
     // otherwise no resume was called; yield back to the handler with the result.
     else {
-      yield_to_handler(hs, h, NULL, NULL, res, true);
+      yield_to_handler(hs, h, NULL, (opidx > h->first ? op : NULL), res, true);
     }
   }
 
@@ -1341,13 +1983,18 @@ static lh_value yieldop(lh_effect optag, lh_value arg) {
   return lh_value_null;
 }
 
-// Yield to the first enclosing handler that can handle
+// Yield to the first enclosing handler in context `hs` that can handle
 // operation `optag` and pass it the argument `arg`.
-lh_value lh_yield(lh_effect optag, lh_value arg) {
-#ifdef _DEBUG_STATS
-  stats.operations++;
+lh_value lh_cx_yield(lh_context* hs, lh_effect optag, lh_value arg) {
+#ifdef _STATS
+  stats_add(operations, 1);
+  stats_tick();
 #endif
-  return yieldop(optag, arg);
+  return yieldop(hs, optag, arg);
+}
+
+lh_value lh_yield(lh_effect optag, lh_value arg) {
+  return lh_cx_yield(&__hstack, optag, arg);
 }
 
 /*-----------------------------------------------------------------
@@ -1363,7 +2010,7 @@ lh_value lh_yield_local(lh_effect optag) {
   // find the operation handler along the handler stack
   hstack* hs = &__hstack;
   count skipped;
-  lh_handlerdef* op;
+  const lh_handlerdef* op;
   effecthandler* h = hstack_find(hs, optag, &op, &skipped);
   // and return the local state
   return 0;
@@ -1377,7 +2024,10 @@ lh_value lh_yield_local(lh_effect optag) {
 void* lh_cstack_ptr(lh_resume r, void* p) {
   if (r->rkind == TailResume) return p;
   assert(r->rkind == GeneralResume || r->rkind == ScopedResume);
-  cstack* cs = &((resume*)r)->cstack;
+  resume* rc = (resume*)r;
+  resume_inflate(rc);
+  rc->compress = LH_COMPRESS_NEVER;  // the returned pointer must stay valid
+  cstack* cs = &rc->cstack;
   ptrdiff_t delta = ptrdiff(cs->frames, cs->base);
   byte* q = (byte*)p + delta;
   assert(q >= cs->frames && q < cs->frames + cs->size);
@@ -1408,6 +2058,208 @@ lh_value lh_yieldN(lh_effect optag, int argcount, ...) {
   return lh_yield(optag, lh_value_yieldargs(yargs));
 }
 
+/*-----------------------------------------------------------------
+  Batched operations
+-----------------------------------------------------------------*/
+
+// Yield a batch of values with a single operation
+lh_value lh_yield_batch(lh_effect optag, const lh_value* values, long count) {
+  assert(count >= 0);
+  assert(count == 0 || values != NULL);
+  // note: allocated on the stack; use `lh_batch_value` to retrieve in the operation handler.
+  lh_batch batch = {count, values};
+  return lh_yield(optag, lh_value_cstack_ptr(&batch));
+}
+
+// Get the batch passed by `lh_yield_batch`; the values may be on the stack or in the heap.
+lh_batch lh_batch_value(lh_resume r, lh_value arg) {
+  lh_batch batch = *(const lh_batch*)lh_cstack_ptr_value(r, arg);
+  if (r->rkind != TailResume && batch.values != NULL) {
+    // `lh_cstack_ptr` already inflated the stack; only adjust values that were on the stack
+    const cstack* cs = &((resume*)r)->cstack;
+    const byte* base = (const byte*)cs->base;
+    const byte* p = (const byte*)batch.values;
+    if (p >= base && p < base + cs->size) {
+      batch.values = (const lh_value*)(cs->frames + (p - base));
+    }
+  }
+  return batch;
+}
+
+void lh_stream_init(lh_stream* s, lh_effect optag, long batch_size) {
+  assert(s != NULL);
+  if (batch_size <= 0) batch_size = 1;
+  s->optag = optag;
+  s->batch_size = batch_size;
+  s->count = 0;
+  s->buffer = (lh_value*)checked_malloc(batch_size * sizeof(lh_value));
+}
+
+void lh_stream_flush(lh_stream* s) {
+  long n = s->count;
+  if (n == 0) return;
+  s->count = 0;
+  lh_yield_batch(s->optag, s->buffer, n);
+}
+
+void lh_stream_done(lh_stream* s) {
+  lh_stream_flush(s);
+  if (s->buffer != NULL) checked_free(s->buffer);
+  s->buffer = NULL;
+}
+
+/*-----------------------------------------------------------------
+  Generators
+  The producer runs on its own stack. The first `lh_generator_next`
+  enters it through `makecontext`; after that the consumer and the
+  producer switch with `_lh_setjmp`/`_lh_longjmp` (which, unlike
+  `swapcontext`, do not save the signal mask with a system call).
+  The handler stack of the thread is swapped along, so handlers
+  installed by the producer are only visible while it runs.
+-----------------------------------------------------------------*/
+
+#define LH_GENERATOR_STACK (256 * 1024)
+#define LH_GENERATOR_CACHE 8
+
+typedef enum _genstate {
+  GenNew,
+  GenSuspended,
+  GenRunning,
+  GenDone
+} genstate;
+
+struct _lh_generator {
+  lh_jmp_buf producer;      // where the producer continues
+  lh_jmp_buf consumer;      // where the consumer continues
+  hstack hstack;            // the handler stack of the side that is not running
+  const void* stackbottom;  // the bottom of the C stack of the side that is not running
+  lh_generator* parent;     // the generator that was running when it was entered
+  lh_actionfun* action;
+  lh_value arg;
+  lh_value value;           // the yielded value, or the result of the producer
+  genstate state;
+  byte* stack;              // the stack of the producer
+  size_t stacksize;
+};
+
+// The generator whose producer is running
+static __thread lh_generator* __generator = NULL;
+
+// Freed stacks of the default size (including the guard page), so short lived generators do not mmap
+static __thread byte* __generator_stacks[LH_GENERATOR_CACHE];
+static __thread int __generator_stacks_count = 0;
+
+// Swap the handler stack and C stack bottom between the consumer and the producer
+static void generator_swap(lh_generator* g) {
+  hstack hs = __hstack;
+  __hstack = g->hstack;
+  g->hstack = hs;
+  const void* bottom = stackbottom;
+  stackbottom = g->stackbottom;
+  g->stackbottom = bottom;
+}
+
+// Switch from the producer back to the consumer
+static __noreturn void generator_leave(lh_generator* g) {
+  generator_swap(g);
+  __generator = g->parent;
+  g->parent = NULL;
+  _lh_longjmp(g->consumer, 1);
+}
+
+// Entry point of the producer stack
+static void generator_start(void) {
+  lh_generator* g = __generator;
+  lh_value res = lh_value_null;
+  g->action->function_ptr(&res, g->action->closure, g->arg);
+  g->value = res;
+  g->state = GenDone;
+  generator_leave(g);
+}
+
+// Switch from the consumer to the producer; returns once it yields or is done.
+static __noinline void generator_enter(lh_generator* g) {
+  genstate state = g->state;
+  g->state = GenRunning;
+  g->parent = __generator;
+  __generator = g;
+  generator_swap(g);
+  if (_lh_setjmp(g->consumer) != 0) return;
+  if (state == GenSuspended) _lh_longjmp(g->producer, 1);
+  ucontext_t uc;
+  if (getcontext(&uc) != 0) fatal(errno, "cannot start a generator");
+  uc.uc_stack.ss_sp = g->stack;
+  uc.uc_stack.ss_size = g->stacksize;
+  uc.uc_link = NULL;
+  makecontext(&uc, generator_start, 0);
+  setcontext(&uc);
+  fatal(errno, "cannot start a generator");
+}
+
+lh_generator* lh_generator_new(lh_actionfun* producer, lh_value arg, size_t stacksize) {
+  lh_init_globals();
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  if (stacksize == 0) stacksize = LH_GENERATOR_STACK;
+  stacksize = (stacksize + page - 1) & ~(page - 1);
+  byte* p;
+  if (stacksize == LH_GENERATOR_STACK && __generator_stacks_count > 0) {
+    p = __generator_stacks[--__generator_stacks_count];
+  } else {
+    // reserve a guard page below the stack
+    p = (byte*)mmap(NULL, stacksize + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == (byte*)MAP_FAILED) fatal(ENOMEM, "cannot allocate a generator stack of %lu bytes", (unsigned long)stacksize);
+    if (mprotect(stackup ? p + stacksize : p, page, PROT_NONE) != 0) {
+      munmap(p, stacksize + page);
+      fatal(errno, "cannot protect a generator stack");
+    }
+  }
+  lh_generator* g = (lh_generator*)checked_malloc(sizeof(lh_generator));
+  memset(g, 0, sizeof(lh_generator));
+  g->action = producer;
+  g->arg = arg;
+  g->state = GenNew;
+  g->stack = (stackup ? p : p + page);
+  g->stacksize = stacksize;
+  g->stackbottom = stack_bottom(g->stack, (ptrdiff_t)stacksize);
+  return g;
+}
+
+bool lh_generator_next(lh_generator* g, lh_value* value) {
+  assert(g != NULL);
+  if (g->state == GenRunning) fatal(EINVAL, "Cannot get the next value of a generator from within its producer");
+  if (g->state != GenDone) generator_enter(g);
+  if (value != NULL) *value = g->value;
+  return (g->state != GenDone);
+}
+
+void lh_generator_yield(lh_value value) {
+  lh_generator* g = __generator;
+  if (g == NULL) fatal(EINVAL, "Can only yield to a generator from its producer");
+  assert(g->state == GenRunning);
+  g->value = value;
+  g->state = GenSuspended;
+  if (_lh_setjmp(g->producer) == 0) generator_leave(g);
+}
+
+bool lh_generator_done(const lh_generator* g) {
+  return (g->state == GenDone);
+}
+
+void lh_generator_free(lh_generator* g) {
+  if (g == NULL) return;
+  if (g->state == GenRunning) fatal(EINVAL, "Cannot free a generator from within its producer");
+  // release the handlers of a suspended producer; its stack is discarded
+  hstack_free(&g->hstack, true);
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  byte* p = (stackup ? g->stack : g->stack - page);
+  if (g->stacksize == LH_GENERATOR_STACK && __generator_stacks_count < LH_GENERATOR_CACHE) {
+    __generator_stacks[__generator_stacks_count++] = p;
+  } else {
+    munmap(p, g->stacksize + page);
+  }
+  checked_free(g);
+}
+
 /*-----------------------------------------------------------------
   Resume
 -----------------------------------------------------------------*/
@@ -1419,10 +2271,10 @@ static resume* to_resume(lh_resume r) {
 }
 
 static __noinline lh_value lh_release_resume_(resume* r, lh_value resarg) {
-  hstack* hs = &__hstack;
+  hstack* hs = r->hs;
   lh_value res;
   LH_INIT(hs)
-  res = capture_resume_call(&__hstack, r, resarg);
+  res = capture_resume_call(hs, r, resarg);
   LH_DONE(hs)
   return res;
 }
@@ -1463,6 +2315,327 @@ void __noinline lh_release(lh_resume r) {
   if (r->rkind != TailResume) _lh_release(to_resume(r));
 }
 
+/*-----------------------------------------------------------------
+  Backtracking search
+  The body of a search runs in place. A choice with more than one
+  alternative pushes a choice point: a jump point, the trail mark,
+  and a copy of the C stack and the handler frames between the
+  search and the choice (usually none). Mutations are recorded on
+  the trail. Failing undoes the trail up to the mark of the innermost
+  choice point, restores its handler frames (which are normally still
+  in place), copies its C stack back and jumps into it with the next
+  alternative. Choice points, the trail and the stack copies are kept
+  in arrays owned by the search that are reused as it backtracks, so
+  in a steady state nothing is allocated.
+-----------------------------------------------------------------*/
+
+// An entry on the trail: the old contents of at most `sizeof(lh_value)` bytes at `addr`.
+typedef struct _trailentry {
+  void* addr;
+  count size;
+  lh_value old;
+} trailentry;
+
+typedef struct _choicepoint {
+  lh_jmp_buf entry;  // jump point in `search_choose`
+  const void* base;  // saved c-stack: lowest address,
+  ptrdiff_t size;    // size,
+  count frames;      // and offset in the stack buffer of the search
+  count trail;       // trail mark
+  count hcount;      // handler stack count
+  count hframes;     // offset of the saved handler frames above the search in the handler buffer
+  count htop;        // offset of the top saved frame from `hframes`
+  long next;         // next alternative
+  long n;            // number of alternatives
+  long depth;        // depth of the branch after this choice
+} choicepoint;
+
+typedef struct _search {
+  struct _search* parent;  // enclosing search on this thread
+  const void* base;        // base of the c-stack of the body
+  lh_jmp_buf exhausted;    // jumped to when there are no choice points left
+  lh_actionfun* body;
+  lh_value arg;
+  lh_solutionfun* on_solution;
+  lh_value solution_arg;
+  long solutions;
+  long maxdepth;
+  long limit;  // depth limit of the current iteration
+  long depth;  // depth of the current branch
+  bool iterative;  // iterative deepening?
+  bool cutoff;   // was the current iteration cut off by `limit`?
+  bool stopped;  // did `on_solution` stop the search?
+  bool hinit;    // was the handler stack uninitialized at the start?
+  count hcount;  // handler stack count at the start
+
+  choicepoint* choices;
+  count nchoices;
+  count choices_size;
+  trailentry* trail;
+  count ntrail;
+  count trail_size;
+  byte* stacks;  // saved c-stacks of the choice points
+  count stacks_used;
+  count stacks_size;
+  byte* hstacks;  // saved handler frames of the choice points
+  count hstacks_used;
+  count hstacks_size;
+} search;
+
+// thread local innermost search
+static __thread search* __search = NULL;
+
+// Grow an array of `elemsize` elements to hold at least `needed` elements.
+static void* search_grow(void* p, count* size, count needed, size_t elemsize) {
+  count newsize = (*size == 0 ? 16 : *size);
+  while (newsize < needed) newsize *= 2;
+  *size = newsize;
+  return checked_realloc(p, newsize * elemsize);
+}
+
+// Acquire or release the handler frames from `top` down to `bot`.
+static void search_handlers_apply(byte* bot, handler* top, bool acquire) {
+  handler* h = top;
+  for (;;) {
+    if (acquire) {
+      handler_acquire(h);
+    } else {
+      handler_release(h);
+    }
+    if ((byte*)h == bot) break;
+    h = _handler_prev(h);
+  }
+}
+
+// Save the handler frames installed since the start of the search with a choice point.
+static void search_save_handlers(search* s, choicepoint* cp) {
+  hstack* hs = &__hstack;
+  count size = hs->count - s->hcount;
+  cp->hcount = hs->count;
+  cp->hframes = s->hstacks_used;
+  if (size == 0) return;
+  if (s->hstacks_used + size > s->hstacks_size) {
+    s->hstacks = (byte*)search_grow(s->hstacks, &s->hstacks_size, s->hstacks_used + size, 1);
+  }
+  byte* saved = s->hstacks + cp->hframes;
+  memcpy(saved, hs->hframes + s->hcount, size);
+  cp->htop = ptrdiff(hs->top, hs->hframes + s->hcount);
+  s->hstacks_used += size;
+  search_handlers_apply(saved, (handler*)(saved + cp->htop), true);
+}
+
+// Release the handler frames saved with a choice point that will not be re-entered again.
+static void search_drop_handlers(search* s, choicepoint* cp) {
+  if (cp->hcount == s->hcount) return;
+  byte* saved = s->hstacks + cp->hframes;
+  search_handlers_apply(saved, (handler*)(saved + cp->htop), false);
+}
+
+// Restore the handler stack of a choice point before re-entering it with alternative `cp->next`.
+// If its frames are still in place we only pop the handlers installed since;
+// otherwise (a handler was exited) we reinstall the saved frames.
+static void search_restore_handlers(search* s, choicepoint* cp) {
+  hstack* hs = &__hstack;
+  count size = cp->hcount - s->hcount;
+  bool last = (cp->next == cp->n - 1);
+  if (hs->count < s->hcount) fatal(EFAULT, "Backtracking into a search whose handlers were already exited!");
+  if (hs->count >= cp->hcount && (size == 0 || memcmp(hs->hframes + s->hcount, s->hstacks + cp->hframes, size) == 0)) {
+    while (hs->count > cp->hcount) {
+      hstack_pop(hs, true);
+    }
+    if (last) search_drop_handlers(s, cp);
+  } else {
+    while (hs->count > s->hcount) {
+      hstack_pop(hs, true);
+    }
+    hstack_ensure_space(hs, size);
+    byte* bot = hs->hframes + hs->count;
+    memcpy(bot, s->hstacks + cp->hframes, size);
+    hs->count += size;
+    hs->top = (handler*)(bot + cp->htop);
+    if (!last) search_handlers_apply(bot, hs->top, true);  // the saved frames keep their references for the next alternative
+  }
+}
+
+// Undo the trail up to `mark`. Entries that point into the part of the c-stack
+// between the search base and `top` are skipped: that part is restored from the choice point
+// (and writing to it now could overwrite our own frame).
+static void search_undo(search* s, count mark, const void* top) {
+  const void* cur = get_stack_top();
+  if (top == NULL || stack_isbelow(top, cur)) top = cur;
+  while (s->ntrail > mark) {
+    trailentry* t = &s->trail[--s->ntrail];
+    if (!stack_isbelow(t->addr, s->base) && !stack_isbelow(top, t->addr)) continue;
+    memcpy(t->addr, &t->old, t->size);
+  }
+}
+
+// Backtrack into the innermost choice point.
+static __noinline __noreturn void search_fail(search* s) {
+  if (s->nchoices == 0) {
+    search_undo(s, 0, NULL);
+    hstack* hs = &__hstack;
+    if (hs->count < s->hcount) fatal(EFAULT, "Backtracking into a search whose handlers were already exited!");
+    while (hs->count > s->hcount) {
+      hstack_pop(hs, true);
+    }
+    _lh_longjmp(s->exhausted, 1);
+  }
+  choicepoint* cp = &s->choices[s->nchoices - 1];
+  search_undo(s, cp->trail, stack_top(cp->base, cp->size));
+  search_restore_handlers(s, cp);
+  cstack cs;
+  cs.base = cp->base;
+  cs.size = cp->size;
+  cs.frames = s->stacks + cp->frames;
+  cs.zsize = 0;
+  jumpto(&cs, &cp->entry, false);
+}
+
+// Push a choice point and return 0, or return the next alternative when backtracking into it.
+static __noinline long search_choose(search* s, long n) {
+  if (s->nchoices >= s->choices_size) {
+    s->choices = (choicepoint*)search_grow(s->choices, &s->choices_size, s->nchoices + 1, sizeof(choicepoint));
+  }
+  choicepoint* cp = &s->choices[s->nchoices];
+  if (_lh_setjmp(cp->entry) != 0) {
+    // longjmp back here from `search_fail`; our stack frame was restored.
+    s = __search;
+    cp = &s->choices[s->nchoices - 1];
+    long alt = cp->next++;
+    s->depth = cp->depth;
+    if (cp->next >= cp->n) {
+      // last alternative: no need to come back here
+      s->nchoices--;
+      s->stacks_used = cp->frames;
+      s->hstacks_used = cp->hframes;
+    }
+    return alt;
+  }
+  // capture the c-stack up to and including our frame
+  const void* top = get_stack_top();
+  ptrdiff_t size = stack_diff(top, s->base);
+  assert(size > 0);
+  if (s->stacks_used + size > s->stacks_size) {
+    s->stacks = (byte*)search_grow(s->stacks, &s->stacks_size, s->stacks_used + size, 1);
+  }
+  cp->base = (s->base <= top ? s->base : top);  // always lowest address
+  cp->size = size;
+  cp->frames = s->stacks_used;
+  memcpy(s->stacks + cp->frames, cp->base, size);
+  s->stacks_used += size;
+  cp->trail = s->ntrail;
+  search_save_handlers(s, cp);
+  cp->next = 1;
+  cp->n = n;
+  cp->depth = s->depth;
+  s->nchoices++;
+  return 0;
+}
+
+long lh_choose(long n) {
+  search* s = __search;
+  if (s == NULL) fatal(EINVAL, "Cannot choose outside a search");
+  if (n <= 0) search_fail(s);
+  if (s->depth >= s->limit) {
+    s->cutoff = true;
+    search_fail(s);
+  }
+  s->depth++;
+  if (n == 1) return 0;
+  return search_choose(s, n);
+}
+
+void lh_fail() {
+  search* s = __search;
+  if (s == NULL) fatal(EINVAL, "Cannot fail outside a search");
+  search_fail(s);
+}
+
+void lh_trail(void* p, size_t size) {
+  search* s = __search;
+  if (s == NULL) return;
+  byte* b = (byte*)p;
+  while (size > 0) {
+    count n = (size > sizeof(lh_value) ? sizeof(lh_value) : size);
+    if (s->ntrail >= s->trail_size) {
+      s->trail = (trailentry*)search_grow(s->trail, &s->trail_size, s->ntrail + 1, sizeof(trailentry));
+    }
+    trailentry* t = &s->trail[s->ntrail++];
+    t->addr = b;
+    t->size = n;
+    memcpy(&t->old, b, n);
+    b += n;
+    size -= n;
+  }
+}
+
+// A normal return of the body; returns only if the search should continue.
+static void search_solution(search* s, lh_value res) {
+  if (s->iterative && s->depth != s->limit) return;  // reported by an earlier iteration
+  s->solutions++;
+  if (s->on_solution != NULL && !s->on_solution(res, s->solution_arg)) {
+    s->stopped = true;
+    while (s->nchoices > 0) {
+      search_drop_handlers(s, &s->choices[--s->nchoices]);
+    }
+    s->stacks_used = 0;
+    s->hstacks_used = 0;
+  }
+}
+
+// Run all iterations of the search. Our frame is above `s->base` and
+// is restored with each choice point; all state that changes is kept in `s`.
+static __noinline void search_run(search* s) {
+  for (;;) {
+    s->depth = 0;
+    s->cutoff = false;
+    if (_lh_setjmp(s->exhausted) == 0) {
+      lh_value res;
+      s->body->function_ptr(&res, s->body->closure, s->arg);
+      search_solution(s, res);
+      search_fail(s);
+    }
+    assert(s->nchoices == 0 && s->ntrail == 0);
+    if (s->stopped || !s->cutoff || s->limit >= s->maxdepth) return;
+    s->limit++;
+  }
+}
+
+// Set the base of the c-stack of the search and run it.
+static __noinline void search_start(search* s) {
+  void* base = NULL;
+  s->base = &base;
+  search_run(s);
+}
+
+long lh_search(lh_search_strategy strategy, long maxdepth, lh_actionfun* body, lh_value arg, lh_solutionfun* on_solution, lh_value solution_arg) {
+  search s;
+  memset(&s, 0, sizeof(search));
+  s.body = body;
+  s.arg = arg;
+  s.on_solution = on_solution;
+  s.solution_arg = solution_arg;
+  s.maxdepth = (maxdepth <= 0 ? LONG_MAX : maxdepth);
+  s.iterative = (strategy == LH_SEARCH_IDDFS);
+  s.limit = (s.iterative ? 0 : s.maxdepth);
+  s.hinit = (__hstack.size == 0);
+  s.hcount = __hstack.count;
+  s.parent = __search;
+  lh_init_globals();
+  __search = &s;
+  search_start(&s);
+  __search = s.parent;
+  if (s.hinit && __hstack.size != 0 && __hstack.count == 0) {
+    hstack_free(&__hstack, true);  // handlers in the body initialized it but were unwound by backtracking
+  }
+  if (s.choices != NULL) checked_free(s.choices);
+  if (s.trail != NULL) checked_free(s.trail);
+  if (s.stacks != NULL) checked_free(s.stacks);
+  if (s.hstacks != NULL) checked_free(s.hstacks);
+  return s.solutions;
+}
+
 void lh_nothing() {}
 
 // Convert function pointers to lh_values's;
@@ -137,6 +137,13 @@ typedef struct {
 /// A `lh_resultfun` is called when a handled action is done.
 // typedef lh_value(lh_resultfun)(lh_value arg);
 
+/// Called on a byte-wise copy of the inline state of a handler when its frame is duplicated,
+/// i.e. when a resumption is resumed more than once. Use it to deep copy owned resources.
+typedef void lh_localcopyfun(void* local);
+
+/// Called when the inline state of a handler is released.
+typedef void lh_localreleasefun(void* local);
+
 /// An acquire function copies the local state in a handler when required.
 typedef lh_value lh_acquirefun(lh_value local);
 
@@ -154,7 +161,11 @@ typedef void lh_releasefun(lh_value local);
 /// \{
 
 /// Continuations are abstract and can only be `resume`d.
-struct _lh_resume;
+/// Only the prefix read by the inline lh_local() is visible; the rest is private to the runtime.
+struct _lh_resume {
+  int rkind;    ///< the kind of the resumption (private)
+  void* local;  ///< the inline state of the handler definition (see lh_local())
+};
 
 /// A "resume" continuation.
 /// This is first-class, and can be stored in data structures etc, and can survive
@@ -214,6 +225,9 @@ typedef struct _lh_handlerdef {
   lh_resultfun* resultfun;         ///< Invoked when the handled action is done; can be NULL in which case the action result is passed unchanged.
   lh_opfun* opfun;                 ///< Definitions of all handled operations ending with an operation with `lh_opkind` `LH_OP_NULL`. Can be NULL to handle no operations;
                                    ///< Note: all operations must be in the same order here as in the effect definition! (since each operation has a fixed index).
+  size_t localsize;                ///< Bytes of inline state stored in the handler frame (see lh_local()); 0 for none.
+  lh_localcopyfun* localcopy;      ///< Fixes up a duplicated state; can be NULL for plain copies.
+  lh_localreleasefun* localrelease;  ///< Releases the state when the handler is done with it; can be NULL.
 } lh_handlerdef;
 
 /*-----------------------------------------------------------------
@@ -225,9 +239,60 @@ typedef struct _lh_handlerdef {
 /// Handles operations yielded in `body(arg)` with the given handler definition `def`.
 lh_value lh_handle(const lh_handlerdef* def, lh_actionfun* body, lh_value arg);
 
+/// Handle several effects with a single handler frame.
+/// Behaves like nested lh_handle() calls with `defs[0]` as the outermost and `defs[ndefs-1]` as the innermost
+/// handler, but installs only one handler frame and one jump point for all of them.
+lh_value lh_handle_many(const lh_handlerdef* defs, long ndefs, lh_actionfun* body, lh_value arg);
+
+/// Handle an effect with inline handler state.
+/// The handler frame holds `def->localsize` bytes of state initialized from `local` (or zeroed if `NULL`),
+/// which operation functions access through lh_local().
+lh_value lh_handle_local(const lh_handlerdef* def, const void* local, lh_actionfun* body, lh_value arg);
+
+/// lh_handle_many() with inline handler state; `locals[i]` initializes the state of `defs[i]`.
+lh_value lh_handle_many_local(const lh_handlerdef* defs, long ndefs, const void* const* locals, lh_actionfun* body, lh_value arg);
+
 /// Yield an operation to the nearest enclosing handler.
 lh_value lh_yield(lh_effect optag, lh_value arg);
 
+/*-----------------------------------------------------------------
+  Explicit contexts
+-----------------------------------------------------------------*/
+
+/// A runtime context holds the handler stack that handlers are installed in and operations are yielded to.
+/// The functions above use the context of the current thread (lh_thread_context()); the `lh_cx_` variants take
+/// it explicitly so generated code can keep it in a register, and separate contexts allow several independent
+/// runtimes (for example one per task) on one thread. Resumptions always resume in the context they were captured in.
+/// Operations that capture a resumption must not be yielded across a handler of another context on the C stack.
+typedef struct _hstack lh_context;
+
+/// Create a new context without handlers.
+lh_context* lh_context_new();
+
+/// Free a context; it must not have handlers installed.
+void lh_context_free(lh_context* cx);
+
+/// The context of the current thread.
+lh_context* lh_thread_context();
+
+/// The context an operation was yielded in.
+lh_context* lh_resume_context(lh_resume r);
+
+/// lh_handle() in context `cx`.
+lh_value lh_cx_handle(lh_context* cx, const lh_handlerdef* def, lh_actionfun* body, lh_value arg);
+
+/// lh_handle_local() in context `cx`.
+lh_value lh_cx_handle_local(lh_context* cx, const lh_handlerdef* def, const void* local, lh_actionfun* body, lh_value arg);
+
+/// lh_handle_many() in context `cx`.
+lh_value lh_cx_handle_many(lh_context* cx, const lh_handlerdef* defs, long ndefs, lh_actionfun* body, lh_value arg);
+
+/// lh_handle_many_local() in context `cx`.
+lh_value lh_cx_handle_many_local(lh_context* cx, const lh_handlerdef* defs, long ndefs, const void* const* locals, lh_actionfun* body, lh_value arg);
+
+/// lh_yield() in context `cx`.
+lh_value lh_cx_yield(lh_context* cx, lh_effect optag, lh_value arg);
+
 /// `lh_yield_local` yields to the first enclosing handler for operation `optag` and returns its local state.
 /// This should be used
 /// with care as it violates the encapsulation principle but works
@@ -253,6 +318,14 @@ lh_value lh_tail_resume(lh_resume r, lh_value res);
 /*-----------------------------------------------------------------
   Resuming first-class continuations
 -----------------------------------------------------------------*/
+/// Pointer to the inline state of the handler of the current operation.
+/// For tail operations this points into the handler frame and is valid until the operation function yields
+/// or installs a handler; for other operations it points into the captured resumption and is valid until it is resumed.
+/// Returns NULL for operations that never resume, or if the handler definition has no inline state.
+static inline void* lh_local(lh_resume r) {
+  return (r != NULL ? r->local : NULL);
+}
+
 /// Explicitly release a first-class continuation without resuming.
 void lh_release(lh_resume r);
 
@@ -263,6 +336,33 @@ lh_value lh_call_resume(lh_resume r, lh_value res);
 /// Also releases the continuation and it cannot be resumed again!
 lh_value lh_release_resume(lh_resume r, lh_value res);
 
+/*-----------------------------------------------------------------
+  Compression of parked continuations
+-----------------------------------------------------------------*/
+
+/// Compression policies for the captured stack of a first-class continuation.
+typedef enum _lh_compress_policy {
+  LH_COMPRESS_IDLE,   ///< Compress once it has been idle longer than the threshold (the default).
+  LH_COMPRESS_NEVER,  ///< Never compress, for example for latency sensitive continuations.
+  LH_COMPRESS_EAGER   ///< Compress at the next lh_compress_idle() regardless of how long it has been idle.
+} lh_compress_policy;
+
+/// Set the idle time in milliseconds after which parked continuations are compressed by lh_compress_idle().
+/// Use 0 (the default) to only compress continuations with the #LH_COMPRESS_EAGER policy.
+/// Only continuations captured while a threshold is set are tracked for idle compression.
+void lh_compress_threshold(unsigned long idle_ms);
+
+/// Set the compression policy of a first-class continuation; ignored for tail resumptions.
+void lh_resume_compress(lh_resume r, lh_compress_policy policy);
+
+/// Compress the captured stacks of the first-class continuations of this thread that are idle.
+/// Compressed stacks are decompressed transparently when resumed. Call this periodically,
+/// for example from an event loop. Returns the number of bytes saved.
+/// Continuations tracked for compression (captured while a threshold is set, or with the #LH_COMPRESS_EAGER
+/// policy) are kept in an unlocked list of the thread that captured them: they must be resumed for the last
+/// time or released on that thread, and before it exits.
+size_t lh_compress_idle();
+
 /*-----------------------------------------------------------------
   Convenience functions for yield
 -----------------------------------------------------------------*/
@@ -299,6 +399,81 @@ typedef struct _yieldargs {
 /// the scope of the operation function and freed automatically afterwards.
 lh_value lh_yieldN(lh_effect optag, int argcount, ...);
 
+/*-----------------------------------------------------------------
+  Batched operations
+-----------------------------------------------------------------*/
+
+/// A batch of values yielded at once with lh_yield_batch().
+typedef struct _lh_batch {
+  long count;              ///< number of values
+  const lh_value* values;  ///< the values; valid during the scope of the operation function
+} lh_batch;
+
+/// Yield `count` values to operation `optag` with a single operation.
+/// The operation function gets a pointer to an #lh_batch as its argument; use lh_batch_value() to retrieve it.
+/// The handler consumes the whole batch before resuming, so `values` may be reused once this returns.
+lh_value lh_yield_batch(lh_effect optag, const lh_value* values, long count);
+
+/// Retrieve the batch passed to an operation function by lh_yield_batch().
+/// The batch (and its values if they are on the C stack) is adjusted to point into the captured stack, if any.
+lh_batch lh_batch_value(lh_resume r, lh_value arg);
+
+/// A stream adapter that turns single values into batched yields.
+/// The buffer is reused for the next batch, so the consumer should resume at most once per batch.
+typedef struct _lh_stream {
+  lh_effect optag;   ///< the operation the batches are yielded to
+  long batch_size;   ///< the number of values per batch
+  long count;        ///< the number of buffered values
+  lh_value* buffer;  ///< `batch_size` values
+} lh_stream;
+
+/// Initialize a stream yielding batches of at most `batch_size` values to operation `optag`.
+void lh_stream_init(lh_stream* s, lh_effect optag, long batch_size);
+
+/// Emit a value on a stream; yields a batch once `batch_size` values are buffered.
+static inline void lh_stream_emit(lh_stream* s, lh_value v) {
+  s->buffer[s->count++] = v;
+  if (s->count >= s->batch_size) {
+    s->count = 0;
+    lh_yield_batch(s->optag, s->buffer, s->batch_size);
+  }
+}
+
+/// Yield the buffered values, if any.
+void lh_stream_flush(lh_stream* s);
+
+/// Flush a stream and release its buffer.
+void lh_stream_done(lh_stream* s);
+
+/*-----------------------------------------------------------------
+  Generators
+-----------------------------------------------------------------*/
+
+/// A generator runs a producer on its own stack as a coroutine of the consumer.
+/// Switching between them is a direct context switch: no stack is captured or copied,
+/// and nothing is allocated per value.
+typedef struct _lh_generator lh_generator;
+
+/// Create a generator that runs `producer(arg)` on a separate stack of `stacksize` bytes
+/// (0 for a default of 256kb). The producer does not run until the first lh_generator_next().
+/// Handlers installed by the producer only handle operations of the producer, and its
+/// resumptions can only be resumed inside the producer.
+lh_generator* lh_generator_new(lh_actionfun* producer, lh_value arg, size_t stacksize);
+
+/// Run the producer until it yields the next value. Returns `false` once the producer
+/// has returned, in which case `*value` is set to its result.
+bool lh_generator_next(lh_generator* g, lh_value* value);
+
+/// In a producer, pass `value` to the consumer and suspend until the next lh_generator_next().
+void lh_generator_yield(lh_value value);
+
+/// Is the producer done?
+bool lh_generator_done(const lh_generator* g);
+
+/// Free a generator. A producer that is not done yet is terminated: the handler frames
+/// it installed are released (see #lh_localreleasefun) and its stack is freed.
+void lh_generator_free(lh_generator* g);
+
 /*-----------------------------------------------------------------
   Operation tags
 -----------------------------------------------------------------*/
@@ -360,13 +535,31 @@ void lh_check_memory(void* out);
 /// Print out statistics.
 void lh_print_stats(FILE* out);
 
-/// Check at the end of the program if all continuations were released
+/// Check at the end of the program if all continuations were released (in debug builds)
 void lh_check_memory(FILE* out);
 #endif
 
 /// Wait for an enter key in debug mode.
 void lh_debug_wait_for_enter();
 
+/// Publish statistics into a shared memory page (see `metrics.h`) mapped from the file at `path`.
+/// The page is refreshed every `period` statistics events of a thread (rounded up to a power of two, 0 for the default)
+/// and on every call to lh_metrics_publish(). Statistics are only counted in debug builds or while the page is open;
+/// each thread adds its counts once per period and when its outermost handler returns.
+/// Returns 0 on success or an `errno` value.
+int lh_metrics_open(const char* path, unsigned period);
+
+/// Publish the final statistics and unmap the metrics page.
+/// Other threads should no longer run handlers, as they may still be publishing into the page.
+void lh_metrics_close();
+
+/// Publish the current statistics now; does nothing if no metrics page is open.
+void lh_metrics_publish();
+
+/// Report the depth of a `queue.c` ring (with `1 << exp` slots and packed state `q`) in the metrics page.
+/// Returns the queue slot or -1 if no metrics page is open or all slots are in use.
+int lh_metrics_register_queue(const char* name, _Atomic uint32_t* q, int exp);
+
 /// \}
 
 /*-----------------------------------------------------------------
@@ -657,4 +850,64 @@ lh_value _lh_implicit_get(lh_resume r, lh_value arg);
 
 /// \} implicits
 
+/*-----------------------------------------------------------------
+  Backtracking search
+-----------------------------------------------------------------*/
+
+/// \defgroup effect_search Backtracking Search
+/// Depth-first search with choice points and a trail.
+/// A search runs its body in place; lh_choose() returns the first alternative directly and
+/// remembers the choice point, lh_fail() undoes the trail back to the innermost choice point with
+/// alternatives left and re-enters it with the next one. Only the C stack between the search and the
+/// choice point is saved, into a buffer that is reused as the search backtracks, so no resumptions
+/// are captured. Handlers that enclose a choice point must not be exited before backtracking into it,
+/// and operations yielded from the body to handlers outside the search should be tail-resumptive.
+///
+/// \b Example
+/// ```
+/// static void queens(void* res, uint8_t* closure, lh_value arg) {
+///   for (long row = 0; row < N; row++) {
+///     long col = lh_choose(N);
+///     if (!safe(row, col)) lh_fail();
+///     lh_trail_assign(column[col], 1);
+///   }
+///   *(lh_value*)res = lh_value_null;  // a solution
+/// }
+/// ```
+/// \{
+
+/// Search strategies.
+typedef enum _lh_search_strategy {
+  LH_SEARCH_DFS,    ///< Depth-first search up to the maximal depth.
+  LH_SEARCH_IDDFS   ///< Iterative deepening: depth-first searches with a depth limit of 0, 1, ... up to the maximal depth.
+} lh_search_strategy;
+
+/// Called for every solution with the result of the search body; return `false` to stop the search.
+typedef bool lh_solutionfun(lh_value result, lh_value arg);
+
+/// Search for the solutions of `body(arg)`.
+/// Every normal return of `body` is a solution that is passed to `on_solution` (if not `NULL`),
+/// after which the search backtracks for the next one. The depth of a branch is the number of lh_choose()
+/// calls on it; `maxdepth` bounds it (use 0 for no bound). With #LH_SEARCH_IDDFS a solution is reported
+/// once, by the iteration whose limit equals its depth. All trailed state is restored on return.
+/// Returns the number of reported solutions.
+long lh_search(lh_search_strategy strategy, long maxdepth, lh_actionfun* body, lh_value arg, lh_solutionfun* on_solution, lh_value solution_arg);
+
+/// Choose an alternative in `[0,n)`; the first call returns 0 and backtracking returns the next ones.
+/// Fails if `n <= 0` or when the depth limit is reached.
+long lh_choose(long n);
+
+/// Fail the current branch and backtrack into the innermost choice point; never returns.
+void lh_fail();
+
+/// Record the current contents of `size` bytes at `p` so they are restored on backtracking.
+/// Does nothing outside a search. The C stack of the search body need not be trailed; it is restored with the choice point.
+void lh_trail(void* p, size_t size);
+
+/// Assign `value` to the lvalue `x` and record the old value on the trail.
+#define lh_trail_assign(x, value) \
+  (lh_trail(&(x), sizeof(x)), (x) = (value))
+
+/// \}
+
 #endif  // __libhandler_h
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef __lzstack_h
+#define __lzstack_h
+
+#include "./types.h"
+
+#include <stdint.h>  // uint32_t
+#include <string.h>  // memcpy, memset
+
+/*-----------------------------------------------------------------
+  A small LZ77 codec for captured C stacks
+  Parked stacks are mostly zero filled buffers and repeated
+  pointers, which compress well with a plain LZ77 and an overlapping
+  copy. The block format follows LZ4: a sequence is a token byte
+  (literal length in the high nibble, match length minus 4 in the
+  low nibble, 15 meaning more length bytes follow), the literals, and
+  a little endian 16 bit match offset. The last sequence only has
+  literals. The decoder checks all bounds.
+-----------------------------------------------------------------*/
+
+#define LZ_MINMATCH 4
+#define LZ_HASHBITS 12
+#define LZ_MAXOFFSET 0xFFFF
+
+// The maximal compressed size of `n` bytes.
+static count lz_bound(count n) {
+  return n + (n / 255) + 16;
+}
+
+static uint32_t lz_read32(const byte* p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static uint32_t lz_hash(uint32_t x) {
+  return (x * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+static byte* lz_put_length(byte* op, count len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (byte)len;
+  return op;
+}
+
+static byte* lz_put_sequence(byte* op, const byte* lit, count litlen, count offset, count matchlen) {
+  byte* token = op++;
+  *token = (byte)((litlen >= 15 ? 15 : litlen) << 4);
+  if (litlen >= 15) op = lz_put_length(op, litlen - 15);
+  memcpy(op, lit, litlen);
+  op += litlen;
+  if (matchlen > 0) {
+    *op++ = (byte)(offset & 0xFF);
+    *op++ = (byte)(offset >> 8);
+    count ml = matchlen - LZ_MINMATCH;
+    *token |= (byte)(ml >= 15 ? 15 : ml);
+    if (ml >= 15) op = lz_put_length(op, ml - 15);
+  }
+  return op;
+}
+
+// Compress `n` bytes of `src` into `dst`, which must hold at least `lz_bound(n)` bytes.
+// Returns the compressed size.
+static count lz_compress(const byte* src, count n, byte* dst) {
+  uint32_t table[1 << LZ_HASHBITS];
+  memset(table, 0, sizeof(table));
+  byte* op = dst;
+  count anchor = 0;
+  count ip = 1;  // position 0 is never a match candidate since 0 marks an empty slot
+  count misses = 0;
+  while (ip + LZ_MINMATCH <= n) {
+    uint32_t x = lz_read32(src + ip);
+    uint32_t h = lz_hash(x);
+    count cand = table[h];
+    table[h] = (uint32_t)ip;
+    if (cand == 0 || ip - cand > LZ_MAXOFFSET || lz_read32(src + cand) != x) {
+      ip += 1 + (misses++ >> 6);  // skip faster through incompressible data
+      continue;
+    }
+    misses = 0;
+    count len = LZ_MINMATCH;
+    while (ip + len < n && src[cand + len] == src[ip + len]) len++;
+    op = lz_put_sequence(op, src + anchor, ip - anchor, ip - cand, len);
+    ip += len;
+    anchor = ip;
+  }
+  op = lz_put_sequence(op, src + anchor, n - anchor, 0, 0);
+  return op - dst;
+}
+
+static bool lz_get_length(const byte** pip, const byte* iend, count* len) {
+  const byte* ip = *pip;
+  byte b;
+  do {
+    if (ip >= iend) return false;
+    b = *ip++;
+    *len += b;
+  } while (b == 255);
+  *pip = ip;
+  return true;
+}
+
+// Copy `n` bytes in 8 byte chunks; may write up to 7 bytes beyond `dst + n`
+// and reads from `src` in order, so it also works for overlapping copies with `dst - src >= 8`.
+static void lz_wildcopy(byte* dst, const byte* src, count n) {
+  byte* end = dst + n;
+  do {
+    memcpy(dst, src, 8);
+    dst += 8;
+    src += 8;
+  } while (dst < end);
+}
+
+// Decompress `zn` bytes of `src` into exactly `n` bytes at `dst`. Returns `false` on corrupt input.
+static bool lz_decompress(const byte* src, count zn, byte* dst, count n) {
+  const byte* ip = src;
+  const byte* iend = src + zn;
+  byte* op = dst;
+  byte* oend = dst + n;
+  while (ip < iend) {
+    byte token = *ip++;
+    count litlen = token >> 4;
+    if (litlen == 15 && !lz_get_length(&ip, iend, &litlen)) return false;
+    if (litlen > iend - ip || litlen > oend - op) return false;
+    if (litlen <= 16 && iend - ip >= 16 && oend - op >= 16) {
+      memcpy(op, ip, 16);  // short literal runs are the common case
+    } else {
+      memcpy(op, ip, litlen);
+    }
+    ip += litlen;
+    op += litlen;
+    if (ip >= iend) break;  // the last sequence has only literals
+    if (iend - ip < 2) return false;
+    count offset = ip[0] | ((count)ip[1] << 8);
+    ip += 2;
+    count len = (token & 15);
+    if (len == 15 && !lz_get_length(&ip, iend, &len)) return false;
+    len += LZ_MINMATCH;
+    if (offset == 0 || offset > op - dst || len > oend - op) return false;
+    const byte* match = op - offset;
+    if (offset >= 8 && oend - op >= len + 8) {
+      lz_wildcopy(op, match, len);
+    } else if (offset == 1) {
+      memset(op, *match, len);
+    } else {
+      for (count i = 0; i < len; i++) op[i] = match[i];
+    }
+    op += len;
+  }
+  return (op == oend);
+}
+
+#endif  // __lzstack_h
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef __lh_metrics_h
+#define __lh_metrics_h
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*-----------------------------------------------------------------
+  Shared-memory metrics page
+  The runtime publishes its statistics into a file mapped with
+  `lh_metrics_open`, so an external process can poll them without
+  stopping the runtime. The page is written as a seqlock: `seq` is
+  odd while an update is in progress and readers retry until they
+  observe the same even `seq` before and after copying the fields.
+  Readers must check `magic`, `version` and `size` before use; fields
+  are only ever appended, in which case `version` is bumped.
+-----------------------------------------------------------------*/
+
+#define LH_METRICS_MAGIC 0x544d484cu  // "LHMT"
+#define LH_METRICS_VERSION 1
+#define LH_METRICS_MAX_QUEUES 16
+#define LH_METRICS_QUEUE_NAME 24
+
+typedef struct _lh_metrics_queue {
+  char name[LH_METRICS_QUEUE_NAME];  // zero terminated
+  _Atomic uint64_t depth;            // number of elements in the queue at the last publish
+} lh_metrics_queue;
+
+typedef struct _lh_metrics_page {
+  uint32_t magic;    // LH_METRICS_MAGIC
+  uint32_t version;  // LH_METRICS_VERSION
+  uint32_t size;     // sizeof(lh_metrics_page) of the writer
+  uint32_t pid;      // process that publishes into this page
+
+  _Atomic uint64_t seq;           // seqlock sequence; odd while the writer is updating
+  _Atomic uint64_t timestamp_ns;  // CLOCK_MONOTONIC time of the last publish
+  _Atomic uint64_t publishes;     // number of completed publishes
+
+  _Atomic uint64_t operations;      // yielded operations
+  _Atomic uint64_t captured;        // captured continuations (resume, scoped and fragment)
+  _Atomic uint64_t resumed;         // resumed continuations
+  _Atomic uint64_t released;        // released continuations
+  _Atomic uint64_t captured_bytes;  // total bytes of captured c-stacks and handler stacks
+  _Atomic uint64_t hstack_max;      // maximal handler stack size in bytes
+
+  _Atomic uint32_t queue_count;  // number of registered queues in `queues`
+  uint32_t _reserved;
+  lh_metrics_queue queues[LH_METRICS_MAX_QUEUES];
+} lh_metrics_page;
+
+#endif  // __lh_metrics_h
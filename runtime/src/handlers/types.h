@@ -55,6 +55,7 @@ typedef struct _cstack {
   const void* base;  // The `base` is the lowest/smallest adress of where the stack is captured
   ptrdiff_t size;    // The byte size of the captured stack
   byte* frames;      // The captured stack data (allocated in the heap)
+  ptrdiff_t zsize;   // The size of `frames` if it is compressed (see `lzstack.h`), 0 otherwise
 } cstack;
 
 // A `fragment` is a captured C-stack and an `entry`.
@@ -72,12 +73,9 @@ typedef enum _resumekind {
   TailResume      // `lh_resume` is a `tailresume`
 } resumekind;
 
-// Typedef'ed to `lh_resume` in the header.
+// `struct _lh_resume` is typedef'ed to `lh_resume` in the header and holds the `resumekind`.
 // This is an algebraic data type and is either a `resume` or `tailresume`.
 // The `_lh_resume` should be the first field of those (so we can upcast safely).
-struct _lh_resume {
-  resumekind rkind;  // the resumption kind
-};
 
 // Every resume kind starts with an `lhresume` field (for safe upcasting)
 #define to_lhresume(r) (&(r)->lhresume)
@@ -91,12 +89,20 @@ typedef struct _resume {
   struct _hstack hstack;         // captured hstack  always `size == count`
   volatile lh_value arg;         // the argument to `resume` is passed through `arg`.
   count resumptions;             // how often was this resumption resumed?
+  struct _hstack* hs;            // the context (handler stack) it was captured in and resumes in
+  struct _resume** parked;       // the list of parked resumptions of the capturing thread while compression is enabled, or NULL
+  struct _resume* parked_prev;   // general resumptions are kept in that list
+  struct _resume* parked_next;   //   so idle ones can be compressed (see `lh_compress_idle`)
+  uint64_t idle_since;           // (coarse) time in ns at which it was captured or last resumed; 0 if unknown
+  byte compress;                 // the `lh_compress_policy`
+  bool incompressible;           // compression was tried and did not pay off
 } resume;
 
 // An optimized resumption that can only used for tail-call resumptions (`lh_tail_resume`).
 typedef struct _tailresume {
-  struct _lh_resume lhresume;  // the kind: always `TailResume` (must be first field, used for casts)
+  struct _lh_resume lhresume;  // the kind: always `TailResume`, and the inline state (must be first field, used for casts)
   volatile bool resumed;       // set to `true` if `lh_tail_resume` was called
+  struct _hstack* hs;          // the context of the operation
 } tailresume;
 
 // A handler; there are four kinds of frames
@@ -119,24 +125,32 @@ struct _handler {
 LH_DEFINE_EFFECT0(__fragment)
 LH_DEFINE_EFFECT0(__scoped)
 LH_DEFINE_EFFECT0(__skip)
+LH_DEFINE_EFFECT0(__many)  // effect handlers that handle more than one effect (see `lh_handle_many`)
 
 // Regular effect handler.
 typedef struct _effecthandler {
   struct _handler handler;
   lh_jmp_buf entry;            // used to jump back to a handler
   count id;                    // uniquely identifies the handler (cannot always use pointer due to reallocation)
-  const lh_handlerdef* hdef;   // operation definitions
+  const lh_handlerdef* hdef;   // operation definitions; the handler handles `hdef[first]` up to `hdef[ndefs-1]` (innermost)
+  count first;                 // first handled definition; resumptions of a multi-effect frame handle only the definitions from the yielded one upward
+  count ndefs;                 // number of definitions in `hdef`
   volatile lh_value arg;       // the yield argument is passed here
   const lh_handlerdef* arg_op;  // the yielded operation is passed here
   resume* arg_resume;          // the resumption function for the yielded operation
   void* stackbase;             // pointer to the c-stack just below the handler
   lh_value local;
+  count localsize;             // bytes of inline state following the frame; each definition has `localsize` bytes rounded up to `LH_LOCAL_ALIGN`
 } effecthandler;
 
+// Inline handler state is stored right after the `effecthandler` and aligned to
+#define LH_LOCAL_ALIGN (sizeof(lh_value))
+
 // A skip handler.
 typedef struct _skiphandler {
   struct _handler handler;
-  count toskip;  // when looking for an operation handler, skip the next `toskip` bytes.
+  count toskip;   // when looking for an operation handler, skip the next `toskip` bytes.
+  count visible;  // definitions of the skipped-to handler below this index are still visible (for multi-effect frames)
 } skiphandler;
 
 // A fragment handler just contains a `fragment`.
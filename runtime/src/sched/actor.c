@@ -0,0 +1,678 @@
+/* ----------------------------------------------------------------------------
+  Actors on worker threads.
+
+  A mailbox is a lock-free stack that senders push to; the actor takes
+  all pending messages with one exchange and reverses them into a
+  private FIFO, so it pays one atomic operation per batch of messages.
+
+  An actor is scheduled when its state goes from idle to scheduled;
+  whoever makes that transition (a sender, or the worker that finds
+  new messages right after parking the actor) puts it in a run queue.
+  A worker has three queues:
+  - a private FIFO of actors that live on it,
+  - an inbox (a lock-free stack) of its actors woken by other threads,
+  - a single-producer multi-consumer ring (see `queue.c`) of actors
+    that did not run yet; the owner pushes, and idle workers steal.
+
+  Preemption: each worker has a timer that sends it a signal every
+  time slice while it is awake. The handler only sets a flag,
+  and only if the same turn was already running at the previous tick,
+  so an actor runs between one and two slices before it is asked to
+  yield. The flag is checked at safepoints in the actor.
+
+  Placement: with pinning, worker `i` is pinned to the `i`-th cpu in
+  placement order (see `topology.h`), allocates its own structure
+  (with its spawn ring) on its node, and steals from the other
+  workers nearest first. Everything a worker allocates later, like
+  captured stacks and its local queue, is first touched on its cpu.
+-----------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include "actor.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../queue/queue.h"
+#include "topology.h"
+
+LH_DEFINE_EFFECT1(actor_park, op)
+
+#define ACTOR_BATCH 64
+#define SPAWN_EXP 12  // a spawn ring holds up to 2^12-1 actors
+#define LOCAL_MINSIZE 64
+#define IDLE_SPINS 64
+#define IDLE_WAIT_NS 1000000  // wait at most 1ms before looking for work to steal again
+#define PREEMPT_SIGNAL SIGURG  // ignored by default, so a stray tick is harmless
+
+#ifndef sigev_notify_thread_id  // older glibc
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+typedef enum _actor_state {
+  ACTOR_IDLE,       // parked on an empty mailbox
+  ACTOR_SCHEDULED,  // in a run queue or running
+  ACTOR_BLOCKED,    // parked in lh_actor_block()
+  ACTOR_WOKEN,      // woken while it was still on its way to block
+  ACTOR_DONE        // returned from its behavior
+} actor_state;
+
+typedef struct _msgnode {
+  struct _msgnode* next;
+  lh_value value;
+} msgnode;
+
+typedef struct _worker worker;
+
+struct _lh_actor {
+  _Atomic(msgnode*) incoming;  // pushed by senders, newest first
+  msgnode* head;               // messages taken by the actor, oldest first
+  _Atomic int state;           // an `actor_state`
+  lh_resume resume;            // the parked actor, or `NULL` if it did not run yet
+  lh_actionfun* behavior;
+  lh_value arg;
+  lh_actors* actors;
+  worker* home;                // the worker it lives on once it ran
+  long budget;                 // messages left in this turn
+  bool yielded;                // did it yield in this turn?
+  bool blocked;                // did it block in this turn?
+  lh_actor* next_ready;        // link in the inbox of its home worker
+  lh_actor* next_all;          // link in the list of all actors
+};
+
+struct _worker {
+  lh_actors* actors;
+  int index;
+  int* steal;  // the other workers in stealing order
+  timer_t timer;
+  // actors that did not run yet; only this worker pushes
+  _Atomic uint32_t spawnq;
+  lh_actor* _Atomic spawned[1 << SPAWN_EXP];
+  // actors living on this worker that are ready to run; only this worker uses it
+  lh_actor** local;
+  long local_size;
+  long local_head;
+  long local_count;
+  // actors living on this worker woken by other threads
+  _Atomic(lh_actor*) inbox;
+  // sleeping while there is no work
+  _Atomic bool sleeping;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+struct _lh_actors {
+  worker** workers;
+  pthread_t* threads;
+  int nworkers;
+  _Atomic int ready;           // workers that are initialized
+  long batch;
+  long slice_us;               // time slice for preemption, or 0
+  bool pin;
+  lh_topology topo;            // if pinned
+  _Atomic int next_worker;     // round robin for actors spawned outside the workers
+  _Atomic long live;           // actors that did not return yet
+  _Atomic(lh_actor*) all;      // all spawned actors
+  _Atomic bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+static __thread worker* __worker = NULL;
+static __thread lh_actor* __actor = NULL;
+
+__thread volatile sig_atomic_t _lh_actor_preempted = 0;
+static __thread volatile long __turn = 0;       // turns run by this worker
+static __thread volatile long __tick_turn = 0;  // the turn at the previous tick
+
+/*-----------------------------------------------------------------
+  Mailbox
+-----------------------------------------------------------------*/
+
+static void mailbox_push(lh_actor* a, lh_value value) {
+  msgnode* m = (msgnode*)lh_malloc(sizeof(msgnode));
+  if (m == NULL) abort();
+  m->value = value;
+  m->next = atomic_load_explicit(&a->incoming, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak(&a->incoming, &m->next, m)) {
+  }
+}
+
+// Move the incoming messages to the FIFO of the actor; returns `false` if there are none.
+static bool mailbox_take(lh_actor* a) {
+  if (a->head != NULL) return true;
+  msgnode* m = atomic_exchange(&a->incoming, NULL);
+  if (m == NULL) return false;
+  msgnode* fifo = NULL;
+  while (m != NULL) {
+    msgnode* next = m->next;
+    m->next = fifo;
+    fifo = m;
+    m = next;
+  }
+  a->head = fifo;
+  return true;
+}
+
+static bool mailbox_empty(lh_actor* a) {
+  return (a->head == NULL && atomic_load(&a->incoming) == NULL);
+}
+
+static void mailbox_free(lh_actor* a) {
+  mailbox_take(a);
+  while (a->head != NULL) {
+    msgnode* m = a->head;
+    a->head = m->next;
+    lh_free(m);
+  }
+}
+
+/*-----------------------------------------------------------------
+  Run queues
+-----------------------------------------------------------------*/
+
+static void local_push(worker* w, lh_actor* a) {
+  if (w->local_count == w->local_size) {
+    long size = (w->local_size == 0 ? LOCAL_MINSIZE : 2 * w->local_size);
+    lh_actor** local = (lh_actor**)lh_malloc(size * sizeof(lh_actor*));
+    if (local == NULL) abort();
+    for (long i = 0; i < w->local_count; i++) local[i] = w->local[(w->local_head + i) & (w->local_size - 1)];
+    if (w->local != NULL) lh_free(w->local);
+    w->local = local;
+    w->local_size = size;
+    w->local_head = 0;
+  }
+  w->local[(w->local_head + w->local_count) & (w->local_size - 1)] = a;
+  w->local_count++;
+}
+
+static lh_actor* local_pop(worker* w) {
+  if (w->local_count == 0) return NULL;
+  lh_actor* a = w->local[w->local_head];
+  w->local_head = (w->local_head + 1) & (w->local_size - 1);
+  w->local_count--;
+  return a;
+}
+
+// Move the actors woken by other threads to the local queue
+static void inbox_take(worker* w) {
+  if (atomic_load_explicit(&w->inbox, memory_order_relaxed) == NULL) return;
+  lh_actor* a = atomic_exchange(&w->inbox, NULL);
+  lh_actor* fifo = NULL;
+  while (a != NULL) {
+    lh_actor* next = a->next_ready;
+    a->next_ready = fifo;
+    fifo = a;
+    a = next;
+  }
+  for (; fifo != NULL; fifo = fifo->next_ready) local_push(w, fifo);
+}
+
+static void worker_wake(worker* w) {
+  if (atomic_load(&w->sleeping)) {
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+  }
+}
+
+static void inbox_push(worker* w, lh_actor* a) {
+  a->next_ready = atomic_load_explicit(&w->inbox, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak(&w->inbox, &a->next_ready, a)) {
+  }
+  worker_wake(w);
+}
+
+// Push an actor that did not run yet; returns `false` if the ring is full
+static bool spawn_push(worker* w, lh_actor* a) {
+  int i = queue_push(&w->spawnq, SPAWN_EXP);
+  if (i < 0) return false;
+  atomic_store_explicit(&w->spawned[i], a, memory_order_relaxed);
+  queue_push_commit(&w->spawnq);
+  return true;
+}
+
+// Pop an actor that did not run yet; called by the owner and by thieves
+static lh_actor* spawn_pop(worker* w) {
+  for (;;) {
+    uint32_t save;
+    int i = queue_mpop(&w->spawnq, SPAWN_EXP, &save);
+    if (i < 0) return NULL;
+    lh_actor* a = atomic_load_explicit(&w->spawned[i], memory_order_relaxed);
+    if (queue_mpop_commit(&w->spawnq, save)) return a;
+  }
+}
+
+// Wake a sleeping worker other than `w` to steal from it
+static void worker_wake_thief(worker* w) {
+  lh_actors* s = w->actors;
+  for (int i = 0; i < s->nworkers - 1; i++) {
+    worker* v = s->workers[w->steal[i]];
+    if (atomic_load_explicit(&v->sleeping, memory_order_relaxed)) {
+      worker_wake(v);
+      return;
+    }
+  }
+}
+
+// Make an idle actor runnable on its home worker
+static void actor_schedule(lh_actor* a) {
+  worker* w = a->home;
+  if (w == __worker) {
+    local_push(w, a);
+  } else {
+    inbox_push(w, a);
+  }
+}
+
+/*-----------------------------------------------------------------
+  Running actors
+-----------------------------------------------------------------*/
+
+static void park_op(void* res, uint8_t* closure, lh_resume r, lh_value arg) {
+  (void)closure;
+  (void)arg;
+  __actor->resume = r;
+  *(lh_value*)res = lh_value_null;  // return to the worker
+}
+
+static lh_opfun park_fun = {park_op};
+static const lh_handlerdef park_def = {.opkind = LH_OP_GENERAL, .effect = LH_EFFECT(actor_park), .opfun = &park_fun};
+
+static void actor_done(lh_actor* a) {
+  lh_actors* s = a->actors;
+  atomic_store(&a->state, ACTOR_DONE);
+  mailbox_free(a);
+  if (atomic_fetch_sub(&s->live, 1) == 1) {
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->done);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+// Run one turn of an actor on worker `w`
+static void actor_turn(worker* w, lh_actor* a) {
+  a->budget = a->actors->batch;
+  a->yielded = false;
+  a->blocked = false;
+  __turn++;
+  _lh_actor_preempted = 0;
+  __actor = a;
+  if (a->resume == NULL) {
+    a->home = w;
+    lh_handle(&park_def, a->behavior, a->arg);
+  } else {
+    lh_resume r = a->resume;
+    a->resume = NULL;
+    lh_release_resume(r, lh_value_null);
+  }
+  __actor = NULL;
+  _lh_actor_preempted = 0;
+  if (a->resume == NULL) {
+    actor_done(a);
+  } else if (a->blocked) {
+    int running = ACTOR_SCHEDULED;
+    if (!atomic_compare_exchange_strong(&a->state, &running, ACTOR_BLOCKED)) {
+      atomic_store(&a->state, ACTOR_SCHEDULED);  // it was woken already
+      local_push(w, a);
+    }
+  } else if (a->yielded || (a->budget <= 0 && !mailbox_empty(a))) {
+    local_push(w, a);  // used up its turn; go to the back of the queue
+  } else {
+    // park, and catch messages that were sent after the mailbox was found empty
+    atomic_store(&a->state, ACTOR_IDLE);
+    int idle = ACTOR_IDLE;
+    if (!mailbox_empty(a) && atomic_compare_exchange_strong(&a->state, &idle, ACTOR_SCHEDULED)) {
+      local_push(w, a);
+    }
+  }
+}
+
+/*-----------------------------------------------------------------
+  Preemption
+-----------------------------------------------------------------*/
+
+static void preempt_tick(int signo) {
+  (void)signo;
+  if (__actor == NULL) return;
+  if (__tick_turn == __turn) {
+    _lh_actor_preempted = 1;  // a full slice in the same turn
+  } else {
+    __tick_turn = __turn;
+  }
+}
+
+static void preempt_install() {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = &preempt_tick;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(PREEMPT_SIGNAL, &sa, NULL) != 0) abort();
+}
+
+// Arm or disarm the timer of a worker
+static void preempt_arm(worker* w, bool on) {
+  long slice = (on ? w->actors->slice_us : 0);
+  struct itimerspec its;
+  its.it_interval.tv_sec = slice / 1000000;
+  its.it_interval.tv_nsec = (slice % 1000000) * 1000;
+  its.it_value = its.it_interval;
+  timer_settime(w->timer, 0, &its, NULL);
+}
+
+// Start the timer of the calling worker. CPU-time clocks are only checked
+// at the scheduler tick, which is too coarse, so this is a monotonic timer
+// that is disarmed while the worker sleeps.
+static void preempt_start(worker* w) {
+  if (w->actors->slice_us <= 0) return;
+  struct sigevent ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.sigev_notify = SIGEV_THREAD_ID;
+  ev.sigev_signo = PREEMPT_SIGNAL;
+  ev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+  if (timer_create(CLOCK_MONOTONIC, &ev, &w->timer) != 0) abort();
+  preempt_arm(w, true);
+}
+
+static void preempt_stop(worker* w) {
+  if (w->actors->slice_us > 0) timer_delete(w->timer);
+}
+
+/*-----------------------------------------------------------------
+  Workers
+-----------------------------------------------------------------*/
+
+static lh_actor* worker_steal(worker* w) {
+  lh_actors* s = w->actors;
+  for (int i = 0; i < s->nworkers - 1; i++) {
+    lh_actor* a = spawn_pop(s->workers[w->steal[i]]);
+    if (a != NULL) return a;
+  }
+  return NULL;
+}
+
+static lh_actor* worker_next(worker* w) {
+  inbox_take(w);  // every time, so that woken actors do not wait behind busy ones
+  lh_actor* a = local_pop(w);
+  if (a != NULL) return a;
+  a = spawn_pop(w);
+  if (a != NULL) return a;
+  return worker_steal(w);
+}
+
+static void worker_sleep(worker* w) {
+  bool preempt = (w->actors->slice_us > 0);
+  if (preempt) preempt_arm(w, false);
+  pthread_mutex_lock(&w->lock);
+  atomic_store(&w->sleeping, true);
+  if (atomic_load(&w->inbox) == NULL && !atomic_load(&w->actors->stop)) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += IDLE_WAIT_NS;
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&w->wake, &w->lock, &until);
+  }
+  atomic_store(&w->sleeping, false);
+  pthread_mutex_unlock(&w->lock);
+  if (preempt) preempt_arm(w, true);
+}
+
+static const lh_cpu* worker_cpu(lh_actors* s, int i) {
+  return &s->topo.cpus[i % s->topo.count];
+}
+
+// Order the other workers by distance, and by index after `i` for the same distance
+static int* worker_steal_order(lh_actors* s, int i) {
+  int n = s->nworkers;
+  int* order = (int*)lh_malloc((n > 1 ? n - 1 : 1) * sizeof(int));
+  if (order == NULL) abort();
+  for (int k = 1; k < n; k++) {
+    int j = (i + k) % n;
+    int d = (s->pin ? lh_topology_distance(worker_cpu(s, i), worker_cpu(s, j)) : 0);
+    int at = k - 1;  // insertion sort, stable
+    while (at > 0 && s->pin && lh_topology_distance(worker_cpu(s, i), worker_cpu(s, order[at - 1])) > d) {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = j;
+  }
+  return order;
+}
+
+// Pin the calling thread and allocate worker `i` on its node
+static worker* worker_init(lh_actors* s, int i) {
+  int node = 0;
+  if (s->pin) {
+    const lh_cpu* c = worker_cpu(s, i);
+    lh_topology_pin(c->cpu);
+    node = c->node;
+  }
+  worker* w = (worker*)lh_node_alloc(sizeof(worker), node, (s->pin ? s->topo.nodes : 1));
+  if (w == NULL) abort();
+  w->actors = s;
+  w->index = i;
+  w->steal = worker_steal_order(s, i);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->wake, NULL);
+  return w;
+}
+
+typedef struct _worker_start {
+  lh_actors* actors;
+  int index;
+} worker_start;
+
+static void* worker_run(void* arg) {
+  worker_start start = *(worker_start*)arg;
+  lh_free(arg);
+  lh_actors* s = start.actors;
+  worker* w = worker_init(s, start.index);
+  s->workers[start.index] = w;
+  pthread_mutex_lock(&s->lock);
+  atomic_fetch_add(&s->ready, 1);
+  pthread_cond_broadcast(&s->done);
+  while (atomic_load(&s->ready) < s->nworkers) pthread_cond_wait(&s->done, &s->lock);  // before stealing
+  pthread_mutex_unlock(&s->lock);
+  __worker = w;
+  preempt_start(w);
+  int spins = 0;
+  while (!atomic_load_explicit(&w->actors->stop, memory_order_relaxed)) {
+    lh_actor* a = worker_next(w);
+    if (a != NULL) {
+      actor_turn(w, a);
+      spins = 0;
+    } else if (++spins < IDLE_SPINS) {
+      sched_yield();
+    } else {
+      worker_sleep(w);
+      spins = 0;
+    }
+  }
+  preempt_stop(w);
+  __worker = NULL;
+  return NULL;
+}
+
+/*-----------------------------------------------------------------
+  Interface
+-----------------------------------------------------------------*/
+
+lh_actors* lh_actors_start(int workers, long batch) {
+  lh_actors_config config = {(workers < 1 ? 1 : workers), batch, 0, false};
+  return lh_actors_start_config(&config);
+}
+
+lh_actors* lh_actors_start_preemptive(int workers, long batch, long slice_us) {
+  lh_actors_config config = {(workers < 1 ? 1 : workers), batch, slice_us, false};
+  return lh_actors_start_config(&config);
+}
+
+lh_actors* lh_actors_start_config(const lh_actors_config* config) {
+  lh_actors* s = (lh_actors*)lh_malloc(sizeof(lh_actors));
+  if (s == NULL) abort();
+  memset(s, 0, sizeof(lh_actors));
+  s->pin = (config->pin && lh_topology_read(&s->topo, NULL));
+  int workers = config->workers;
+  if (workers <= 0) {
+    cpu_set_t allowed;
+    workers = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT(&allowed) : 1);
+  }
+  s->workers = (worker**)lh_malloc(workers * sizeof(worker*));
+  s->threads = (pthread_t*)lh_malloc(workers * sizeof(pthread_t));
+  if (s->workers == NULL || s->threads == NULL) abort();
+  s->nworkers = workers;
+  s->batch = (config->batch > 0 ? config->batch : ACTOR_BATCH);
+  s->slice_us = (config->slice_us > 0 ? config->slice_us : 0);
+  if (s->slice_us > 0) preempt_install();
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->done, NULL);
+  for (int i = 0; i < workers; i++) {
+    worker_start* start = (worker_start*)lh_malloc(sizeof(worker_start));
+    if (start == NULL) abort();
+    start->actors = s;
+    start->index = i;
+    if (pthread_create(&s->threads[i], NULL, &worker_run, start) != 0) abort();
+  }
+  // workers steal from each other, so wait until all are there
+  pthread_mutex_lock(&s->lock);
+  while (atomic_load(&s->ready) < workers) pthread_cond_wait(&s->done, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+  return s;
+}
+
+void lh_actors_join(lh_actors* s) {
+  assert(__worker == NULL);
+  pthread_mutex_lock(&s->lock);
+  while (atomic_load(&s->live) > 0) pthread_cond_wait(&s->done, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+  atomic_store(&s->stop, true);
+  for (int i = 0; i < s->nworkers; i++) {
+    worker* w = s->workers[i];
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(s->threads[i], NULL);
+    if (w->local != NULL) lh_free(w->local);
+    lh_free(w->steal);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake);
+    lh_node_free(w, sizeof(worker));
+  }
+  lh_actor* a = atomic_load(&s->all);
+  while (a != NULL) {
+    lh_actor* next = a->next_all;
+    mailbox_free(a);  // messages sent while it returned
+    lh_free(a);
+    a = next;
+  }
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->done);
+  if (s->pin) lh_topology_free(&s->topo);
+  lh_free(s->workers);
+  lh_free(s->threads);
+  lh_free(s);
+}
+
+lh_actor* lh_actor_spawn(lh_actors* s, lh_actionfun* behavior, lh_value arg) {
+  lh_actor* a = (lh_actor*)lh_malloc(sizeof(lh_actor));
+  if (a == NULL) abort();
+  memset(a, 0, sizeof(lh_actor));
+  a->behavior = behavior;
+  a->arg = arg;
+  a->actors = s;
+  atomic_store_explicit(&a->state, ACTOR_SCHEDULED, memory_order_relaxed);
+  a->next_all = atomic_load_explicit(&s->all, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak(&s->all, &a->next_all, a)) {
+  }
+  atomic_fetch_add(&s->live, 1);
+  worker* w = __worker;
+  if (w != NULL && w->actors == s) {
+    if (spawn_push(w, a)) {
+      worker_wake_thief(w);
+    } else {
+      a->home = w;  // the ring is full; keep it here
+      local_push(w, a);
+    }
+  } else {
+    // spawned outside the workers: distribute round robin
+    int i = atomic_fetch_add_explicit(&s->next_worker, 1, memory_order_relaxed);
+    a->home = s->workers[(unsigned)i % (unsigned)s->nworkers];
+    inbox_push(a->home, a);
+  }
+  return a;
+}
+
+void lh_actor_send(lh_actor* a, lh_value msg) {
+  if (atomic_load_explicit(&a->state, memory_order_relaxed) == ACTOR_DONE) return;
+  mailbox_push(a, msg);
+  int idle = ACTOR_IDLE;
+  if (atomic_load(&a->state) == ACTOR_IDLE && atomic_compare_exchange_strong(&a->state, &idle, ACTOR_SCHEDULED)) {
+    actor_schedule(a);
+  }
+}
+
+lh_value lh_actor_receive() {
+  lh_actor* a = __actor;
+  assert(a != NULL);
+  if (_lh_actor_preempted) a->budget = 0;  // a safepoint: end the turn
+  while (a->budget <= 0 || !mailbox_take(a)) {
+    lh_yield(LH_EFFECT(actor_park), lh_value_null);
+    a = __actor;
+  }
+  a->budget--;
+  msgnode* m = a->head;
+  a->head = m->next;
+  lh_value value = m->value;
+  lh_free(m);
+  return value;
+}
+
+void lh_actor_yield() {
+  lh_actor* a = __actor;
+  assert(a != NULL);
+  a->yielded = true;
+  lh_yield(LH_EFFECT(actor_park), lh_value_null);
+}
+
+void lh_actor_block() {
+  lh_actor* a = __actor;
+  assert(a != NULL);
+  a->blocked = true;
+  lh_yield(LH_EFFECT(actor_park), lh_value_null);
+}
+
+void lh_actor_wake(lh_actor* a) {
+  int state = atomic_load(&a->state);
+  for (;;) {
+    if (state == ACTOR_BLOCKED) {
+      if (atomic_compare_exchange_weak(&a->state, &state, ACTOR_SCHEDULED)) {
+        actor_schedule(a);
+        return;
+      }
+    } else if (state == ACTOR_SCHEDULED) {
+      // still running towards lh_actor_block(); its worker reschedules it
+      if (atomic_compare_exchange_weak(&a->state, &state, ACTOR_WOKEN)) return;
+    } else {
+      return;
+    }
+  }
+}
+
+lh_actor* lh_actor_self() {
+  return __actor;
+}
+
+lh_actors* lh_actor_pool() {
+  return (__actor == NULL ? NULL : __actor->actors);
+}
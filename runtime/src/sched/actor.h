@@ -0,0 +1,99 @@
+#pragma once
+#ifndef __actor_h
+#define __actor_h
+
+#include <signal.h>
+
+#include "libhandler.h"
+
+/*-----------------------------------------------------------------
+  Actors
+  Actors run on a pool of worker threads. Each actor has a mailbox
+  that any thread can send to, and a behavior that takes messages
+  out of it with lh_actor_receive(). An actor processes up to `batch`
+  messages per scheduling turn; when its mailbox is empty it parks by
+  capturing a resumption, so it never blocks its worker.
+
+  A parked actor holds a copy of its stack that can only be restored
+  on the thread that captured it, so an actor stays on the worker
+  that first ran it. Idle workers steal actors that did not run yet
+  from the other workers.
+
+  Actors are scheduled cooperatively. With a time slice, each worker
+  also runs a timer while it is awake; when an actor is still in
+  the same turn after a full slice, the next safepoint it passes
+  (`lh_actor_safepoint()` or `lh_actor_receive()`) yields it to the
+  back of the run queue.
+-----------------------------------------------------------------*/
+
+/// An actor.
+typedef struct _lh_actor lh_actor;
+
+/// A pool of worker threads running actors.
+typedef struct _lh_actors lh_actors;
+
+/// Start `workers` worker threads (at least 1) that run actors for up to `batch` messages
+/// per turn (0 for a default of 64).
+lh_actors* lh_actors_start(int workers, long batch);
+
+/// How to run a pool of actors.
+typedef struct _lh_actors_config {
+  int workers;    // number of worker threads, or 0 for one per usable cpu
+  long batch;     // messages per turn, or 0 for 64
+  long slice_us;  // time slice for preemption, or 0 for none
+  bool pin;       // pin workers by cpu topology and steal from the nearest workers first
+} lh_actors_config;
+
+/// Start a pool of workers as configured. With `pin`, each worker is pinned to a cpu
+/// (spread over cores before hardware threads, filling a node at a time), its
+/// scheduling structures are allocated on its NUMA node if there are several, and
+/// it steals from workers on the same core, cluster, package and node first.
+lh_actors* lh_actors_start_config(const lh_actors_config* config);
+
+/// Like lh_actors_start(), but with preemption: actors that run longer than `slice_us`
+/// microseconds in one turn yield at their next safepoint (no preemption if 0).
+/// The timer signal (`SIGURG`) can interrupt system calls made by actors with `EINTR`.
+lh_actors* lh_actors_start_preemptive(int workers, long batch, long slice_us);
+
+/// Wait until all actors spawned in `actors` have returned from their behavior,
+/// then stop the workers and free the actors. Must not be called from an actor.
+void lh_actors_join(lh_actors* actors);
+
+/// Spawn an actor running `behavior(arg)`. The action must stay valid until the actor is done.
+/// The actor can receive messages right away, and stays valid until lh_actors_join().
+lh_actor* lh_actor_spawn(lh_actors* actors, lh_actionfun* behavior, lh_value arg);
+
+/// Send a message to an actor; can be called from any thread.
+/// Messages to an actor that has returned are dropped.
+void lh_actor_send(lh_actor* actor, lh_value msg);
+
+/// In an actor, take the next message from its mailbox, parking the actor until one arrives.
+lh_value lh_actor_receive();
+
+/// In an actor, let the other actors on its worker run before continuing.
+void lh_actor_yield();
+
+/// In an actor, park until another thread or actor calls lh_actor_wake() on it.
+/// Messages that arrive meanwhile stay in the mailbox.
+void lh_actor_block();
+
+/// Wake an actor that blocked, or is about to block, in lh_actor_block(); can be
+/// called from any thread. Each wake releases one block, and must be paired with it.
+void lh_actor_wake(lh_actor* actor);
+
+/// Set by the timer when the running actor should yield; use lh_actor_safepoint().
+extern __thread volatile sig_atomic_t _lh_actor_preempted;
+
+/// Yield if the running actor used up its time slice. This is only a thread-local
+/// load when there is nothing to do, so it can go on loop back-edges.
+static inline void lh_actor_safepoint() {
+  if (__builtin_expect(_lh_actor_preempted, 0)) lh_actor_yield();
+}
+
+/// The actor that is running, or `NULL` outside an actor.
+lh_actor* lh_actor_self();
+
+/// The pool the running actor belongs to, or `NULL` outside an actor.
+lh_actors* lh_actor_pool();
+
+#endif  // __actor_h
@@ -0,0 +1,201 @@
+/* ----------------------------------------------------------------------------
+  Structured concurrency: nurseries on top of effect handlers.
+
+  A nursery installs a scope handler whose inline state points to the
+  nursery, and runs its run loop inside it. Each task runs under its
+  own child handler for the `spawn`, `yield` and `fail` operations, so
+  yielding captures only the stack of that task. The scope handler
+  owns the run queue: when it is released, either because the
+  nursery is done or because it was parked in a task of an enclosing
+  nursery that got cancelled, the tasks left in the queue are released.
+-----------------------------------------------------------------------------*/
+#include "nursery.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+LH_DEFINE_EFFECT0(nursery_scope)
+LH_DEFINE_EFFECT1(nursery_spawn, op)
+LH_DEFINE_EFFECT1(nursery_yield, op)
+LH_DEFINE_EFFECT1(nursery_fail, op)
+
+#define NURSERY_MINSIZE 64
+
+// A runnable task: either a child that did not start yet, or a parked one.
+typedef struct _task {
+  lh_actionfun* action;  // the action of a child that did not start
+  lh_value arg;
+  lh_resume resume;      // the resumption of a parked task, or `NULL`
+  bool body;             // is this the body of the nursery?
+} task;
+
+typedef struct _nursery {
+  task* tasks;      // ring buffer of runnable tasks
+  long size;        // its capacity, a power of 2
+  long head;        // index of the first task
+  long count;       // number of runnable tasks
+  bool running_body;  // is the running task the body?
+  bool yielded;       // did the running task yield?
+  bool failed;
+  lh_value error;
+  lh_value result;  // the result of the body
+  struct _outcome* out;
+} nursery;
+
+// The outcome of a nursery, on the stack of `lh_nursery_run`
+typedef struct _outcome {
+  bool completed;
+  lh_value value;
+} outcome;
+
+/*-----------------------------------------------------------------
+  Run queue
+-----------------------------------------------------------------*/
+
+static void nursery_push(nursery* n, task t) {
+  if (n->count == n->size) {
+    long size = (n->size == 0 ? NURSERY_MINSIZE : 2 * n->size);
+    task* tasks = (task*)lh_malloc(size * sizeof(task));
+    if (tasks == NULL) abort();
+    // unwrap the ring into the new buffer
+    for (long i = 0; i < n->count; i++) tasks[i] = n->tasks[(n->head + i) & (n->size - 1)];
+    if (n->tasks != NULL) lh_free(n->tasks);
+    n->tasks = tasks;
+    n->size = size;
+    n->head = 0;
+  }
+  n->tasks[(n->head + n->count) & (n->size - 1)] = t;
+  n->count++;
+}
+
+static task nursery_pop(nursery* n) {
+  assert(n->count > 0);
+  task t = n->tasks[n->head];
+  n->head = (n->head + 1) & (n->size - 1);
+  n->count--;
+  return t;
+}
+
+// Release all tasks left in the run queue
+static void nursery_cancel(nursery* n) {
+  while (n->count > 0) {
+    task t = nursery_pop(n);
+    if (t.resume != NULL) lh_release(t.resume);
+  }
+}
+
+// Called when the scope handler is released
+static void nursery_release(void* local) {
+  nursery* n = *(nursery**)local;
+  nursery_cancel(n);
+  if (n->tasks != NULL) lh_free(n->tasks);
+  lh_free(n);
+}
+
+/*-----------------------------------------------------------------
+  Operations
+-----------------------------------------------------------------*/
+
+static nursery* nursery_of(lh_resume r) {
+  return *(nursery**)lh_local(r);
+}
+
+static void spawn_op(void* res, uint8_t* closure, lh_resume r, lh_value arg) {
+  (void)closure;
+  nursery_push(nursery_of(r), *(const task*)lh_cstack_ptr_value(r, arg));
+  *(lh_value*)res = lh_tail_resume(r, lh_value_null);
+}
+
+static void yield_op(void* res, uint8_t* closure, lh_resume r, lh_value arg) {
+  (void)closure;
+  (void)arg;
+  nursery* n = nursery_of(r);
+  task t = {NULL, lh_value_null, r, n->running_body};
+  nursery_push(n, t);
+  n->yielded = true;
+  *(lh_value*)res = lh_value_null;  // return to the run loop
+}
+
+static void fail_op(void* res, uint8_t* closure, lh_resume r, lh_value arg) {
+  (void)closure;
+  nursery* n = nursery_of(r);
+  if (!n->failed) {
+    n->failed = true;
+    n->error = arg;
+  }
+  *(lh_value*)res = lh_value_null;  // return to the run loop without resuming
+}
+
+static lh_opfun spawn_fun = {spawn_op};
+static lh_opfun yield_fun = {yield_op};
+static lh_opfun fail_fun = {fail_op};
+
+static const lh_handlerdef child_defs[3] = {
+    {.opkind = LH_OP_TAIL_NOOP, .effect = LH_EFFECT(nursery_spawn), .opfun = &spawn_fun, .localsize = sizeof(nursery*)},
+    {.opkind = LH_OP_GENERAL, .effect = LH_EFFECT(nursery_yield), .opfun = &yield_fun, .localsize = sizeof(nursery*)},
+    {.opkind = LH_OP_TAIL_NOOP, .effect = LH_EFFECT(nursery_fail), .opfun = &fail_fun, .localsize = sizeof(nursery*)}};
+
+static const lh_handlerdef scope_def = {
+    .opkind = LH_OP_FORWARD, .effect = LH_EFFECT(nursery_scope), .localsize = sizeof(nursery*), .localrelease = &nursery_release};
+
+/*-----------------------------------------------------------------
+  Run loop
+-----------------------------------------------------------------*/
+
+static void nursery_loop(nursery* n) {
+  const void* locals[3] = {&n, &n, &n};
+  while (n->count > 0 && !n->failed) {
+    task t = nursery_pop(n);
+    n->yielded = false;
+    n->running_body = t.body;
+    lh_value res;
+    if (t.resume == NULL) {
+      res = lh_handle_many_local(child_defs, 3, locals, t.action, t.arg);
+    } else {
+      res = lh_release_resume(t.resume, lh_value_null);
+    }
+    if (t.body && !n->yielded) n->result = res;
+  }
+}
+
+// Runs inside the scope handler, which releases the nursery when it is done
+static void nursery_action(void* res, uint8_t* closure, lh_value arg) {
+  (void)closure;
+  nursery* n = (nursery*)lh_ptr_value(arg);
+  nursery_loop(n);
+  n->out->completed = !n->failed;
+  n->out->value = (n->failed ? n->error : n->result);
+  *(lh_value*)res = lh_value_null;
+}
+
+/*-----------------------------------------------------------------
+  Interface
+-----------------------------------------------------------------*/
+
+bool lh_nursery_run(lh_actionfun* body, lh_value arg, lh_value* result) {
+  nursery* n = (nursery*)lh_malloc(sizeof(nursery));
+  if (n == NULL) abort();
+  memset(n, 0, sizeof(nursery));
+  outcome out = {false, lh_value_null};
+  n->out = &out;
+  task t = {body, arg, NULL, true};
+  nursery_push(n, t);
+  lh_actionfun action = {nursery_action};
+  lh_handle_local(&scope_def, &n, &action, lh_value_ptr(n));
+  if (result != NULL) *result = out.value;
+  return out.completed;
+}
+
+void lh_nursery_spawn(lh_actionfun* child, lh_value arg) {
+  task t = {child, arg, NULL, false};
+  lh_yield(LH_EFFECT(nursery_spawn), lh_value_cstack_ptr(&t));
+}
+
+void lh_nursery_yield() {
+  lh_yield(LH_EFFECT(nursery_yield), lh_value_null);
+}
+
+void lh_nursery_fail(lh_value error) {
+  lh_yield(LH_EFFECT(nursery_fail), error);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef __nursery_h
+#define __nursery_h
+
+#include "libhandler.h"
+
+/*-----------------------------------------------------------------
+  Structured concurrency
+  A nursery runs a body and all the children it spawns as
+  cooperative tasks on the current thread, and returns once all of
+  them are done. A child that yields is parked as a first-class
+  resumption at the back of the run queue. When a child fails, the
+  children that did not finish yet are cancelled: their parked
+  resumptions are released, which frees their stacks and releases the
+  inline state of their handlers (see #lh_localreleasefun), including
+  that of nurseries nested in them.
+-----------------------------------------------------------------*/
+
+/// Run `body(arg)` in a new nursery and wait for it and all children it spawns.
+/// Returns `true` if they all completed, with `*result` set to the result of `body`.
+/// Returns `false` if a child failed, with `*result` set to the error it passed to lh_nursery_fail().
+/// A nursery may be parked inside a child of an enclosing nursery, but must not be resumed more than once.
+bool lh_nursery_run(lh_actionfun* body, lh_value arg, lh_value* result);
+
+/// Spawn `child(arg)` in the innermost nursery. It runs once the current task yields or finishes.
+/// The action must stay valid until the child is done.
+void lh_nursery_spawn(lh_actionfun* child, lh_value arg);
+
+/// Yield to the other tasks of the innermost nursery; returns when the current task is scheduled again.
+void lh_nursery_yield();
+
+/// Fail the current task with `error` and cancel the other tasks of the innermost nursery.
+/// Does not return.
+void lh_nursery_fail(lh_value error);
+
+#endif  // __nursery_h
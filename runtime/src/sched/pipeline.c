@@ -0,0 +1,243 @@
+/* ----------------------------------------------------------------------------
+  Pipelines of threads connected by rings of batches.
+
+  A channel between two stages is a `queue.c` ring whose elements are
+  whole batches: slot `i` of the ring owns `batch` items in `items`
+  and a count in `counts`. The producer keeps the slot returned by
+  `queue_push` while it fills it, and commits it when it is full (or
+  flushed); the consumer handles the items of a popped slot in place
+  and commits the pop afterwards. A count of -1 marks the end of the
+  stream. A consumer that finds its input empty first flushes its own
+  partial batch, so items do not wait downstream of an idle stage.
+-----------------------------------------------------------------------------*/
+#include "pipeline.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../queue/queue.h"
+
+#define PIPELINE_BATCH 64
+#define PIPELINE_EXP 6
+#define PIPELINE_MAXEXP 15  // queue.c keeps indices in 16 bits
+#define BACKOFF_SPINS 64
+#define BACKOFF_YIELDS 64
+#define BACKOFF_SLEEP_NS 20000
+
+typedef struct _channel {
+  _Atomic uint32_t q;
+  int exp;
+  long batch;
+  lh_value* items;  // (1 << exp) * batch items
+  long* counts;     // items in each slot, or -1 for the end
+} channel;
+
+struct _lh_emitter {
+  channel* channel;  // `NULL` after the last stage
+  int slot;          // the slot being filled, or -1
+  long count;
+};
+
+typedef struct _stage {
+  lh_stage_fun* fun;
+  lh_stage_done_fun* done;
+  void* arg;
+  channel* in;
+  lh_emitter out;
+  pthread_t thread;
+} stage;
+
+struct _lh_pipeline {
+  lh_source_fun* source;
+  void* source_arg;
+  lh_emitter source_out;
+  pthread_t source_thread;
+  long batch;
+  int exp;
+  stage* stages;
+  int count;
+  int size;
+};
+
+/*-----------------------------------------------------------------
+  Channels
+-----------------------------------------------------------------*/
+
+// Wait a little longer every time nothing can move
+static void backoff(int* round) {
+  int r = (*round)++;
+  if (r < BACKOFF_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else if (r < BACKOFF_SPINS + BACKOFF_YIELDS) {
+    sched_yield();
+  } else {
+    struct timespec ts = {0, BACKOFF_SLEEP_NS};
+    nanosleep(&ts, NULL);
+  }
+}
+
+static channel* channel_new(long batch, int exp) {
+  channel* ch = (channel*)lh_malloc(sizeof(channel));
+  if (ch == NULL) abort();
+  atomic_init(&ch->q, 0);
+  ch->exp = exp;
+  ch->batch = batch;
+  ch->items = (lh_value*)lh_malloc((size_t)(1 << exp) * batch * sizeof(lh_value));
+  ch->counts = (long*)lh_malloc((size_t)(1 << exp) * sizeof(long));
+  if (ch->items == NULL || ch->counts == NULL) abort();
+  return ch;
+}
+
+static void channel_free(channel* ch) {
+  lh_free(ch->items);
+  lh_free(ch->counts);
+  lh_free(ch);
+}
+
+// Get a free slot, waiting while the ring is full
+static int channel_reserve(channel* ch) {
+  int round = 0;
+  int slot;
+  while ((slot = queue_push(&ch->q, ch->exp)) < 0) backoff(&round);
+  return slot;
+}
+
+/*-----------------------------------------------------------------
+  Emitting
+-----------------------------------------------------------------*/
+
+static void emitter_init(lh_emitter* out, channel* ch) {
+  out->channel = ch;
+  out->slot = -1;
+  out->count = 0;
+}
+
+void lh_emit_flush(lh_emitter* out) {
+  if (out->slot < 0 || out->count == 0) return;
+  out->channel->counts[out->slot] = out->count;
+  queue_push_commit(&out->channel->q);
+  out->slot = -1;
+  out->count = 0;
+}
+
+void lh_emit(lh_emitter* out, lh_value item) {
+  channel* ch = out->channel;
+  if (ch == NULL) return;
+  if (out->slot < 0) out->slot = channel_reserve(ch);
+  ch->items[(long)out->slot * ch->batch + out->count] = item;
+  if (++out->count == ch->batch) lh_emit_flush(out);
+}
+
+// Flush and pass on the end of the stream
+static void emitter_end(lh_emitter* out) {
+  channel* ch = out->channel;
+  if (ch == NULL) return;
+  lh_emit_flush(out);
+  int slot = channel_reserve(ch);
+  ch->counts[slot] = -1;
+  queue_push_commit(&ch->q);
+}
+
+/*-----------------------------------------------------------------
+  Threads
+-----------------------------------------------------------------*/
+
+static void* source_run(void* arg) {
+  lh_pipeline* p = (lh_pipeline*)arg;
+  p->source(&p->source_out, p->source_arg);
+  emitter_end(&p->source_out);
+  return NULL;
+}
+
+static void* stage_run(void* arg) {
+  stage* s = (stage*)arg;
+  channel* in = s->in;
+  for (;;) {
+    int slot;
+    int round = 0;
+    while ((slot = queue_pop(&in->q, in->exp)) < 0) {
+      if (round == 0) lh_emit_flush(&s->out);  // going idle: publish what we have
+      backoff(&round);
+    }
+    long count = in->counts[slot];
+    if (count < 0) {
+      queue_pop_commit(&in->q);
+      break;
+    }
+    const lh_value* items = &in->items[(long)slot * in->batch];
+    for (long i = 0; i < count; i++) s->fun(items[i], &s->out, s->arg);
+    queue_pop_commit(&in->q);
+  }
+  if (s->done != NULL) s->done(&s->out, s->arg);
+  emitter_end(&s->out);
+  return NULL;
+}
+
+/*-----------------------------------------------------------------
+  Interface
+-----------------------------------------------------------------*/
+
+lh_pipeline* lh_pipeline_new(lh_source_fun* source, void* arg, long batch, int exp) {
+  lh_pipeline* p = (lh_pipeline*)lh_malloc(sizeof(lh_pipeline));
+  if (p == NULL) abort();
+  memset(p, 0, sizeof(lh_pipeline));
+  p->source = source;
+  p->source_arg = arg;
+  p->batch = (batch > 0 ? batch : PIPELINE_BATCH);
+  p->exp = (exp <= 0 ? PIPELINE_EXP : (exp > PIPELINE_MAXEXP ? PIPELINE_MAXEXP : exp));
+  if (p->exp < 2) p->exp = 2;
+  emitter_init(&p->source_out, NULL);
+  return p;
+}
+
+void lh_pipeline_add(lh_pipeline* p, lh_stage_fun* fun, lh_stage_done_fun* done, void* arg) {
+  if (p->count == p->size) {
+    int size = (p->size == 0 ? 4 : 2 * p->size);
+    stage* stages = (stage*)lh_malloc(size * sizeof(stage));
+    if (stages == NULL) abort();
+    if (p->stages != NULL) {
+      memcpy(stages, p->stages, p->count * sizeof(stage));
+      lh_free(p->stages);
+    }
+    p->stages = stages;
+    p->size = size;
+  }
+  stage* s = &p->stages[p->count++];
+  memset(s, 0, sizeof(stage));
+  s->fun = fun;
+  s->done = done;
+  s->arg = arg;
+}
+
+void lh_pipeline_run(lh_pipeline* p) {
+  // wire the channels: source -> stage 0 -> ... -> last stage
+  lh_emitter* prev = &p->source_out;
+  for (int i = 0; i < p->count; i++) {
+    stage* s = &p->stages[i];
+    s->in = channel_new(p->batch, p->exp);
+    emitter_init(prev, s->in);
+    emitter_init(&s->out, NULL);
+    prev = &s->out;
+  }
+  for (int i = p->count - 1; i >= 0; i--) {
+    if (pthread_create(&p->stages[i].thread, NULL, &stage_run, &p->stages[i]) != 0) abort();
+  }
+  if (pthread_create(&p->source_thread, NULL, &source_run, p) != 0) abort();
+  pthread_join(p->source_thread, NULL);
+  for (int i = 0; i < p->count; i++) {
+    pthread_join(p->stages[i].thread, NULL);
+    channel_free(p->stages[i].in);
+    p->stages[i].in = NULL;
+  }
+}
+
+void lh_pipeline_free(lh_pipeline* p) {
+  if (p->stages != NULL) lh_free(p->stages);
+  lh_free(p);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef __pipeline_h
+#define __pipeline_h
+
+#include "libhandler.h"
+
+/*-----------------------------------------------------------------
+  Pipelines
+  A pipeline is a source followed by stages, each running on its own
+  thread. Consecutive stages are connected by a bounded
+  single-producer single-consumer ring of batches: a stage fills a
+  batch of items in place and publishes it at once, so the threads
+  synchronize once per batch instead of once per item. When a ring is
+  full the stage that emits waits, which slows everything upstream
+  down to the pace of the slowest stage.
+
+  When the source returns, the end of the stream travels down the
+  pipeline behind the last items: each stage handles all items before
+  it, calls its `done` function, and passes the end on. The threads
+  finish from the source to the last stage.
+-----------------------------------------------------------------*/
+
+/// A pipeline.
+typedef struct _lh_pipeline lh_pipeline;
+
+/// Where a source or stage emits its items.
+typedef struct _lh_emitter lh_emitter;
+
+/// A source emits all items of the stream and returns.
+typedef void(lh_source_fun)(lh_emitter* out, void* arg);
+
+/// A stage is called for each item and can emit any number of items.
+typedef void(lh_stage_fun)(lh_value item, lh_emitter* out, void* arg);
+
+/// Called after the last item of the stream; it can still emit items.
+typedef void(lh_stage_done_fun)(lh_emitter* out, void* arg);
+
+/// Create a pipeline whose rings hold up to `2^exp - 1` batches (`exp` at most 15)
+/// of `batch` items (0 for a default of 64 items and `exp` 6).
+lh_pipeline* lh_pipeline_new(lh_source_fun* source, void* arg, long batch, int exp);
+
+/// Add a stage; `done` can be `NULL`. Items emitted by the last stage are dropped.
+void lh_pipeline_add(lh_pipeline* p, lh_stage_fun* stage, lh_stage_done_fun* done, void* arg);
+
+/// Run the pipeline, each stage on its own thread, until all stages are done.
+void lh_pipeline_run(lh_pipeline* p);
+
+void lh_pipeline_free(lh_pipeline* p);
+
+/// Emit an item to the next stage, waiting while its ring is full.
+void lh_emit(lh_emitter* out, lh_value item);
+
+/// Publish the items emitted so far without waiting for the batch to fill up.
+void lh_emit_flush(lh_emitter* out);
+
+#endif  // __pipeline_h
@@ -0,0 +1,240 @@
+/* ----------------------------------------------------------------------------
+  Mutex, semaphore, barrier and latch for actors.
+
+  Each primitive has a wait queue behind a spin lock that is only held
+  for a few instructions. A waiter is a heap node, not one on the
+  stack of the actor: the stack of a parked actor is copied away, and
+  its memory is used by the next actor on the worker.
+
+  The semaphore counts below zero for the actors that wait: `wait`
+  decrements under the queue lock and enqueues itself if there was no
+  unit, and `post` increments and, if the count was negative, dequeues
+  a waiter under the lock and wakes it with the unit. Since the waiter
+  enqueued itself before releasing the lock, `post` always finds it.
+-----------------------------------------------------------------------------*/
+#include "sync.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#define SYNC_SPINS 100        // tries before parking
+#define GUARD_SPINS 64        // spins on the queue lock before yielding the thread
+
+struct _lh_waiter {
+  lh_actor* actor;
+  lh_waiter* next;
+};
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/*-----------------------------------------------------------------
+  Wait queues
+-----------------------------------------------------------------*/
+
+static void waitq_init(lh_waitq* q) {
+  atomic_flag_clear(&q->guard);
+  q->head = NULL;
+  q->tail = NULL;
+}
+
+static void waitq_lock(lh_waitq* q) {
+  int spins = 0;
+  while (atomic_flag_test_and_set_explicit(&q->guard, memory_order_acquire)) {
+    if (++spins < GUARD_SPINS) {
+      cpu_relax();
+    } else {
+      sched_yield();  // the holder may have been descheduled
+      spins = 0;
+    }
+  }
+}
+
+static void waitq_unlock(lh_waitq* q) {
+  atomic_flag_clear_explicit(&q->guard, memory_order_release);
+}
+
+// Enqueue the running actor; under the lock
+static void waitq_push(lh_waitq* q) {
+  lh_waiter* w = (lh_waiter*)lh_malloc(sizeof(lh_waiter));
+  if (w == NULL) abort();
+  w->actor = lh_actor_self();
+  w->next = NULL;
+  if (q->tail == NULL) {
+    q->head = w;
+  } else {
+    q->tail->next = w;
+  }
+  q->tail = w;
+}
+
+// Dequeue the first waiter, or `NULL`; under the lock
+static lh_actor* waitq_pop(lh_waitq* q) {
+  lh_waiter* w = q->head;
+  if (w == NULL) return NULL;
+  q->head = w->next;
+  if (q->head == NULL) q->tail = NULL;
+  lh_actor* a = w->actor;
+  lh_free(w);
+  return a;
+}
+
+// Take all waiters; under the lock
+static lh_waiter* waitq_take(lh_waitq* q) {
+  lh_waiter* w = q->head;
+  q->head = NULL;
+  q->tail = NULL;
+  return w;
+}
+
+// Wake the waiters taken with `waitq_take`
+static void wake_all(lh_waiter* w) {
+  while (w != NULL) {
+    lh_waiter* next = w->next;
+    lh_actor_wake(w->actor);
+    lh_free(w);
+    w = next;
+  }
+}
+
+// Enqueue the running actor, release the lock and park
+static void waitq_block(lh_waitq* q) {
+  assert(lh_actor_self() != NULL);
+  waitq_push(q);
+  waitq_unlock(q);
+  lh_actor_block();
+}
+
+/*-----------------------------------------------------------------
+  Semaphore
+-----------------------------------------------------------------*/
+
+void lh_semaphore_init(lh_semaphore* sem, long count) {
+  atomic_init(&sem->count, count);
+  waitq_init(&sem->waiting);
+}
+
+bool lh_semaphore_trywait(lh_semaphore* sem) {
+  long count = atomic_load_explicit(&sem->count, memory_order_relaxed);
+  while (count > 0) {
+    if (atomic_compare_exchange_weak_explicit(&sem->count, &count, count - 1, memory_order_acquire,
+                                              memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void lh_semaphore_wait(lh_semaphore* sem) {
+  for (int i = 0; i < SYNC_SPINS; i++) {
+    if (lh_semaphore_trywait(sem)) return;
+    cpu_relax();
+  }
+  waitq_lock(&sem->waiting);
+  if (atomic_fetch_sub(&sem->count, 1) > 0) {
+    waitq_unlock(&sem->waiting);
+    return;
+  }
+  waitq_block(&sem->waiting);  // woken by `post` with its unit
+}
+
+void lh_semaphore_post(lh_semaphore* sem) {
+  if (atomic_fetch_add(&sem->count, 1) >= 0) return;
+  waitq_lock(&sem->waiting);
+  lh_actor* a = waitq_pop(&sem->waiting);
+  waitq_unlock(&sem->waiting);
+  assert(a != NULL);
+  lh_actor_wake(a);
+}
+
+/*-----------------------------------------------------------------
+  Mutex
+-----------------------------------------------------------------*/
+
+void lh_mutex_init(lh_mutex* m) {
+  lh_semaphore_init(&m->sem, 1);
+}
+
+void lh_mutex_lock(lh_mutex* m) {
+  lh_semaphore_wait(&m->sem);
+}
+
+bool lh_mutex_trylock(lh_mutex* m) {
+  return lh_semaphore_trywait(&m->sem);
+}
+
+void lh_mutex_unlock(lh_mutex* m) {
+  lh_semaphore_post(&m->sem);
+}
+
+/*-----------------------------------------------------------------
+  Barrier
+-----------------------------------------------------------------*/
+
+void lh_barrier_init(lh_barrier* b, long parties) {
+  b->parties = (parties < 1 ? 1 : parties);
+  b->arrived = 0;
+  atomic_init(&b->generation, 0);
+  waitq_init(&b->waiting);
+}
+
+bool lh_barrier_wait(lh_barrier* b) {
+  waitq_lock(&b->waiting);
+  long generation = atomic_load_explicit(&b->generation, memory_order_relaxed);
+  if (++b->arrived == b->parties) {
+    b->arrived = 0;
+    atomic_store(&b->generation, generation + 1);
+    lh_waiter* waiters = waitq_take(&b->waiting);
+    waitq_unlock(&b->waiting);
+    wake_all(waiters);
+    return true;
+  }
+  waitq_unlock(&b->waiting);
+  for (int i = 0; i < SYNC_SPINS; i++) {
+    if (atomic_load(&b->generation) != generation) return false;
+    cpu_relax();
+  }
+  waitq_lock(&b->waiting);
+  if (atomic_load_explicit(&b->generation, memory_order_relaxed) != generation) {
+    waitq_unlock(&b->waiting);
+    return false;
+  }
+  waitq_block(&b->waiting);
+  return false;
+}
+
+/*-----------------------------------------------------------------
+  Latch
+-----------------------------------------------------------------*/
+
+void lh_latch_init(lh_latch* l, long count) {
+  atomic_init(&l->count, count);
+  waitq_init(&l->waiting);
+}
+
+void lh_latch_count_down(lh_latch* l, long n) {
+  long count = atomic_fetch_sub(&l->count, n);
+  if (count > 0 && count - n <= 0) {
+    waitq_lock(&l->waiting);
+    lh_waiter* waiters = waitq_take(&l->waiting);
+    waitq_unlock(&l->waiting);
+    wake_all(waiters);
+  }
+}
+
+void lh_latch_wait(lh_latch* l) {
+  for (int i = 0; i < SYNC_SPINS; i++) {
+    if (atomic_load(&l->count) <= 0) return;
+    cpu_relax();
+  }
+  waitq_lock(&l->waiting);
+  if (atomic_load_explicit(&l->count, memory_order_relaxed) <= 0) {
+    waitq_unlock(&l->waiting);
+    return;
+  }
+  waitq_block(&l->waiting);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef __sync_h
+#define __sync_h
+
+#include <stdatomic.h>
+
+#include "actor.h"
+
+/*-----------------------------------------------------------------
+  Synchronization between actors
+  Waiting spins for a short while and then parks the actor with
+  lh_actor_block(), so its worker goes on running other actors.
+  Releasing hands the resource directly to the first waiter, in FIFO
+  order, so a woken actor never has to compete for it again.
+
+  Waiting must happen in an actor; releasing (unlock, post, count
+  down) can happen on any thread. Everything is initialized by its
+  `_init` function and needs no cleanup once nobody waits.
+-----------------------------------------------------------------*/
+
+typedef struct _lh_waiter lh_waiter;
+
+// A FIFO of parked actors behind a spin lock
+typedef struct _lh_waitq {
+  atomic_flag guard;
+  lh_waiter* head;
+  lh_waiter* tail;
+} lh_waitq;
+
+/// A counting semaphore.
+typedef struct _lh_semaphore {
+  _Atomic long count;  // negative: the number of actors waiting
+  lh_waitq waiting;
+} lh_semaphore;
+
+void lh_semaphore_init(lh_semaphore* sem, long count);
+
+/// Take a unit, waiting until there is one.
+void lh_semaphore_wait(lh_semaphore* sem);
+
+/// Take a unit if there is one without waiting.
+bool lh_semaphore_trywait(lh_semaphore* sem);
+
+/// Give a unit back; goes to the first waiter if there is one.
+void lh_semaphore_post(lh_semaphore* sem);
+
+/// A mutex; it is not reentrant, and can be unlocked by another actor than the one that locked it.
+typedef struct _lh_mutex {
+  lh_semaphore sem;
+} lh_mutex;
+
+void lh_mutex_init(lh_mutex* m);
+void lh_mutex_lock(lh_mutex* m);
+bool lh_mutex_trylock(lh_mutex* m);
+void lh_mutex_unlock(lh_mutex* m);
+
+/// A reusable barrier for a fixed number of actors.
+typedef struct _lh_barrier {
+  long parties;
+  long arrived;
+  _Atomic long generation;
+  lh_waitq waiting;
+} lh_barrier;
+
+void lh_barrier_init(lh_barrier* b, long parties);
+
+/// Wait until `parties` actors arrived; returns `true` in exactly one of them per round.
+bool lh_barrier_wait(lh_barrier* b);
+
+/// A one-shot latch that opens when its count reaches zero.
+typedef struct _lh_latch {
+  _Atomic long count;
+  lh_waitq waiting;
+} lh_latch;
+
+void lh_latch_init(lh_latch* l, long count);
+
+/// Count down by `n`; opens the latch when the count reaches zero.
+void lh_latch_count_down(lh_latch* l, long n);
+
+/// Wait until the latch is open.
+void lh_latch_wait(lh_latch* l);
+
+#endif  // __sync_h
@@ -0,0 +1,138 @@
+/* ----------------------------------------------------------------------------
+  CPU topology from sysfs, thread pinning, and node-local memory.
+
+  Memory is placed on a node with the `mbind` system call directly, so
+  there is no dependency on libnuma; on a single node, or where the
+  call is not available, the memory just goes where the first thread
+  that touches it runs.
+-----------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include "topology.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define MAX_NODES 1024
+
+// Read one integer from `<sysdir>/cpu/cpu<cpu>/<file>`; returns `deflt` if there is none
+static int read_int(const char* sysdir, int cpu, const char* file, int deflt) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/cpu/cpu%d/%s", sysdir, cpu, file);
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return deflt;
+  int value;
+  if (fscanf(f, "%d", &value) != 1 || value < 0) value = deflt;
+  fclose(f);
+  return value;
+}
+
+// The node of a cpu is the `node<n>` entry in its sysfs directory
+static int read_node(const char* sysdir, int cpu) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/cpu/cpu%d", sysdir, cpu);
+  DIR* dir = opendir(path);
+  if (dir == NULL) return 0;
+  int node = 0;
+  struct dirent* e;
+  while ((e = readdir(dir)) != NULL) {
+    int n;
+    if (strncmp(e->d_name, "node", 4) == 0 && sscanf(e->d_name + 4, "%d", &n) == 1) {
+      node = n;
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+static int compare_placement(const void* x, const void* y) {
+  const lh_cpu* a = (const lh_cpu*)x;
+  const lh_cpu* b = (const lh_cpu*)y;
+  if (a->node != b->node) return a->node - b->node;
+  if (a->package != b->package) return a->package - b->package;
+  if (a->smt != b->smt) return a->smt - b->smt;
+  if (a->cluster != b->cluster) return a->cluster - b->cluster;
+  if (a->core != b->core) return a->core - b->core;
+  return a->cpu - b->cpu;
+}
+
+bool lh_topology_read(lh_topology* topo, const char* sysdir) {
+  if (sysdir == NULL) sysdir = "/sys/devices/system";
+  memset(topo, 0, sizeof(lh_topology));
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  int count = CPU_COUNT(&allowed);
+  if (count <= 0) return false;
+  lh_cpu* cpus = (lh_cpu*)malloc(count * sizeof(lh_cpu));
+  if (cpus == NULL) return false;
+  int n = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE && n < count; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    lh_cpu* c = &cpus[n++];
+    c->cpu = cpu;
+    c->core = read_int(sysdir, cpu, "topology/core_id", cpu);
+    c->package = read_int(sysdir, cpu, "topology/physical_package_id", 0);
+    c->cluster = read_int(sysdir, cpu, "topology/cluster_id", c->core);
+    c->node = read_node(sysdir, cpu);
+    c->smt = 0;
+    for (int i = 0; i < n - 1; i++) {
+      if (cpus[i].package == c->package && cpus[i].core == c->core) c->smt++;
+    }
+  }
+  qsort(cpus, n, sizeof(lh_cpu), &compare_placement);
+  int nodes = 0;
+  for (int i = 0; i < n; i++) {
+    if (i == 0 || cpus[i].node != cpus[i - 1].node) nodes++;
+  }
+  topo->count = n;
+  topo->cpus = cpus;
+  topo->nodes = nodes;
+  return true;
+}
+
+void lh_topology_free(lh_topology* topo) {
+  free(topo->cpus);
+  topo->cpus = NULL;
+  topo->count = 0;
+}
+
+int lh_topology_distance(const lh_cpu* a, const lh_cpu* b) {
+  if (a->node != b->node) return 5;
+  if (a->package != b->package) return 4;
+  if (a->cluster != b->cluster) return 3;
+  if (a->core != b->core) return 2;
+  return (a->cpu == b->cpu ? 0 : 1);
+}
+
+bool lh_topology_pin(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return (sched_setaffinity(0, sizeof(set), &set) == 0);
+}
+
+void* lh_node_alloc(size_t size, int node, int nodes) {
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return NULL;
+  if (nodes > 1 && node >= 0 && node < MAX_NODES) {
+    unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, (unsigned long)MAX_NODES, 0);  // a hint; ignore failure
+  }
+  return p;
+}
+
+void lh_node_free(void* p, size_t size) {
+  if (p != NULL) munmap(p, size);
+}
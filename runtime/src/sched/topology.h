@@ -0,0 +1,50 @@
+#pragma once
+#ifndef __topology_h
+#define __topology_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*-----------------------------------------------------------------
+  CPU topology
+  Read from `/sys/devices/system/cpu` for the cpus this thread may
+  run on (so `taskset` restricts it). Where the files are missing,
+  every cpu counts as its own core in one package on one node.
+-----------------------------------------------------------------*/
+
+/// A cpu and where it sits. Ids are as in sysfs and are only unique within their parent.
+typedef struct _lh_cpu {
+  int cpu;
+  int core;     // core within the package
+  int cluster;  // cluster of cores sharing a cache within the package
+  int package;  // socket
+  int node;     // NUMA node
+  int smt;      // index among the hardware threads of its core
+} lh_cpu;
+
+typedef struct _lh_topology {
+  int count;    // number of usable cpus
+  lh_cpu* cpus; // in placement order: node by node, one thread per core before the siblings
+  int nodes;    // number of NUMA nodes among them
+} lh_topology;
+
+/// Read the topology of the usable cpus from `sysdir` (`NULL` for `/sys/devices/system`).
+/// Returns `false` if no cpu is usable.
+bool lh_topology_read(lh_topology* topo, const char* sysdir);
+
+void lh_topology_free(lh_topology* topo);
+
+/// How far apart two cpus are: 0 for the same cpu, then same core, same cluster,
+/// same package, same node, and 5 for different nodes.
+int lh_topology_distance(const lh_cpu* a, const lh_cpu* b);
+
+/// Pin the calling thread to a cpu; returns `false` if that is not allowed.
+bool lh_topology_pin(int cpu);
+
+/// Allocate `size` bytes of zeroed memory placed on `node` if there are several `nodes`.
+/// The memory is mapped per page, so use it for large per-thread structures.
+void* lh_node_alloc(size_t size, int node, int nodes);
+
+void lh_node_free(void* p, size_t size);
+
+#endif  // __topology_h
@@ -0,0 +1,116 @@
+// Poll a libhandler metrics page (see `lh_metrics_open`) and print rates.
+//
+//   clang-18 -O2 -I../src/handlers metrics_reader.c -o metrics_reader
+//   ./metrics_reader <path> [interval-ms]
+//
+// The page is read with the seqlock protocol from `metrics.h`, so the
+// publishing process is never stopped or slowed down by the reader.
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+struct snapshot {
+  uint64_t timestamp_ns;
+  uint64_t publishes;
+  uint64_t operations;
+  uint64_t captured;
+  uint64_t resumed;
+  uint64_t released;
+  uint64_t captured_bytes;
+  uint64_t hstack_max;
+  uint32_t queue_count;
+  uint64_t depth[LH_METRICS_MAX_QUEUES];
+};
+
+static uint64_t load(_Atomic uint64_t *field) {
+  return atomic_load_explicit(field, memory_order_relaxed);
+}
+
+static void read_snapshot(lh_metrics_page *m, struct snapshot *s) {
+  uint64_t before, after;
+  do {
+    while ((before = atomic_load_explicit(&m->seq, memory_order_acquire)) & 1) {
+    }
+    s->timestamp_ns = load(&m->timestamp_ns);
+    s->publishes = load(&m->publishes);
+    s->operations = load(&m->operations);
+    s->captured = load(&m->captured);
+    s->resumed = load(&m->resumed);
+    s->released = load(&m->released);
+    s->captured_bytes = load(&m->captured_bytes);
+    s->hstack_max = load(&m->hstack_max);
+    s->queue_count = atomic_load_explicit(&m->queue_count, memory_order_relaxed);
+    if (s->queue_count > LH_METRICS_MAX_QUEUES) s->queue_count = LH_METRICS_MAX_QUEUES;
+    for (uint32_t i = 0; i < s->queue_count; i++) {
+      s->depth[i] = load(&m->queues[i].depth);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&m->seq, memory_order_relaxed);
+  } while (before != after);
+}
+
+static double rate(uint64_t now, uint64_t prev, double secs) {
+  return secs > 0 ? (double)(now - prev) / secs : 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <metrics-file> [interval-ms]\n", argv[0]);
+    return 2;
+  }
+  long interval_ms = argc > 2 ? atol(argv[2]) : 1000;
+
+  int fd = open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  void *p = mmap(NULL, sizeof(lh_metrics_page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  lh_metrics_page *m = p;
+  if (m->magic != LH_METRICS_MAGIC || m->version != LH_METRICS_VERSION || m->size < sizeof(lh_metrics_page)) {
+    fprintf(stderr, "%s: not a version %d metrics page\n", argv[1], LH_METRICS_VERSION);
+    return 1;
+  }
+  printf("pid %u\n", m->pid);
+
+  struct snapshot prev, cur;
+  read_snapshot(m, &prev);
+  for (;;) {
+    struct timespec ts = {interval_ms / 1000, (interval_ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+    read_snapshot(m, &cur);
+    if (cur.publishes == prev.publishes) {
+      printf("(no new data)\n");
+      fflush(stdout);
+      continue;
+    }
+    double secs = (double)(cur.timestamp_ns - prev.timestamp_ns) / 1e9;
+    printf("ops/s %10.0f  captured/s %9.0f  resumed/s %9.0f  released/s %9.0f  "
+           "captured kb/s %8.0f  parked %6lld  hstack max %lu kb",
+           rate(cur.operations, prev.operations, secs),
+           rate(cur.captured, prev.captured, secs),
+           rate(cur.resumed, prev.resumed, secs),
+           rate(cur.released, prev.released, secs),
+           rate(cur.captured_bytes, prev.captured_bytes, secs) / 1024,
+           (long long)(cur.captured - cur.released),
+           (unsigned long)((cur.hstack_max + 1023) / 1024));
+    for (uint32_t i = 0; i < cur.queue_count; i++) {
+      printf("  %s %lu", m->queues[i].name, (unsigned long)cur.depth[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+    prev = cur;
+  }
+}